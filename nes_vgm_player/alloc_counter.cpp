@@ -0,0 +1,39 @@
+/*
+ * alloc_counter.cpp - Heap allocation counter for checking the real time render path
+ */
+#include "alloc_counter.h"
+
+#ifndef NDEBUG
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+// The array and nothrow forms of the standard library forward to these
+void* operator new(std::size_t size)
+{
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+uint64_t threadAllocationCount()
+{
+    return allocations;
+}
+#else
+uint64_t threadAllocationCount()
+{
+    return 0;
+}
+#endif
@@ -0,0 +1,15 @@
+/*
+ * alloc_counter.h - Heap allocation counter for checking the real time render path
+ *
+ * Debug builds replace the global operator new to count the allocations of
+ * every thread. Release builds keep the standard allocator and count nothing.
+ */
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Heap allocations made so far by the calling thread (always 0 in release builds)
+uint64_t threadAllocationCount();
+
+#endif
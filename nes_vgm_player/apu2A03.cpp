@@ -6,6 +6,9 @@
  */
 
 #include "apu2A03.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include <bit>
 #include <cstdint>
 #include <cstring>
 
@@ -13,9 +16,6 @@ using namespace std;
 
 #define DMA_ATTR
 #define IRAM_ATTR
-#define SAMPLE_RATE 44100
-
-DMA_ATTR uint8_t Apu2A03::audio_buffer[AUDIO_BUFFER_SIZE];
 
 Apu2A03::Apu2A03()
 {
@@ -252,6 +252,33 @@ IRAM_ATTR void Apu2A03::clock()
 	triangleChannelClock(triangle, triangle_enable);
 	triangleChannelClock(triangle, triangle_enable);
 
+	frameCounterClock();
+	silenceMutedPulses();
+
+	// Silencing the triangle channel when triangle.seq.reload < 2 is considered less accurate emulation,
+	// but eliminates high frequencies and popping
+	// if (!triangle_enable || triangle.len_counter.timer == 0 || triangle.seq.reload < 2) 
+	// {
+	// 	triangle.seq.output = 0;
+	// 	triangle.env.output = 0;
+	// }
+
+	// Put sound channels output into audio buffers
+	// Generate sample every 20.29221088 clocks
+	// (1.789773 MHz / 2) / 44100 Hz, see apu_timing.h
+	buffer_full = false;
+	if (sample_time > APU_TIME_PER_SAMPLE)
+	{
+		generateSample();
+		sample_time -= APU_TIME_PER_SAMPLE;
+	}
+
+	sample_time += APU_TIME_PER_CYCLE;
+	clock_counter++;
+}
+
+IRAM_ATTR void Apu2A03::frameCounterClock()
+{
     switch (clock_counter)
     {
     case 3728:
@@ -325,7 +352,10 @@ IRAM_ATTR void Apu2A03::clock()
         }
         break;
     }
+}
 
+IRAM_ATTR void Apu2A03::silenceMutedPulses()
+{
 	// Mute sound channels if muted
 	if (pulse1.sweep.mute || pulse1.seq.reload < 8 || pulse1.len_counter.timer == 0)
 	{
@@ -337,36 +367,8 @@ IRAM_ATTR void Apu2A03::clock()
 		pulse2.seq.output = 0;
 		pulse2.env.output = 0;
 	}
-	// Silencing the triangle channel when triangle.seq.reload < 2 is considered less accurate emulation,
-	// but eliminates high frequencies and popping
-	// if (!triangle_enable || triangle.len_counter.timer == 0 || triangle.seq.reload < 2) 
-	// {
-	// 	triangle.seq.output = 0;
-	// 	triangle.env.output = 0;
-	// }
-
-	// Put sound channels output into audio buffers
-	// Generate sample every 20.29221088 clocks
-	// (1.789773 MHz / 2) / 44100 Hz
-	buffer_full = false;
-	if (pulse_hz > 894886)
-	{
-		generateSample();
-		pulse_hz -= 894886;
-	}
-
-    // if (pulse_hz > 1073863)
-	// {
-	// 	generateSample();
-	// 	pulse_hz -= 1073863;
-	// }
-    
-	pulse_hz += SAMPLE_RATE;
-	clock_counter++;
 }
 
-extern void putAudioStreamData(const void* buf, int len);
-
 IRAM_ATTR void Apu2A03::generateSample()
 {
     uint16_t index = buffer_index; //(buffer_index << 1); 
@@ -397,11 +399,140 @@ IRAM_ATTR void Apu2A03::generateSample()
 			samples[i] = audio_buffer[i];
 		}*/
 
-		putAudioStreamData(audio_buffer, sizeof(audio_buffer));
+		if (output_callback) output_callback(output_userdata, audio_buffer, sizeof(audio_buffer));
 
     }
 }
 
+void Apu2A03::flushAudioBuffer()
+{
+	if (buffer_index == 0) return;
+	if (output_callback) output_callback(output_userdata, audio_buffer, buffer_index);
+	buffer_index = 0;
+}
+
+void Apu2A03::restoreState(const Apu2A03& state)
+{
+	Bus* connected_bus = bus;
+	Cpu6502* connected_cpu = cpu;
+	AudioOutputCallback callback = output_callback;
+	void* userdata = output_userdata;
+	*this = state;
+	bus = connected_bus;
+	cpu = connected_cpu;
+	output_callback = callback;
+	output_userdata = userdata;
+}
+
+template<typename Self, typename Visitor>
+void Apu2A03::visitState(Self& apu, Visitor& visit)
+{
+	auto sequencer = [&](auto& seq) {
+		visit(seq.duty_cycle); visit(seq.cycle_position); visit(seq.timer); visit(seq.reload); visit(seq.output);
+	};
+	auto envelope = [&](auto& env) {
+		visit(env.start_flag); visit(env.loop); visit(env.constant_volume); visit(env.volume);
+		visit(env.timer); visit(env.output); visit(env.decay_level_counter);
+	};
+	auto length = [&](auto& len) { visit(len.enable); visit(len.halt); visit(len.timer); };
+	auto pulse = [&](auto& channel) {
+		sequencer(channel.seq);
+		envelope(channel.env);
+		auto& sweep = channel.sweep;
+		visit(sweep.enable); visit(sweep.negate); visit(sweep.reload_flag); visit(sweep.mute);
+		visit(sweep.pulse_channel_number); visit(sweep.shift_count); visit(sweep.change);
+		visit(sweep.timer); visit(sweep.reload); visit(sweep.target_period);
+		length(channel.len_counter);
+	};
+
+	visit(apu.cycle_count);
+	visit(apu.output);
+	visit(apu.clock_counter);
+	visit(apu.sample_time);
+	visit(apu.wait_scheduler);
+	visit(apu.four_step_sequence_mode);
+	visit(apu.buffer_full);
+	visit(apu.interrupt_inhibit);
+	visit(apu.IRQ);
+	visit(apu.DMC_sample_byte);
+
+	pulse(apu.pulse1);
+	visit(apu.pulse1_enable);
+	pulse(apu.pulse2);
+	visit(apu.pulse2_enable);
+
+	sequencer(apu.triangle.seq);
+	length(apu.triangle.len_counter);
+	auto& linear = apu.triangle.lin_counter;
+	visit(linear.control); visit(linear.reload_flag); visit(linear.counter); visit(linear.reload);
+	visit(apu.triangle_enable);
+
+	envelope(apu.noise.env);
+	length(apu.noise.len_counter);
+	visit(apu.noise.timer); visit(apu.noise.reload); visit(apu.noise.shift_register);
+	visit(apu.noise.output); visit(apu.noise.mode);
+	visit(apu.noise_enable);
+
+	auto& dmc = apu.DMC;
+	visit(dmc.IRQ_flag); visit(dmc.loop_flag); visit(dmc.sample_buffer_empty); visit(dmc.sample_buffer);
+	visit(dmc.sample_address); visit(dmc.sample_length); visit(dmc.timer); visit(dmc.reload);
+	visit(dmc.output_unit.shift_register); visit(dmc.output_unit.remaining_bits);
+	visit(dmc.output_unit.output_level); visit(dmc.output_unit.silence_flag);
+	visit(dmc.memory_reader.address); visit(dmc.memory_reader.remaining_bytes);
+	visit(apu.DMC_enable);
+}
+
+// Snapshot field encodings: integers little endian in their own size, bools
+// as one byte, doubles as their bit pattern
+struct StateSizer
+{
+	size_t size = 0;
+	template<typename T> void operator()(const T&) { size += sizeof(T); }
+};
+
+struct StateWriter
+{
+	uint8_t* out;
+	void put(uint64_t value, size_t bytes) { for (size_t i = 0; i < bytes; i++) *out++ = uint8_t(value >> (8 * i)); }
+	void operator()(double value) { put(std::bit_cast<uint64_t>(value), 8); }
+	void operator()(const ApuScheduler& scheduler) { put(scheduler.fraction(), 4); }
+	template<typename T> void operator()(T value) { put(uint64_t(value), sizeof(T)); }
+};
+
+struct StateReader
+{
+	const uint8_t* in;
+	uint64_t get(size_t bytes) { uint64_t value = 0; for (size_t i = 0; i < bytes; i++) value |= uint64_t(*in++) << (8 * i); return value; }
+	void operator()(double& value) { value = std::bit_cast<double>(get(8)); }
+	void operator()(ApuScheduler& scheduler) { scheduler.setFraction(uint32_t(get(4))); }
+	void operator()(bool& value) { value = get(1) != 0; }
+	template<typename T> void operator()(T& value) { value = T(get(sizeof(T))); }
+};
+
+size_t Apu2A03::stateSize()
+{
+	static const size_t size = [] {
+		Apu2A03 apu;
+		StateSizer sizer;
+		visitState(apu, sizer);
+		return sizer.size;
+	}();
+	return size;
+}
+
+void Apu2A03::writeState(uint8_t* out) const
+{
+	StateWriter writer{out};
+	visitState(*this, writer);
+}
+
+void Apu2A03::readState(const uint8_t* in)
+{
+	StateReader reader{in};
+	visitState(*this, reader);
+	buffer_index = 0;
+}
+
 IRAM_ATTR void Apu2A03::pulseChannelClock(sequencerUnit& seq, bool enable)
 {
 	if (!enable) return;
@@ -7,54 +7,78 @@
 #ifndef APU2A03_H
 #define APU2A03_H
 
+#include <cstddef>
 #include <cstdint>
 
+#include "apu_timing.h"
+
 using namespace std;
 
 #define AUDIO_BUFFER_SIZE 2048
 
+// Called every time the audio buffer has been filled (or flushed)
+typedef void (*AudioOutputCallback)(void* userdata, const uint8_t* buf, int len);
+
 class Bus;
 class Cpu6502;
 
-class Bus
-{
-public:
-	uint8_t cpuRead(uint16_t addr) { return 0; }
-};
-class Cpu6502
-{
-public:
-	int cycles = 0;
-};
-
 class Apu2A03
 {
+	// Steps several instances in SIMD lanes and reuses the scalar code for rare events
+	friend class Apu2A03xN;
+
 public:
     Apu2A03();
     ~Apu2A03();
 
 public:
     void connectBus(Bus* n) { bus = n; }
+	Bus* connectedBus() const { return bus; }
     void connectCPU(Cpu6502* n) { cpu = n; }
     void cpuWrite(uint16_t addr, uint8_t data);
     uint8_t cpuRead(uint16_t addr);
     void clock();
-	void clock(uint32_t cycles) { for (uint32_t i = 0; i < cycles; i++) clock(); }
+	void clock(uint32_t cycles) { cycle_count += cycles; for (uint32_t i = 0; i < cycles; i++) clock(); }
+	// Converts a VGM wait into APU cycles; the fraction of a cycle left over is
+	// part of the APU state and carried into the next wait
+	uint32_t waitCycles(uint32_t samples) { return wait_scheduler.cycles(samples); }
+	void resetWaitScheduler() { wait_scheduler.reset(); }
+	// Generates samples at the same cycles as 'other' from now on
+	void alignSampleClock(const Apu2A03& other) { sample_time = other.sample_time; }
     void resetChannels();
 	bool isBufferFull() { return buffer_full; }
-    static uint8_t audio_buffer[AUDIO_BUFFER_SIZE];
+	void setOutputCallback(AudioOutputCallback callback, void* userdata) { output_callback = callback; output_userdata = userdata; }
+	AudioOutputCallback outputCallback() const { return output_callback; }
+	void* outputUserdata() const { return output_userdata; }
+	void flushAudioBuffer();
+	// Takes over the emulation state of another instance, keeping bus, CPU and output connections
+	void restoreState(const Apu2A03& state);
+	// Compact binary snapshot of the emulation state for checkpoints: every
+	// field little endian, stateSize() bytes. Connections and the audio buffer
+	// are not part of it, flush the buffer before writing a snapshot.
+	static size_t stateSize();
+	void writeState(uint8_t* out) const;
+	void readState(const uint8_t* in);
+	// Compares the complete emulation state (used to prove register writes to be no-ops)
+	bool operator==(const Apu2A03& other) const = default;
+    uint8_t audio_buffer[AUDIO_BUFFER_SIZE];
 
     uint8_t DMC_sample_byte = 0;
 	bool IRQ = false;
 	uint32_t buffer_index = 0;
+	// Cycles run through clock(cycles), for statistics
+	uint64_t cycle_count = 0;
 
 
 private:
 	Bus* bus = nullptr;
 	Cpu6502* cpu = nullptr;
+	AudioOutputCallback output_callback = nullptr;
+	void* output_userdata = nullptr;
 	double output = 0.0;
     uint32_t clock_counter = 0;
-	uint32_t pulse_hz = 0;
+	uint32_t sample_time = 0;	// time since the last sample, in apu_timing.h units
+	ApuScheduler wait_scheduler;
 	bool four_step_sequence_mode = true;
 	bool buffer_full = false;
 
@@ -98,6 +122,8 @@ private:
 		uint16_t timer = 0x0000;
 		uint16_t reload = 0x0000;
 		uint8_t output = 0x00;
+
+		bool operator==(const sequencerUnit&) const = default;
 	};
 	struct linear_counter
 	{
@@ -105,6 +131,8 @@ private:
 		bool reload_flag = false;
 		uint8_t counter = 0x00;
 		uint8_t reload = 0x00;
+
+		bool operator==(const linear_counter&) const = default;
 	};
 	struct envelopeUnit
 	{
@@ -115,6 +143,8 @@ private:
 		uint8_t timer = 0x00;
 		uint8_t output = 0x00;
 		uint8_t decay_level_counter = 0x00;
+
+		bool operator==(const envelopeUnit&) const = default;
 	};
 	struct sweepUnit
 	{
@@ -128,17 +158,23 @@ private:
 		uint16_t timer = 0x0000;
 		uint16_t reload = 0x0000;
 		int16_t target_period = 0x0000;
+
+		bool operator==(const sweepUnit&) const = default;
 	};
 	struct length_counter
 	{
 		bool enable = false;
 		bool halt = false;
 		uint8_t timer = 0x00;
+
+		bool operator==(const length_counter&) const = default;
 	};
 	struct memoryReader
 	{
 		uint16_t address = 0x0000;
 		int16_t remaining_bytes = 0;
+
+		bool operator==(const memoryReader&) const = default;
 	};
 	struct outputUnit
 	{
@@ -146,6 +182,8 @@ private:
 		int16_t remaining_bits = 0;
 		uint8_t output_level = 0;
 		bool silence_flag = false;
+
+		bool operator==(const outputUnit&) const = default;
 	};
 
 	// Sound Channels 
@@ -155,12 +193,16 @@ private:
 		envelopeUnit env;
 		sweepUnit sweep;
 		length_counter len_counter;
+
+		bool operator==(const pulseChannel&) const = default;
 	};
 	struct triangleChannel
 	{
 		sequencerUnit seq;
 		length_counter len_counter;
 		linear_counter lin_counter;
+
+		bool operator==(const triangleChannel&) const = default;
 	};
 	struct noiseChannel
 	{
@@ -171,6 +213,8 @@ private:
 		uint16_t shift_register = 0x01;
 		uint8_t output = 0x00;
 		bool mode = false;
+
+		bool operator==(const noiseChannel&) const = default;
 	};
 	struct DMCChannel
 	{
@@ -184,6 +228,8 @@ private:
 		uint16_t reload = 0x0000;
 		outputUnit output_unit;
 		memoryReader memory_reader;
+
+		bool operator==(const DMCChannel&) const = default;
 	};
 
 	bool interrupt_inhibit = false;
@@ -207,7 +253,13 @@ private:
 	DMCChannel DMC;
 	bool DMC_enable = false;
 
+	// Calls visit(field) for every field of a snapshot, in snapshot order
+	template<typename Self, typename Visitor>
+	static void visitState(Self& apu, Visitor& visit);
+
 	void generateSample();
+	void frameCounterClock();
+	void silenceMutedPulses();
 
 	void pulseChannelClock(sequencerUnit& seq, bool enable);
 	void triangleChannelClock(triangleChannel& triangle, bool enable);
@@ -0,0 +1,383 @@
+/*
+ * apu2A03_multi.cpp - Several NES APU instances stepped together in SIMD lanes
+ */
+#include "apu2A03_multi.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+// Values of the frame counter at which the scalar APU may clock its envelopes,
+// sweeps and length counters (or reset the sequence)
+static constexpr uint32_t FRAME_COUNTER_STEPS[] = { 3728, 7456, 11185, 14914, 18640 };
+
+// GCC and Clang can compile a second copy of the channel loop for AVX2, which
+// fills one register with the 8 lanes. Builds that target AVX2 already don't need it.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__AVX2__)
+#define APU2A03XN_AVX2_CLONE
+#endif
+
+Apu2A03xN::Apu2A03xN()
+{
+    for (int l = 0; l < LANES; l++) gatherLane(l);
+#ifdef APU2A03XN_AVX2_CLONE
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+// No register write reads the state owned by the lane arrays, so the scalar
+// APU applies the write and only the fields that register can change are
+// copied into the arrays
+void Apu2A03xN::cpuWrite(int l, uint16_t addr, uint8_t data)
+{
+    Apu2A03& apu = lanes[l];
+    apu.cpuWrite(addr, data);
+
+    switch (addr) {
+    case 0x4000: case 0x4002: case 0x4003:
+    case 0x4004: case 0x4006: case 0x4007: {
+        int p = (addr >> 2) & 1;
+        const Apu2A03::sequencerUnit& seq = p ? apu.pulse2.seq : apu.pulse1.seq;
+        if ((addr & 3) == 3) {
+            pulse_timer[p][l] = seq.timer;
+            pulse_position[p][l] = seq.cycle_position;
+        }
+        pulse_pattern[p][l] = dutyPattern(seq.duty_cycle, pulse_position[p][l]);
+        refreshPulse(p, l);
+        break;
+    }
+    case 0x400B:
+        triangle_timer[l] = apu.triangle.seq.timer;
+        [[fallthrough]];
+    case 0x400A:
+        refreshTriangle(l);
+        break;
+    case 0x400E: case 0x400F:
+        refreshNoise(l);
+        break;
+    case 0x4010:
+        DMC_timer[l] = apu.DMC.timer;
+        break;
+    case 0x4011:
+        DMC_level[l] = apu.DMC.output_unit.output_level;
+        break;
+    case 0x4015:
+        refreshPulse(0, l);
+        refreshPulse(1, l);
+        refreshTriangle(l);
+        refreshNoise(l);
+        DMC_enable[l] = apu.DMC_enable;
+        break;
+    }
+}
+
+void Apu2A03xN::setOutputCallback(int lane, AudioOutputCallback callback, void* userdata)
+{
+    output_callback[lane] = callback;
+    output_userdata[lane] = userdata;
+}
+
+void Apu2A03xN::flushAudioBuffer()
+{
+    if (buffer_index == 0) return;
+    for (int l = 0; l < LANES; l++) {
+        if (output_callback[l]) output_callback[l](output_userdata[l], audio_buffer[l], buffer_index);
+    }
+    buffer_index = 0;
+}
+
+void Apu2A03xN::finishLane(int lane)
+{
+    if (buffer_index && output_callback[lane]) output_callback[lane](output_userdata[lane], audio_buffer[lane], buffer_index);
+    output_callback[lane] = nullptr;
+}
+
+Apu2A03 Apu2A03xN::lane(int lane)
+{
+    scatterLane(lane);
+    Apu2A03 copy = lanes[lane];
+    copy.setOutputCallback(nullptr, nullptr);
+    copy.buffer_index = buffer_index;
+    return copy;
+}
+
+// Copies the scalar state of a lane into the lane arrays
+void Apu2A03xN::gatherLane(int l)
+{
+    const Apu2A03& apu = lanes[l];
+    const Apu2A03::pulseChannel* pulse[2] = { &apu.pulse1, &apu.pulse2 };
+
+    clock_counter[l] = apu.clock_counter;
+    for (int p = 0; p < 2; p++) {
+        const Apu2A03::pulseChannel& ch = *pulse[p];
+        pulse_timer[p][l] = ch.seq.timer;
+        pulse_position[p][l] = ch.seq.cycle_position;
+        pulse_pattern[p][l] = dutyPattern(ch.seq.duty_cycle, ch.seq.cycle_position);
+        pulse_output[p][l] = ch.seq.output;
+        pulse_volume[p][l] = ch.env.output;
+        refreshPulse(p, l);
+    }
+
+    triangle_timer[l] = apu.triangle.seq.timer;
+    triangle_position[l] = apu.triangle.seq.duty_cycle;
+    triangle_output[l] = apu.triangle.seq.output;
+    refreshTriangle(l);
+
+    noise_timer[l] = apu.noise.timer;
+    noise_shift_register[l] = apu.noise.shift_register;
+    noise_output[l] = apu.noise.output;
+    refreshNoise(l);
+
+    DMC_timer[l] = apu.DMC.timer;
+    DMC_enable[l] = apu.DMC_enable;
+    DMC_level[l] = apu.DMC.output_unit.output_level;
+}
+
+void Apu2A03xN::refreshPulse(int p, int l)
+{
+    const Apu2A03& apu = lanes[l];
+    const Apu2A03::pulseChannel& ch = p ? apu.pulse2 : apu.pulse1;
+    pulse_enable[p][l] = p ? apu.pulse2_enable : apu.pulse1_enable;
+    pulse_reload[p][l] = ch.seq.reload;
+    bool muted = ch.sweep.mute || ch.seq.reload < 8 || ch.len_counter.timer == 0;
+    pulse_keep[p][l] = muted ? 0 : 0xFFFFFFFF;
+}
+
+void Apu2A03xN::refreshTriangle(int l)
+{
+    const Apu2A03& apu = lanes[l];
+    triangle_enable[l] = apu.triangle_enable;
+    triangle_reload[l] = apu.triangle.seq.reload;
+    bool triangle_active = apu.triangle.len_counter.timer > 0 && apu.triangle.lin_counter.counter > 0 && apu.triangle.seq.reload >= 2;
+    triangle_gate[l] = triangle_active ? 0xFFFFFFFF : 0;
+}
+
+void Apu2A03xN::refreshNoise(int l)
+{
+    const Apu2A03& apu = lanes[l];
+    noise_enable[l] = apu.noise_enable;
+    noise_reload[l] = apu.noise.reload;
+    noise_mode[l] = apu.noise.mode ? 0xFFFFFFFF : 0;
+    noise_volume[l] = apu.noise.len_counter.timer > 0 ? apu.noise.env.output : 0;
+}
+
+// The 8 duty steps as bits, rotated so that bit 0 is the step at the position
+uint32_t Apu2A03xN::dutyPattern(uint8_t duty_cycle, uint32_t position)
+{
+    static constexpr auto patterns = [] {
+        std::array<uint32_t, 4> bits = {};
+        for (int d = 0; d < 4; d++) {
+            for (int i = 0; i < 8; i++) bits[d] |= uint32_t(Apu2A03::duty_sequences[d][i]) << i;
+        }
+        return bits;
+    }();
+    uint32_t bits = patterns[duty_cycle];
+    return ((bits >> position) | (bits << (8 - position))) & 0xFF;
+}
+
+// Writes the state owned by the lane arrays back to the scalar APU of a lane
+void Apu2A03xN::scatterLane(int l)
+{
+    Apu2A03& apu = lanes[l];
+    Apu2A03::pulseChannel* pulse[2] = { &apu.pulse1, &apu.pulse2 };
+
+    apu.clock_counter = clock_counter[l];
+    apu.sample_time = sample_time;
+    for (int p = 0; p < 2; p++) {
+        pulse[p]->seq.timer = pulse_timer[p][l];
+        pulse[p]->seq.cycle_position = pulse_position[p][l];
+        pulse[p]->seq.output = pulse_output[p][l];
+        pulse[p]->env.output = pulse_volume[p][l];
+    }
+    apu.triangle.seq.timer = triangle_timer[l];
+    apu.triangle.seq.duty_cycle = triangle_position[l];
+    apu.triangle.seq.output = triangle_output[l];
+    apu.noise.timer = noise_timer[l];
+    apu.noise.shift_register = noise_shift_register[l];
+    apu.noise.output = noise_output[l];
+    apu.DMC.timer = DMC_timer[l];
+}
+
+// Number of cycles that can be stepped before a lane reaches a frame counter
+// step or the next sample is due
+uint32_t Apu2A03xN::cyclesToNextEvent() const
+{
+    uint32_t cycles = sample_time > APU_TIME_PER_SAMPLE ? 0 : (APU_TIME_PER_SAMPLE - sample_time) / APU_TIME_PER_CYCLE + 1;
+    for (int l = 0; l < LANES; l++) {
+        for (uint32_t step : FRAME_COUNTER_STEPS) cycles = std::min(cycles, step - clock_counter[l]);
+    }
+    return cycles;
+}
+
+// One APU cycle of the channel timers for all lanes. Mirrors pulseChannelClock,
+// noiseChannelClock, DMCChannelClock and triangleChannelClock of the scalar APU
+// with 0/1 masks in place of the branches. All channels are stepped in one loop
+// over the lanes so the whole cycle is vectorized, and shifts are by constants
+// only as SSE2 has no per-lane variable shift. The DMC sample fetches only touch
+// DMC state, so they can come after the triangle.
+inline void Apu2A03xN::stepChannels()
+{
+    uint32_t DMC_fired = 0;
+    for (int l = 0; l < LANES; l++) {
+        for (int p = 0; p < 2; p++) {
+            uint32_t en = pulse_enable[p][l];
+            uint32_t timer = (pulse_timer[p][l] - en) & 0xFFFF;
+            uint32_t fire = 0u - ((timer == 0xFFFF) & en);
+            uint32_t pattern = pulse_pattern[p][l];
+            uint32_t rotated = ((pattern >> 1) | (pattern << 7)) & 0xFF;
+            pulse_timer[p][l] = (pulse_reload[p][l] & fire) | (timer & ~fire);
+            pulse_output[p][l] = (pattern & 1 & fire) | (pulse_output[p][l] & ~fire);
+            pulse_pattern[p][l] = (rotated & fire) | (pattern & ~fire);
+            pulse_position[p][l] = (pulse_position[p][l] + (fire & 1)) & 7;
+        }
+
+        {
+            uint32_t en = noise_enable[l];
+            uint32_t timer = (noise_timer[l] - en) & 0xFFFF;
+            uint32_t fire = 0u - ((timer == 0xFFFF) & en);
+            uint32_t sr = noise_shift_register[l];
+            uint32_t tap = ((sr >> 6) & noise_mode[l]) | ((sr >> 1) & ~noise_mode[l]);
+            uint32_t out = (sr ^ tap) & 1;
+            noise_timer[l] = (noise_reload[l] & fire) | (timer & ~fire);
+            noise_output[l] = (out & fire) | (noise_output[l] & ~fire);
+            noise_shift_register[l] = (((sr >> 1) | (out << 14)) & fire) | (sr & ~fire);
+        }
+
+        {
+            uint32_t en = DMC_enable[l];
+            uint32_t timer = (DMC_timer[l] - en) & 0xFFFF;
+            DMC_timer[l] = timer;
+            DMC_fired |= (timer == 0xFFFF) & en;
+        }
+
+        for (int step = 0; step < 2; step++) {
+            uint32_t en = triangle_enable[l];
+            uint32_t timer = (triangle_timer[l] - en) & 0xFFFF;
+            uint32_t fire = 0u - ((timer == 0) & en);
+            uint32_t advance = fire & triangle_gate[l];
+            uint32_t pos = triangle_position[l];
+            // 15, 14, ..., 0, 0, 1, ..., 15
+            uint32_t value = pos ^ (15 + (pos >> 4));
+            triangle_timer[l] = (triangle_reload[l] & fire) | (timer & ~fire);
+            triangle_output[l] = (value & advance) | (triangle_output[l] & ~advance);
+            triangle_position[l] = (pos + (advance & 1)) & 31;
+        }
+    }
+
+    if (DMC_fired) {
+        for (int l = 0; l < LANES; l++) {
+            if (DMC_enable[l] && DMC_timer[l] == 0xFFFF) DMCClock(l);
+        }
+    }
+}
+
+void Apu2A03xN::silenceMutedPulses()
+{
+    for (int p = 0; p < 2; p++) {
+        for (int l = 0; l < LANES; l++) {
+            pulse_output[p][l] &= pulse_keep[p][l];
+            pulse_volume[p][l] &= pulse_keep[p][l];
+        }
+    }
+}
+
+// Runs of cycles without events only step the channels. The mute mask can
+// only change at events, so applying it once after the run leaves the same
+// state as the scalar APU applying it every cycle.
+void Apu2A03xN::runChannels(uint32_t cycles)
+{
+#ifdef APU2A03XN_AVX2_CLONE
+    if (avx2) return runChannelsAVX2(cycles);
+#endif
+    for (uint32_t i = 0; i < cycles; i++) stepChannels();
+    silenceMutedPulses();
+}
+
+#ifdef APU2A03XN_AVX2_CLONE
+__attribute__((target("avx2"))) void Apu2A03xN::runChannelsAVX2(uint32_t cycles)
+{
+    for (uint32_t i = 0; i < cycles; i++) stepChannels();
+    silenceMutedPulses();
+}
+#endif
+
+// A frame counter step goes by the clock counter of the lane (and may reset it)
+// and writes the envelope outputs. The pulse volumes, which the lane arrays may
+// have silenced, go over first in case the step leaves them alone.
+void Apu2A03xN::frameCounterClock()
+{
+    for (int l = 0; l < LANES; l++) {
+        bool step = false;
+        for (uint32_t s : FRAME_COUNTER_STEPS) step |= clock_counter[l] == s;
+        if (!step) continue;
+
+        Apu2A03& apu = lanes[l];
+        apu.clock_counter = clock_counter[l];
+        apu.pulse1.env.output = pulse_volume[0][l];
+        apu.pulse2.env.output = pulse_volume[1][l];
+        apu.frameCounterClock();
+        clock_counter[l] = apu.clock_counter;
+        pulse_volume[0][l] = apu.pulse1.env.output;
+        pulse_volume[1][l] = apu.pulse2.env.output;
+        refreshPulse(0, l);
+        refreshPulse(1, l);
+        refreshTriangle(l);
+        refreshNoise(l);
+    }
+}
+
+// The timer of the lane has just wrapped, let the scalar APU shift the output
+// unit and fetch the next sample byte
+void Apu2A03xN::DMCClock(int l)
+{
+    Apu2A03& apu = lanes[l];
+    apu.DMC.timer = 0;
+    apu.DMCChannelClock(apu.DMC, true);
+    DMC_timer[l] = apu.DMC.timer;
+    DMC_level[l] = apu.DMC.output_unit.output_level;
+}
+
+void Apu2A03xN::generateSamples()
+{
+    uint32_t index = buffer_index;
+    for (int l = 0; l < LANES; l++) {
+        // Outputs are 0 or 1, masks in place of the multiplies SSE2 doesn't have for 32 bit
+        uint32_t val = (pulse_volume[0][l] & (0u - pulse_output[0][l])) + (pulse_volume[1][l] & (0u - pulse_output[1][l]));
+        val += triangle_output[l] + DMC_level[l];
+        val += noise_volume[l] & ((noise_shift_register[l] & 1) - 1);
+        audio_buffer[l][index] = uint8_t(std::min(val, 255u));
+    }
+
+    buffer_index++;
+    if (buffer_index >= AUDIO_BUFFER_SIZE) {
+        buffer_index = 0;
+        for (int l = 0; l < LANES; l++) {
+            if (output_callback[l]) output_callback[l](output_userdata[l], audio_buffer[l], AUDIO_BUFFER_SIZE);
+        }
+    }
+}
+
+// Same order as Apu2A03::clock(): channels, frame counter, mute check, sample.
+void Apu2A03xN::clock(uint32_t cycles)
+{
+    while (cycles > 0) {
+        uint32_t run = std::min(cycles, cyclesToNextEvent());
+        if (run > 0) runChannels(run);
+        sample_time += run * APU_TIME_PER_CYCLE;
+        for (int l = 0; l < LANES; l++) clock_counter[l] += run;
+        cycles -= run;
+        if (cycles == 0) break;
+
+        stepChannels();
+        frameCounterClock();
+        silenceMutedPulses();
+        if (sample_time > APU_TIME_PER_SAMPLE) {
+            generateSamples();
+            sample_time -= APU_TIME_PER_SAMPLE;
+        }
+        sample_time += APU_TIME_PER_CYCLE;
+        for (int l = 0; l < LANES; l++) clock_counter[l]++;
+        cycles--;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * apu2A03_multi.h - Several NES APU instances stepped together in SIMD lanes
+ *
+ * The per-cycle work of the APU (channel timers, sequencer positions, the
+ * noise LFSR and the sample mixer) is kept as a struct of arrays with one
+ * element per lane, written as branch-free loops over the lanes that the
+ * compiler turns into SSE2 code, plus an AVX2 copy that is picked at runtime
+ * on CPUs that have it. Everything that happens rarely (register writes,
+ * frame counter steps, DMC sample fetches) is delegated to a regular Apu2A03
+ * per lane, so every lane renders bit-identical to the scalar APU. Only the
+ * fields such an event can change are copied between the two.
+ */
+#ifndef APU2A03_MULTI_H
+#define APU2A03_MULTI_H
+
+#include <cstdint>
+
+#include "apu2A03.h"
+
+class Apu2A03xN
+{
+public:
+    // 8 x 32 bit fills one AVX2 register (two SSE registers)
+    static constexpr int LANES = 8;
+
+    Apu2A03xN();
+
+    void connectBus(int lane, Bus* n) { lanes[lane].connectBus(n); }
+    void connectCPU(int lane, Cpu6502* n) { lanes[lane].connectCPU(n); }
+    void cpuWrite(int lane, uint16_t addr, uint8_t data);
+    // Clocks all lanes by the same number of APU cycles
+    void clock(uint32_t cycles);
+    void setOutputCallback(int lane, AudioOutputCallback callback, void* userdata);
+    void flushAudioBuffer();
+    // Emits the pending samples of one lane and stops its output, the lane keeps running silently
+    void finishLane(int lane);
+
+    // Copy of the complete state of one lane as a scalar APU
+    Apu2A03 lane(int lane);
+
+private:
+    Apu2A03 lanes[LANES];
+    AudioOutputCallback output_callback[LANES] = {};
+    void* output_userdata[LANES] = {};
+
+    uint32_t sample_time = 0;
+    uint32_t buffer_index = 0;
+    alignas(32) uint8_t audio_buffer[LANES][AUDIO_BUFFER_SIZE] = {};
+
+    // Per-cycle state, owned by the lane arrays while clock() runs
+    alignas(32) uint32_t clock_counter[LANES] = {};
+    alignas(32) uint32_t pulse_timer[2][LANES] = {};
+    alignas(32) uint32_t pulse_position[2][LANES] = {};
+    // Duty sequence rotated by the position, bit 0 is the next output
+    alignas(32) uint32_t pulse_pattern[2][LANES] = {};
+    alignas(32) uint32_t pulse_output[2][LANES] = {};
+    alignas(32) uint32_t pulse_volume[2][LANES] = {};
+    alignas(32) uint32_t triangle_timer[LANES] = {};
+    alignas(32) uint32_t triangle_position[LANES] = {};
+    alignas(32) uint32_t triangle_output[LANES] = {};
+    alignas(32) uint32_t noise_timer[LANES] = {};
+    alignas(32) uint32_t noise_shift_register[LANES] = {};
+    alignas(32) uint32_t noise_output[LANES] = {};
+    alignas(32) uint32_t DMC_timer[LANES] = {};
+
+    // Read-only copies of the scalar state, refreshed after the scalar events that change them
+    alignas(32) uint32_t pulse_enable[2][LANES] = {};
+    alignas(32) uint32_t pulse_reload[2][LANES] = {};
+    alignas(32) uint32_t pulse_keep[2][LANES] = {};
+    alignas(32) uint32_t triangle_enable[LANES] = {};
+    alignas(32) uint32_t triangle_reload[LANES] = {};
+    alignas(32) uint32_t triangle_gate[LANES] = {};
+    alignas(32) uint32_t noise_enable[LANES] = {};
+    alignas(32) uint32_t noise_reload[LANES] = {};
+    alignas(32) uint32_t noise_mode[LANES] = {};
+    alignas(32) uint32_t noise_volume[LANES] = {};
+    alignas(32) uint32_t DMC_enable[LANES] = {};
+    alignas(32) uint32_t DMC_level[LANES] = {};
+
+    // Steps the channels with the AVX2 copy of the loop
+    bool avx2 = false;
+
+    void gatherLane(int lane);
+    void scatterLane(int lane);
+    void refreshPulse(int pulse, int lane);
+    void refreshTriangle(int lane);
+    void refreshNoise(int lane);
+    static uint32_t dutyPattern(uint8_t duty_cycle, uint32_t position);
+    uint32_t cyclesToNextEvent() const;
+    void stepChannels();
+    void runChannels(uint32_t cycles);
+    void runChannelsAVX2(uint32_t cycles);
+    void silenceMutedPulses();
+    void frameCounterClock();
+    void DMCClock(int lane);
+    void generateSamples();
+};
+
+#endif
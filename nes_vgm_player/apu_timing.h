@@ -0,0 +1,42 @@
+/*
+ * apu_timing.h - Fixed-point timing of APU cycles against 44.1 kHz samples
+ *
+ * An output sample lasts 1789773 / 2 / 44100 = 20.2922... APU cycles. Time is
+ * counted in integer units of which an APU cycle has APU_TIME_PER_CYCLE and a
+ * sample APU_TIME_PER_SAMPLE, so the ratio is exact. The APU generates its
+ * samples on this time base and waits of VGM streams are converted with it,
+ * carrying the fraction of a cycle from one wait to the next, so a stream of
+ * N samples clocks the APU for exactly the cycles in which it outputs N
+ * samples, however long the track.
+ */
+#ifndef APU_TIMING_H
+#define APU_TIMING_H
+
+#include <cstdint>
+
+constexpr uint32_t APU_TIME_PER_CYCLE = 2 * 44100;
+constexpr uint32_t APU_TIME_PER_SAMPLE = 1789773;
+
+// Converts sample counts into APU cycles, keeping the remainder
+class ApuScheduler
+{
+public:
+    // APU cycles of the next 'samples' samples
+    uint32_t cycles(uint32_t samples)
+    {
+        const uint64_t time = uint64_t(samples) * APU_TIME_PER_SAMPLE + remainder;
+        remainder = uint32_t(time % APU_TIME_PER_CYCLE);
+        return uint32_t(time / APU_TIME_PER_CYCLE);
+    }
+    void reset() { remainder = 0; }
+    // Carried fraction of a cycle, for snapshots
+    uint32_t fraction() const { return remainder; }
+    void setFraction(uint32_t time) { remainder = time % APU_TIME_PER_CYCLE; }
+
+    bool operator==(const ApuScheduler& other) const = default;
+
+private:
+    uint32_t remainder = 0;     // time units short of the next cycle
+};
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * audio_sink.h - Destination of the player's audio
+ *
+ * The player renders until queued() reaches its target level, then calls
+ * flush() and idle(). Samples are 8-bit unsigned mono at AUDIO_SAMPLE_RATE,
+ * as produced by the APU.
+ */
+#ifndef AUDIO_SINK_H
+#define AUDIO_SINK_H
+
+#include <cstdint>
+
+constexpr int AUDIO_SAMPLE_RATE = 44100;
+
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+
+    virtual void write(const uint8_t* samples, int count) = 0;
+    // Samples written that have not been played (or handed to the consumer) yet
+    virtual int queued() = 0;
+    // Passes buffered samples on. Returns false once the output has failed.
+    virtual bool flush() = 0;
+    // Drops all samples that have not been played yet
+    virtual void clear() = 0;
+    virtual void setPaused(bool paused) = 0;
+    // Called between refills, waits a little for the queued audio to drain
+    virtual void idle() = 0;
+};
+
+#endif
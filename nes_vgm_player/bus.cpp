@@ -0,0 +1,132 @@
+/*
+ * bus.cpp - CPU memory map for NSF playback
+ */
+#include "bus.h"
+#include "apu2A03.h"
+#include "cpu6502.h"
+
+#include <algorithm>
+
+Bus::Bus()
+{
+    ram.fill(0);
+    wram.fill(0);
+    bank_offset.fill(0);
+    // JSR $0000; JMP DRIVER_IDLE_ADDRESS
+    driver = { 0x20, 0x00, 0x00, 0x4C, DRIVER_IDLE_ADDRESS & 0xFF, DRIVER_IDLE_ADDRESS >> 8 };
+}
+
+uint8_t Bus::cpuRead(uint16_t addr)
+{
+    if (addr < 0x2000)
+        return ram[addr & 0x07FF];
+    if (addr == 0x4015)
+        return apu ? apu->cpuRead(addr) : 0;
+    if (addr >= DRIVER_ADDRESS && addr < DRIVER_ADDRESS + driver.size())
+        return driver[addr - DRIVER_ADDRESS];
+    if (addr >= 0x6000 && addr < 0x8000)
+        return wram[addr - 0x6000];
+    if (addr >= 0x8000)
+    {
+        uint32_t offset = bank_offset[(addr - 0x8000) >> 12] + (addr & 0x0FFF);
+        return offset < rom.size() ? rom[offset] : 0;
+    }
+    return 0;
+}
+
+void Bus::cpuWrite(uint16_t addr, uint8_t data)
+{
+    if (addr < 0x2000)
+    {
+        ram[addr & 0x07FF] = data;
+    }
+    else if (addr >= 0x4000 && addr <= 0x4017)
+    {
+        if (apu)
+        {
+            // Bring the APU up to the moment of the write before applying it
+            syncApu();
+            apu->cpuWrite(addr, data);
+        }
+    }
+    else if (addr >= 0x5FF8 && addr <= 0x5FFF)
+    {
+        if (bankswitching) bank_offset[addr - 0x5FF8] = uint32_t(data) << 12;
+    }
+    else if (addr >= 0x6000 && addr < 0x8000)
+    {
+        wram[addr - 0x6000] = data;
+    }
+}
+
+void Bus::loadProgram(const uint8_t* data, size_t size, uint16_t loadAddress, const uint8_t* banks)
+{
+    bankswitching = (banks != nullptr);
+    if (bankswitching)
+    {
+        // The image is padded so that the load address lands on its offset within a bank
+        size_t padding = loadAddress & 0x0FFF;
+        rom.assign(padding, 0);
+        rom.insert(rom.end(), data, data + size);
+        for (size_t i = 0; i < bank_offset.size(); i++)
+            bank_offset[i] = uint32_t(banks[i]) << 12;
+    }
+    else
+    {
+        rom.assign(0x8000, 0);
+        size_t start = std::max<size_t>(loadAddress, 0x8000) - 0x8000;
+        size_t skip = (loadAddress < 0x8000) ? 0x8000 - loadAddress : 0;
+        if (skip < size)
+            std::copy(data + skip, data + std::min(size, skip + rom.size() - start), rom.begin() + start);
+        for (size_t i = 0; i < bank_offset.size(); i++)
+            bank_offset[i] = uint32_t(i) << 12;
+    }
+}
+
+void Bus::clearRam()
+{
+    ram.fill(0);
+    wram.fill(0);
+}
+
+void Bus::setDriverTarget(uint16_t routine)
+{
+    driver[1] = routine & 0xFF;
+    driver[2] = routine >> 8;
+}
+
+void Bus::syncApu()
+{
+    if (cpu) syncApu(cpu->clock_count);
+}
+
+void Bus::syncApu(uint64_t cpuCycle)
+{
+    if (!apu || cpuCycle <= apu_cpu_cycle) return;
+    uint64_t apuCycles = (cpuCycle - apu_cpu_cycle) / 2;
+    apu->clock(static_cast<uint32_t>(apuCycles));
+    apu_cpu_cycle += apuCycles * 2;
+}
+
+void Bus::clearDataMemory()
+{
+    bankswitching = false;
+    rom.assign(0x8000, 0);
+    for (size_t i = 0; i < bank_offset.size(); i++)
+        bank_offset[i] = uint32_t(i) << 12;
+}
+
+void Bus::writeDataMemory(uint32_t addr, const uint8_t* data, size_t size)
+{
+    if (addr < 0x8000)
+    {
+        size_t skip = std::min<size_t>(size, 0x8000 - addr);
+        data += skip;
+        size -= skip;
+        addr = 0x8000;
+    }
+    // Only the linear memory of clearDataMemory() takes writes
+    if (addr >= 0x10000 || bankswitching || rom.size() < 0x8000) return;
+    size = std::min<size_t>(size, 0x10000 - addr);
+    std::copy(data, data + size, rom.begin() + (addr - 0x8000));
+}
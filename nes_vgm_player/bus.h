@@ -0,0 +1,64 @@
+/*
+ * bus.h - CPU memory map for NSF playback
+ *   $0000-$1FFF  2 KB internal RAM (mirrored)
+ *   $4000-$4017  APU registers
+ *   $4100-$4105  player driver (calls INIT/PLAY, then idles)
+ *   $5FF8-$5FFF  NSF bank select registers
+ *   $6000-$7FFF  8 KB work RAM
+ *   $8000-$FFFF  program ROM in eight 4 KB banks
+ * Without a program loaded every read outside of RAM returns 0.
+ */
+#ifndef BUS_H
+#define BUS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Apu2A03;
+class Cpu6502;
+
+class Bus
+{
+public:
+    Bus();
+
+public:
+    static constexpr uint16_t DRIVER_ADDRESS = 0x4100;
+    static constexpr uint16_t DRIVER_IDLE_ADDRESS = DRIVER_ADDRESS + 3;
+
+    void connectAPU(Apu2A03* n) { apu = n; }
+    void connectCPU(Cpu6502* n) { cpu = n; }
+    uint8_t cpuRead(uint16_t addr);
+    void cpuWrite(uint16_t addr, uint8_t data);
+
+    // Maps an NSF program image. 'banks' holds the 8 initial bank numbers,
+    // nullptr maps the image linearly at loadAddress instead.
+    void loadProgram(const uint8_t* data, size_t size, uint16_t loadAddress, const uint8_t* banks);
+    void clearRam();
+    // VGM streams: maps 32 KB of zeroed memory at $8000 for the data written by
+    // RAM write blocks (DMC samples). Writes outside of $8000-$FFFF are dropped.
+    void clearDataMemory();
+    void writeDataMemory(uint32_t addr, const uint8_t* data, size_t size);
+    // Points the driver's JSR at routine; the CPU idles at DRIVER_IDLE_ADDRESS once it returns
+    void setDriverTarget(uint16_t routine);
+
+    // Clocks the APU up to the current CPU cycle (the APU runs at half the CPU clock)
+    void syncApu();
+    void syncApu(uint64_t cpuCycle);
+
+private:
+    Apu2A03* apu = nullptr;
+    Cpu6502* cpu = nullptr;
+    uint64_t apu_cpu_cycle = 0; // CPU cycle the APU has been clocked up to
+
+    std::array<uint8_t, 2048> ram;
+    std::array<uint8_t, 8192> wram;
+    std::array<uint8_t, 6> driver;
+    std::vector<uint8_t> rom;
+    std::array<uint32_t, 8> bank_offset;
+    bool bankswitching = false;
+};
+
+#endif
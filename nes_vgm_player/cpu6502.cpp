@@ -0,0 +1,615 @@
+/*
+ * cpu6502.cpp - MOS 6502 (2A03) CPU interpreter
+ */
+#include "cpu6502.h"
+#include "bus.h"
+
+using a = Cpu6502;
+
+const Cpu6502::Instruction Cpu6502::lookup[256] =
+{
+	// 0x00
+	{ "BRK", &a::BRK, &a::IMM, 7 }, { "ORA", &a::ORA, &a::IZX, 6 }, { "???", &a::XXX, &a::IMP, 2 }, { "SLO", &a::SLO, &a::IZX, 8 },
+	{ "NOP", &a::SKB, &a::ZP0, 3 }, { "ORA", &a::ORA, &a::ZP0, 3 }, { "ASL", &a::ASL, &a::ZP0, 5 }, { "SLO", &a::SLO, &a::ZP0, 5 },
+	{ "PHP", &a::PHP, &a::IMP, 3 }, { "ORA", &a::ORA, &a::IMM, 2 }, { "ASL", &a::ASL, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "NOP", &a::SKB, &a::ABS, 4 }, { "ORA", &a::ORA, &a::ABS, 4 }, { "ASL", &a::ASL, &a::ABS, 6 }, { "SLO", &a::SLO, &a::ABS, 6 },
+	// 0x10
+	{ "BPL", &a::BPL, &a::REL, 2 }, { "ORA", &a::ORA, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "SLO", &a::SLO, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "ORA", &a::ORA, &a::ZPX, 4 }, { "ASL", &a::ASL, &a::ZPX, 6 }, { "SLO", &a::SLO, &a::ZPX, 6 },
+	{ "CLC", &a::CLC, &a::IMP, 2 }, { "ORA", &a::ORA, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "SLO", &a::SLO, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "ORA", &a::ORA, &a::ABX, 4 }, { "ASL", &a::ASL, &a::ABX, 7 }, { "SLO", &a::SLO, &a::ABX, 7 },
+	// 0x20
+	{ "JSR", &a::JSR, &a::ABS, 6 }, { "AND", &a::AND, &a::IZX, 6 }, { "???", &a::XXX, &a::IMP, 2 }, { "RLA", &a::RLA, &a::IZX, 8 },
+	{ "BIT", &a::BIT, &a::ZP0, 3 }, { "AND", &a::AND, &a::ZP0, 3 }, { "ROL", &a::ROL, &a::ZP0, 5 }, { "RLA", &a::RLA, &a::ZP0, 5 },
+	{ "PLP", &a::PLP, &a::IMP, 4 }, { "AND", &a::AND, &a::IMM, 2 }, { "ROL", &a::ROL, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "BIT", &a::BIT, &a::ABS, 4 }, { "AND", &a::AND, &a::ABS, 4 }, { "ROL", &a::ROL, &a::ABS, 6 }, { "RLA", &a::RLA, &a::ABS, 6 },
+	// 0x30
+	{ "BMI", &a::BMI, &a::REL, 2 }, { "AND", &a::AND, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "RLA", &a::RLA, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "AND", &a::AND, &a::ZPX, 4 }, { "ROL", &a::ROL, &a::ZPX, 6 }, { "RLA", &a::RLA, &a::ZPX, 6 },
+	{ "SEC", &a::SEC, &a::IMP, 2 }, { "AND", &a::AND, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "RLA", &a::RLA, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "AND", &a::AND, &a::ABX, 4 }, { "ROL", &a::ROL, &a::ABX, 7 }, { "RLA", &a::RLA, &a::ABX, 7 },
+	// 0x40
+	{ "RTI", &a::RTI, &a::IMP, 6 }, { "EOR", &a::EOR, &a::IZX, 6 }, { "???", &a::XXX, &a::IMP, 2 }, { "SRE", &a::SRE, &a::IZX, 8 },
+	{ "NOP", &a::SKB, &a::ZP0, 3 }, { "EOR", &a::EOR, &a::ZP0, 3 }, { "LSR", &a::LSR, &a::ZP0, 5 }, { "SRE", &a::SRE, &a::ZP0, 5 },
+	{ "PHA", &a::PHA, &a::IMP, 3 }, { "EOR", &a::EOR, &a::IMM, 2 }, { "LSR", &a::LSR, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "JMP", &a::JMP, &a::ABS, 3 }, { "EOR", &a::EOR, &a::ABS, 4 }, { "LSR", &a::LSR, &a::ABS, 6 }, { "SRE", &a::SRE, &a::ABS, 6 },
+	// 0x50
+	{ "BVC", &a::BVC, &a::REL, 2 }, { "EOR", &a::EOR, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "SRE", &a::SRE, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "EOR", &a::EOR, &a::ZPX, 4 }, { "LSR", &a::LSR, &a::ZPX, 6 }, { "SRE", &a::SRE, &a::ZPX, 6 },
+	{ "CLI", &a::CLI, &a::IMP, 2 }, { "EOR", &a::EOR, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "SRE", &a::SRE, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "EOR", &a::EOR, &a::ABX, 4 }, { "LSR", &a::LSR, &a::ABX, 7 }, { "SRE", &a::SRE, &a::ABX, 7 },
+	// 0x60
+	{ "RTS", &a::RTS, &a::IMP, 6 }, { "ADC", &a::ADC, &a::IZX, 6 }, { "???", &a::XXX, &a::IMP, 2 }, { "RRA", &a::RRA, &a::IZX, 8 },
+	{ "NOP", &a::SKB, &a::ZP0, 3 }, { "ADC", &a::ADC, &a::ZP0, 3 }, { "ROR", &a::ROR, &a::ZP0, 5 }, { "RRA", &a::RRA, &a::ZP0, 5 },
+	{ "PLA", &a::PLA, &a::IMP, 4 }, { "ADC", &a::ADC, &a::IMM, 2 }, { "ROR", &a::ROR, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "JMP", &a::JMP, &a::IND, 5 }, { "ADC", &a::ADC, &a::ABS, 4 }, { "ROR", &a::ROR, &a::ABS, 6 }, { "RRA", &a::RRA, &a::ABS, 6 },
+	// 0x70
+	{ "BVS", &a::BVS, &a::REL, 2 }, { "ADC", &a::ADC, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "RRA", &a::RRA, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "ADC", &a::ADC, &a::ZPX, 4 }, { "ROR", &a::ROR, &a::ZPX, 6 }, { "RRA", &a::RRA, &a::ZPX, 6 },
+	{ "SEI", &a::SEI, &a::IMP, 2 }, { "ADC", &a::ADC, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "RRA", &a::RRA, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "ADC", &a::ADC, &a::ABX, 4 }, { "ROR", &a::ROR, &a::ABX, 7 }, { "RRA", &a::RRA, &a::ABX, 7 },
+	// 0x80
+	{ "NOP", &a::SKB, &a::IMM, 2 }, { "STA", &a::STA, &a::IZX, 6 }, { "NOP", &a::SKB, &a::IMM, 2 }, { "SAX", &a::SAX, &a::IZX, 6 },
+	{ "STY", &a::STY, &a::ZP0, 3 }, { "STA", &a::STA, &a::ZP0, 3 }, { "STX", &a::STX, &a::ZP0, 3 }, { "SAX", &a::SAX, &a::ZP0, 3 },
+	{ "DEY", &a::DEY, &a::IMP, 2 }, { "NOP", &a::SKB, &a::IMM, 2 }, { "TXA", &a::TXA, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "STY", &a::STY, &a::ABS, 4 }, { "STA", &a::STA, &a::ABS, 4 }, { "STX", &a::STX, &a::ABS, 4 }, { "SAX", &a::SAX, &a::ABS, 4 },
+	// 0x90
+	{ "BCC", &a::BCC, &a::REL, 2 }, { "STA", &a::STA, &a::IZY, 6 }, { "???", &a::XXX, &a::IMP, 2 }, { "???", &a::XXX, &a::IZY, 6 },
+	{ "STY", &a::STY, &a::ZPX, 4 }, { "STA", &a::STA, &a::ZPX, 4 }, { "STX", &a::STX, &a::ZPY, 4 }, { "SAX", &a::SAX, &a::ZPY, 4 },
+	{ "TYA", &a::TYA, &a::IMP, 2 }, { "STA", &a::STA, &a::ABY, 5 }, { "TXS", &a::TXS, &a::IMP, 2 }, { "???", &a::XXX, &a::ABY, 5 },
+	{ "???", &a::XXX, &a::ABX, 5 }, { "STA", &a::STA, &a::ABX, 5 }, { "???", &a::XXX, &a::ABY, 5 }, { "???", &a::XXX, &a::ABY, 5 },
+	// 0xA0
+	{ "LDY", &a::LDY, &a::IMM, 2 }, { "LDA", &a::LDA, &a::IZX, 6 }, { "LDX", &a::LDX, &a::IMM, 2 }, { "LAX", &a::LAX, &a::IZX, 6 },
+	{ "LDY", &a::LDY, &a::ZP0, 3 }, { "LDA", &a::LDA, &a::ZP0, 3 }, { "LDX", &a::LDX, &a::ZP0, 3 }, { "LAX", &a::LAX, &a::ZP0, 3 },
+	{ "TAY", &a::TAY, &a::IMP, 2 }, { "LDA", &a::LDA, &a::IMM, 2 }, { "TAX", &a::TAX, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "LDY", &a::LDY, &a::ABS, 4 }, { "LDA", &a::LDA, &a::ABS, 4 }, { "LDX", &a::LDX, &a::ABS, 4 }, { "LAX", &a::LAX, &a::ABS, 4 },
+	// 0xB0
+	{ "BCS", &a::BCS, &a::REL, 2 }, { "LDA", &a::LDA, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "LAX", &a::LAX, &a::IZY, 5 },
+	{ "LDY", &a::LDY, &a::ZPX, 4 }, { "LDA", &a::LDA, &a::ZPX, 4 }, { "LDX", &a::LDX, &a::ZPY, 4 }, { "LAX", &a::LAX, &a::ZPY, 4 },
+	{ "CLV", &a::CLV, &a::IMP, 2 }, { "LDA", &a::LDA, &a::ABY, 4 }, { "TSX", &a::TSX, &a::IMP, 2 }, { "???", &a::XXX, &a::ABY, 4 },
+	{ "LDY", &a::LDY, &a::ABX, 4 }, { "LDA", &a::LDA, &a::ABX, 4 }, { "LDX", &a::LDX, &a::ABY, 4 }, { "LAX", &a::LAX, &a::ABY, 4 },
+	// 0xC0
+	{ "CPY", &a::CPY, &a::IMM, 2 }, { "CMP", &a::CMP, &a::IZX, 6 }, { "NOP", &a::SKB, &a::IMM, 2 }, { "DCP", &a::DCP, &a::IZX, 8 },
+	{ "CPY", &a::CPY, &a::ZP0, 3 }, { "CMP", &a::CMP, &a::ZP0, 3 }, { "DEC", &a::DEC, &a::ZP0, 5 }, { "DCP", &a::DCP, &a::ZP0, 5 },
+	{ "INY", &a::INY, &a::IMP, 2 }, { "CMP", &a::CMP, &a::IMM, 2 }, { "DEX", &a::DEX, &a::IMP, 2 }, { "???", &a::XXX, &a::IMM, 2 },
+	{ "CPY", &a::CPY, &a::ABS, 4 }, { "CMP", &a::CMP, &a::ABS, 4 }, { "DEC", &a::DEC, &a::ABS, 6 }, { "DCP", &a::DCP, &a::ABS, 6 },
+	// 0xD0
+	{ "BNE", &a::BNE, &a::REL, 2 }, { "CMP", &a::CMP, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "DCP", &a::DCP, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "CMP", &a::CMP, &a::ZPX, 4 }, { "DEC", &a::DEC, &a::ZPX, 6 }, { "DCP", &a::DCP, &a::ZPX, 6 },
+	{ "CLD", &a::CLD, &a::IMP, 2 }, { "CMP", &a::CMP, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "DCP", &a::DCP, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "CMP", &a::CMP, &a::ABX, 4 }, { "DEC", &a::DEC, &a::ABX, 7 }, { "DCP", &a::DCP, &a::ABX, 7 },
+	// 0xE0
+	{ "CPX", &a::CPX, &a::IMM, 2 }, { "SBC", &a::SBC, &a::IZX, 6 }, { "NOP", &a::SKB, &a::IMM, 2 }, { "ISC", &a::ISC, &a::IZX, 8 },
+	{ "CPX", &a::CPX, &a::ZP0, 3 }, { "SBC", &a::SBC, &a::ZP0, 3 }, { "INC", &a::INC, &a::ZP0, 5 }, { "ISC", &a::ISC, &a::ZP0, 5 },
+	{ "INX", &a::INX, &a::IMP, 2 }, { "SBC", &a::SBC, &a::IMM, 2 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "SBC", &a::SBC, &a::IMM, 2 },
+	{ "CPX", &a::CPX, &a::ABS, 4 }, { "SBC", &a::SBC, &a::ABS, 4 }, { "INC", &a::INC, &a::ABS, 6 }, { "ISC", &a::ISC, &a::ABS, 6 },
+	// 0xF0
+	{ "BEQ", &a::BEQ, &a::REL, 2 }, { "SBC", &a::SBC, &a::IZY, 5 }, { "???", &a::XXX, &a::IMP, 2 }, { "ISC", &a::ISC, &a::IZY, 8 },
+	{ "NOP", &a::SKB, &a::ZPX, 4 }, { "SBC", &a::SBC, &a::ZPX, 4 }, { "INC", &a::INC, &a::ZPX, 6 }, { "ISC", &a::ISC, &a::ZPX, 6 },
+	{ "SED", &a::SED, &a::IMP, 2 }, { "SBC", &a::SBC, &a::ABY, 4 }, { "NOP", &a::NOP, &a::IMP, 2 }, { "ISC", &a::ISC, &a::ABY, 7 },
+	{ "NOP", &a::SKB, &a::ABX, 4 }, { "SBC", &a::SBC, &a::ABX, 4 }, { "INC", &a::INC, &a::ABX, 7 }, { "ISC", &a::ISC, &a::ABX, 7 },
+};
+
+Cpu6502::Cpu6502()
+{
+}
+
+uint8_t Cpu6502::read(uint16_t addr)
+{
+	return bus->cpuRead(addr);
+}
+
+void Cpu6502::write(uint16_t addr, uint8_t data)
+{
+	bus->cpuWrite(addr, data);
+}
+
+void Cpu6502::push(uint8_t data)
+{
+	write(0x0100 + stkp, data);
+	stkp--;
+}
+
+uint8_t Cpu6502::pop()
+{
+	stkp++;
+	return read(0x0100 + stkp);
+}
+
+void Cpu6502::reset()
+{
+	addr_abs = 0xFFFC;
+	uint16_t lo = read(addr_abs + 0);
+	uint16_t hi = read(addr_abs + 1);
+	pc = (hi << 8) | lo;
+
+	a = 0;
+	x = 0;
+	y = 0;
+	stkp = 0xFD;
+	status = U | I;
+
+	cycles = 0;
+	clock_count += 7;
+}
+
+void Cpu6502::irq()
+{
+	if (getFlag(I)) return;
+
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
+	push((status & ~B) | U);
+	setFlag(I, true);
+
+	uint16_t lo = read(0xFFFE);
+	uint16_t hi = read(0xFFFF);
+	pc = (hi << 8) | lo;
+	clock_count += 7;
+}
+
+void Cpu6502::nmi()
+{
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
+	push((status & ~B) | U);
+	setFlag(I, true);
+
+	uint16_t lo = read(0xFFFA);
+	uint16_t hi = read(0xFFFB);
+	pc = (hi << 8) | lo;
+	clock_count += 7;
+}
+
+uint32_t Cpu6502::step()
+{
+	opcode = read(pc++);
+	setFlag(U, true);
+
+	const Instruction& instruction = lookup[opcode];
+	extra_cycles = 0;
+	uint8_t page_crossed = (this->*instruction.addrmode)();
+	uint8_t takes_page_cycle = (this->*instruction.operate)();
+
+	uint32_t total = instruction.cycles + (page_crossed & takes_page_cycle) + extra_cycles + cycles;
+	cycles = 0;
+	clock_count += total;
+	return total;
+}
+
+// ---------------------------------------------------------------------
+// Addressing modes
+
+// Implied / accumulator: the operand is the accumulator
+uint8_t Cpu6502::IMP()
+{
+	fetched = a;
+	return 0;
+}
+
+uint8_t Cpu6502::IMM()
+{
+	addr_abs = pc++;
+	return 0;
+}
+
+uint8_t Cpu6502::ZP0()
+{
+	addr_abs = read(pc++) & 0x00FF;
+	return 0;
+}
+
+uint8_t Cpu6502::ZPX()
+{
+	addr_abs = (read(pc++) + x) & 0x00FF;
+	return 0;
+}
+
+uint8_t Cpu6502::ZPY()
+{
+	addr_abs = (read(pc++) + y) & 0x00FF;
+	return 0;
+}
+
+uint8_t Cpu6502::REL()
+{
+	addr_rel = read(pc++);
+	if (addr_rel & 0x80) addr_rel |= 0xFF00;
+	return 0;
+}
+
+uint8_t Cpu6502::ABS()
+{
+	uint16_t lo = read(pc++);
+	uint16_t hi = read(pc++);
+	addr_abs = (hi << 8) | lo;
+	return 0;
+}
+
+uint8_t Cpu6502::ABX()
+{
+	uint16_t lo = read(pc++);
+	uint16_t hi = read(pc++);
+	addr_abs = ((hi << 8) | lo) + x;
+	return (addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
+}
+
+uint8_t Cpu6502::ABY()
+{
+	uint16_t lo = read(pc++);
+	uint16_t hi = read(pc++);
+	addr_abs = ((hi << 8) | lo) + y;
+	return (addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
+}
+
+// The pointer high byte is fetched without carry (hardware page boundary bug)
+uint8_t Cpu6502::IND()
+{
+	uint16_t ptr_lo = read(pc++);
+	uint16_t ptr_hi = read(pc++);
+	uint16_t ptr = (ptr_hi << 8) | ptr_lo;
+
+	uint16_t lo = read(ptr);
+	uint16_t hi = read((ptr & 0xFF00) | ((ptr + 1) & 0x00FF));
+	addr_abs = (hi << 8) | lo;
+	return 0;
+}
+
+uint8_t Cpu6502::IZX()
+{
+	uint16_t t = read(pc++);
+	uint16_t lo = read((t + x) & 0x00FF);
+	uint16_t hi = read((t + x + 1) & 0x00FF);
+	addr_abs = (hi << 8) | lo;
+	return 0;
+}
+
+uint8_t Cpu6502::IZY()
+{
+	uint16_t t = read(pc++);
+	uint16_t lo = read(t & 0x00FF);
+	uint16_t hi = read((t + 1) & 0x00FF);
+	addr_abs = ((hi << 8) | lo) + y;
+	return (addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------
+// Helpers
+
+uint8_t Cpu6502::fetch()
+{
+	if (lookup[opcode].addrmode != &Cpu6502::IMP)
+		fetched = read(addr_abs);
+	return fetched;
+}
+
+// Read-modify-write result goes to the accumulator in accumulator mode
+void Cpu6502::writeBack(uint8_t value)
+{
+	if (lookup[opcode].addrmode == &Cpu6502::IMP)
+		a = value;
+	else
+		write(addr_abs, value);
+}
+
+void Cpu6502::branch(bool condition)
+{
+	if (!condition) return;
+
+	extra_cycles++;
+	addr_abs = pc + addr_rel;
+	if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+		extra_cycles++;
+	pc = addr_abs;
+}
+
+void Cpu6502::compare(uint8_t reg)
+{
+	uint16_t temp = (uint16_t)reg - (uint16_t)fetched;
+	setFlag(C, reg >= fetched);
+	setZN(temp & 0x00FF);
+}
+
+static inline uint8_t addWithCarry(uint8_t& status, uint8_t acc, uint8_t value)
+{
+	uint16_t temp = (uint16_t)acc + (uint16_t)value + (status & Cpu6502::C);
+	status &= ~(Cpu6502::C | Cpu6502::V | Cpu6502::Z | Cpu6502::N);
+	if (temp > 0xFF) status |= Cpu6502::C;
+	if ((~(acc ^ value) & (acc ^ temp)) & 0x80) status |= Cpu6502::V;
+	if ((temp & 0xFF) == 0) status |= Cpu6502::Z;
+	if (temp & 0x80) status |= Cpu6502::N;
+	return temp & 0xFF;
+}
+
+// ---------------------------------------------------------------------
+// Official opcodes
+
+uint8_t Cpu6502::ADC()
+{
+	fetch();
+	a = addWithCarry(status, a, fetched);
+	return 1;
+}
+
+uint8_t Cpu6502::SBC()
+{
+	fetch();
+	a = addWithCarry(status, a, fetched ^ 0xFF);
+	return 1;
+}
+
+uint8_t Cpu6502::AND()
+{
+	a &= fetch();
+	setZN(a);
+	return 1;
+}
+
+uint8_t Cpu6502::ASL()
+{
+	fetch();
+	setFlag(C, fetched & 0x80);
+	uint8_t value = fetched << 1;
+	setZN(value);
+	writeBack(value);
+	return 0;
+}
+
+uint8_t Cpu6502::BCC() { branch(!getFlag(C)); return 0; }
+uint8_t Cpu6502::BCS() { branch(getFlag(C)); return 0; }
+uint8_t Cpu6502::BEQ() { branch(getFlag(Z)); return 0; }
+uint8_t Cpu6502::BMI() { branch(getFlag(N)); return 0; }
+uint8_t Cpu6502::BNE() { branch(!getFlag(Z)); return 0; }
+uint8_t Cpu6502::BPL() { branch(!getFlag(N)); return 0; }
+uint8_t Cpu6502::BVC() { branch(!getFlag(V)); return 0; }
+uint8_t Cpu6502::BVS() { branch(getFlag(V)); return 0; }
+
+uint8_t Cpu6502::BIT()
+{
+	fetch();
+	setFlag(Z, (a & fetched) == 0x00);
+	setFlag(N, fetched & (1 << 7));
+	setFlag(V, fetched & (1 << 6));
+	return 0;
+}
+
+// The padding byte after BRK has already been skipped by IMM
+uint8_t Cpu6502::BRK()
+{
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
+	push(status | B | U);
+	setFlag(I, true);
+	pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+	return 0;
+}
+
+uint8_t Cpu6502::CLC() { setFlag(C, false); return 0; }
+uint8_t Cpu6502::CLD() { setFlag(D, false); return 0; }
+uint8_t Cpu6502::CLI() { setFlag(I, false); return 0; }
+uint8_t Cpu6502::CLV() { setFlag(V, false); return 0; }
+
+uint8_t Cpu6502::CMP() { fetch(); compare(a); return 1; }
+uint8_t Cpu6502::CPX() { fetch(); compare(x); return 0; }
+uint8_t Cpu6502::CPY() { fetch(); compare(y); return 0; }
+
+uint8_t Cpu6502::DEC()
+{
+	uint8_t value = fetch() - 1;
+	write(addr_abs, value);
+	setZN(value);
+	return 0;
+}
+
+uint8_t Cpu6502::DEX() { x--; setZN(x); return 0; }
+uint8_t Cpu6502::DEY() { y--; setZN(y); return 0; }
+
+uint8_t Cpu6502::EOR()
+{
+	a ^= fetch();
+	setZN(a);
+	return 1;
+}
+
+uint8_t Cpu6502::INC()
+{
+	uint8_t value = fetch() + 1;
+	write(addr_abs, value);
+	setZN(value);
+	return 0;
+}
+
+uint8_t Cpu6502::INX() { x++; setZN(x); return 0; }
+uint8_t Cpu6502::INY() { y++; setZN(y); return 0; }
+
+uint8_t Cpu6502::JMP()
+{
+	pc = addr_abs;
+	return 0;
+}
+
+uint8_t Cpu6502::JSR()
+{
+	pc--;
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
+	pc = addr_abs;
+	return 0;
+}
+
+uint8_t Cpu6502::LDA() { a = fetch(); setZN(a); return 1; }
+uint8_t Cpu6502::LDX() { x = fetch(); setZN(x); return 1; }
+uint8_t Cpu6502::LDY() { y = fetch(); setZN(y); return 1; }
+
+uint8_t Cpu6502::LSR()
+{
+	fetch();
+	setFlag(C, fetched & 0x01);
+	uint8_t value = fetched >> 1;
+	setZN(value);
+	writeBack(value);
+	return 0;
+}
+
+uint8_t Cpu6502::NOP() { return 0; }
+
+uint8_t Cpu6502::ORA()
+{
+	a |= fetch();
+	setZN(a);
+	return 1;
+}
+
+uint8_t Cpu6502::PHA() { push(a); return 0; }
+uint8_t Cpu6502::PHP() { push(status | B | U); return 0; }
+
+uint8_t Cpu6502::PLA()
+{
+	a = pop();
+	setZN(a);
+	return 0;
+}
+
+uint8_t Cpu6502::PLP()
+{
+	status = (pop() & ~B) | U;
+	return 0;
+}
+
+uint8_t Cpu6502::ROL()
+{
+	fetch();
+	uint8_t value = (fetched << 1) | (getFlag(C) ? 0x01 : 0x00);
+	setFlag(C, fetched & 0x80);
+	setZN(value);
+	writeBack(value);
+	return 0;
+}
+
+uint8_t Cpu6502::ROR()
+{
+	fetch();
+	uint8_t value = (getFlag(C) ? 0x80 : 0x00) | (fetched >> 1);
+	setFlag(C, fetched & 0x01);
+	setZN(value);
+	writeBack(value);
+	return 0;
+}
+
+uint8_t Cpu6502::RTI()
+{
+	status = (pop() & ~B) | U;
+	uint16_t lo = pop();
+	uint16_t hi = pop();
+	pc = (hi << 8) | lo;
+	return 0;
+}
+
+uint8_t Cpu6502::RTS()
+{
+	uint16_t lo = pop();
+	uint16_t hi = pop();
+	pc = ((hi << 8) | lo) + 1;
+	return 0;
+}
+
+uint8_t Cpu6502::SEC() { setFlag(C, true); return 0; }
+uint8_t Cpu6502::SED() { setFlag(D, true); return 0; }
+uint8_t Cpu6502::SEI() { setFlag(I, true); return 0; }
+
+uint8_t Cpu6502::STA() { write(addr_abs, a); return 0; }
+uint8_t Cpu6502::STX() { write(addr_abs, x); return 0; }
+uint8_t Cpu6502::STY() { write(addr_abs, y); return 0; }
+
+uint8_t Cpu6502::TAX() { x = a; setZN(x); return 0; }
+uint8_t Cpu6502::TAY() { y = a; setZN(y); return 0; }
+uint8_t Cpu6502::TSX() { x = stkp; setZN(x); return 0; }
+uint8_t Cpu6502::TXA() { a = x; setZN(a); return 0; }
+uint8_t Cpu6502::TXS() { stkp = x; return 0; }
+uint8_t Cpu6502::TYA() { a = y; setZN(a); return 0; }
+
+// ---------------------------------------------------------------------
+// Unofficial opcodes
+
+uint8_t Cpu6502::LAX()
+{
+	a = x = fetch();
+	setZN(a);
+	return 1;
+}
+
+uint8_t Cpu6502::SAX()
+{
+	write(addr_abs, a & x);
+	return 0;
+}
+
+uint8_t Cpu6502::DCP()
+{
+	fetched = fetch() - 1;
+	write(addr_abs, fetched);
+	compare(a);
+	return 0;
+}
+
+uint8_t Cpu6502::ISC()
+{
+	uint8_t value = fetch() + 1;
+	write(addr_abs, value);
+	a = addWithCarry(status, a, value ^ 0xFF);
+	return 0;
+}
+
+uint8_t Cpu6502::SLO()
+{
+	fetch();
+	setFlag(C, fetched & 0x80);
+	uint8_t value = fetched << 1;
+	write(addr_abs, value);
+	a |= value;
+	setZN(a);
+	return 0;
+}
+
+uint8_t Cpu6502::RLA()
+{
+	fetch();
+	uint8_t value = (fetched << 1) | (getFlag(C) ? 0x01 : 0x00);
+	setFlag(C, fetched & 0x80);
+	write(addr_abs, value);
+	a &= value;
+	setZN(a);
+	return 0;
+}
+
+uint8_t Cpu6502::SRE()
+{
+	fetch();
+	setFlag(C, fetched & 0x01);
+	uint8_t value = fetched >> 1;
+	write(addr_abs, value);
+	a ^= value;
+	setZN(a);
+	return 0;
+}
+
+uint8_t Cpu6502::RRA()
+{
+	fetch();
+	uint8_t value = (getFlag(C) ? 0x80 : 0x00) | (fetched >> 1);
+	setFlag(C, fetched & 0x01);
+	write(addr_abs, value);
+	a = addWithCarry(status, a, value);
+	return 0;
+}
+
+uint8_t Cpu6502::SKB()
+{
+	fetch();
+	return 1;
+}
+
+uint8_t Cpu6502::XXX()
+{
+	return 0;
+}
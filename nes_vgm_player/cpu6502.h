@@ -0,0 +1,108 @@
+/*
+ * cpu6502.h - MOS 6502 (2A03) CPU interpreter
+ * Table dispatched: every opcode maps to an addressing mode, an operation and
+ * its base cycle count. Page crossings and taken branches add cycles on top.
+ */
+#ifndef CPU6502_H
+#define CPU6502_H
+
+#include <cstdint>
+
+class Bus;
+
+class Cpu6502
+{
+public:
+    Cpu6502();
+
+public:
+    enum FLAGS6502
+    {
+        C = (1 << 0), // Carry
+        Z = (1 << 1), // Zero
+        I = (1 << 2), // Disable interrupts
+        D = (1 << 3), // Decimal mode (ignored by the 2A03)
+        B = (1 << 4), // Break
+        U = (1 << 5), // Unused
+        V = (1 << 6), // Overflow
+        N = (1 << 7), // Negative
+    };
+
+    uint8_t a = 0x00;
+    uint8_t x = 0x00;
+    uint8_t y = 0x00;
+    uint8_t stkp = 0xFD;
+    uint16_t pc = 0x0000;
+    uint8_t status = 0x24;
+
+    // Stall cycles requested by other devices (DMC DMA), added to the next step()
+    int cycles = 0;
+    // Total number of CPU cycles executed since power up
+    uint64_t clock_count = 0;
+
+    void connectBus(Bus* n) { bus = n; }
+    void reset();
+    void irq();
+    void nmi();
+    // Executes one instruction and returns the number of cycles it took
+    uint32_t step();
+
+private:
+    Bus* bus = nullptr;
+
+    uint8_t fetched = 0x00;
+    uint16_t addr_abs = 0x0000;
+    uint16_t addr_rel = 0x0000;
+    uint8_t opcode = 0x00;
+    uint8_t extra_cycles = 0;
+
+    uint8_t read(uint16_t addr);
+    void write(uint16_t addr, uint8_t data);
+    uint8_t fetch();
+    void push(uint8_t data);
+    uint8_t pop();
+    bool getFlag(FLAGS6502 f) const { return (status & f) != 0; }
+    void setFlag(FLAGS6502 f, bool v) { if (v) status |= f; else status &= ~f; }
+    void setZN(uint8_t value) { setFlag(Z, value == 0x00); setFlag(N, value & 0x80); }
+    void branch(bool condition);
+    void compare(uint8_t reg);
+    void writeBack(uint8_t value);
+
+    struct Instruction
+    {
+        const char* name;
+        uint8_t (Cpu6502::*operate)();
+        uint8_t (Cpu6502::*addrmode)();
+        uint8_t cycles;
+    };
+    static const Instruction lookup[256];
+
+    // Addressing modes, return 1 if an extra cycle may be needed (page crossed)
+    uint8_t IMP(); uint8_t IMM(); uint8_t ZP0(); uint8_t ZPX();
+    uint8_t ZPY(); uint8_t REL(); uint8_t ABS(); uint8_t ABX();
+    uint8_t ABY(); uint8_t IND(); uint8_t IZX(); uint8_t IZY();
+
+    // Official opcodes, return 1 if they take the page crossing cycle
+    uint8_t ADC(); uint8_t AND(); uint8_t ASL(); uint8_t BCC();
+    uint8_t BCS(); uint8_t BEQ(); uint8_t BIT(); uint8_t BMI();
+    uint8_t BNE(); uint8_t BPL(); uint8_t BRK(); uint8_t BVC();
+    uint8_t BVS(); uint8_t CLC(); uint8_t CLD(); uint8_t CLI();
+    uint8_t CLV(); uint8_t CMP(); uint8_t CPX(); uint8_t CPY();
+    uint8_t DEC(); uint8_t DEX(); uint8_t DEY(); uint8_t EOR();
+    uint8_t INC(); uint8_t INX(); uint8_t INY(); uint8_t JMP();
+    uint8_t JSR(); uint8_t LDA(); uint8_t LDX(); uint8_t LDY();
+    uint8_t LSR(); uint8_t NOP(); uint8_t ORA(); uint8_t PHA();
+    uint8_t PHP(); uint8_t PLA(); uint8_t PLP(); uint8_t ROL();
+    uint8_t ROR(); uint8_t RTI(); uint8_t RTS(); uint8_t SBC();
+    uint8_t SEC(); uint8_t SED(); uint8_t SEI(); uint8_t STA();
+    uint8_t STX(); uint8_t STY(); uint8_t TAX(); uint8_t TAY();
+    uint8_t TSX(); uint8_t TXA(); uint8_t TXS(); uint8_t TYA();
+
+    // Stable unofficial opcodes used by some sound drivers
+    uint8_t LAX(); uint8_t SAX(); uint8_t DCP(); uint8_t ISC();
+    uint8_t SLO(); uint8_t RLA(); uint8_t SRE(); uint8_t RRA();
+    uint8_t SKB(); // NOP reading its operand (may take the page crossing cycle)
+    uint8_t XXX(); // remaining unofficial opcodes are executed as NOPs
+};
+
+#endif
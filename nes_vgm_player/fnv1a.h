@@ -0,0 +1,22 @@
+/*
+ * fnv1a.h - 64-bit FNV-1a hash, used for PCM fingerprints and content keys
+ */
+#ifndef FNV1A_H
+#define FNV1A_H
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV1A_PRIME = 0x100000001b3ULL;
+
+inline uint64_t fnv1a64(const uint8_t* data, size_t len, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * loudness.cpp - EBU R128 / ITU-R BS.1770 loudness and true peak measurement
+ */
+#include "loudness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+constexpr double PI = 3.14159265358979323846;
+
+// 400 ms gating blocks overlapping by 75 %, built from 100 ms sub-blocks
+constexpr int SUB_BLOCKS_PER_BLOCK = 4;
+constexpr double ABSOLUTE_GATE_LUFS = -70.0;
+constexpr double RELATIVE_GATE_LU = -10.0;
+
+// True peak: 4x oversampling with a 48 tap windowed sinc, 12 taps per phase
+constexpr int OVERSAMPLING = 4;
+constexpr int TAPS_PER_PHASE = 12;
+
+struct Biquad
+{
+    double b0, b1, b2, a1, a2;
+    double z1 = 0.0, z2 = 0.0;
+
+    double process(double x)
+    {
+        double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+// K-weighting (BS.1770 pre-filter and RLB high-pass) for any sample rate,
+// derived from the analog prototypes the 48 kHz coefficients are based on
+static void kWeighting(int sampleRate, Biquad& shelf, Biquad& highPass)
+{
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = std::tan(PI * f0 / sampleRate);
+    double Vh = std::pow(10.0, G / 20.0);
+    double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    shelf = { (Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+        2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0 };
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = std::tan(PI * f0 / sampleRate);
+    a0 = 1.0 + K / Q + K * K;
+    highPass = { 1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0 };
+}
+
+static std::array<double, OVERSAMPLING * TAPS_PER_PHASE> interpolationFilter()
+{
+    std::array<double, OVERSAMPLING * TAPS_PER_PHASE> h;
+    const int n = static_cast<int>(h.size());
+    for (int i = 0; i < n; i++) {
+        double t = double(i - n / 2) / OVERSAMPLING;
+        double sinc = (t == 0.0) ? 1.0 : std::sin(PI * t) / (PI * t);
+        double window = 0.5 - 0.5 * std::cos(2.0 * PI * i / n);
+        h[i] = sinc * window;
+    }
+    return h;
+}
+
+static double loudness(double meanSquare)
+{
+    return -0.691 + 10.0 * std::log10(meanSquare);
+}
+
+LoudnessResult measureLoudness(const std::vector<uint8_t>& pcm, int sampleRate)
+{
+    LoudnessResult result;
+    Biquad shelf, highPass;
+    kWeighting(sampleRate, shelf, highPass);
+    static const auto h = interpolationFilter();
+
+    const size_t subBlockSize = sampleRate / 10;
+    std::vector<double> subBlocks;
+    double sum = 0.0;
+    size_t count = 0;
+    double peak = 0.0;
+    std::array<double, TAPS_PER_PHASE> history = {};
+
+    // The APU output is unipolar. Measuring around the mean keeps the DC offset
+    // out of the peak and the filters from ringing on the step at the start.
+    double dc = 0.0;
+    for (uint8_t v : pcm) dc += v;
+    dc = pcm.empty() ? 0.0 : dc / pcm.size();
+
+    for (size_t i = 0; i < pcm.size(); i++) {
+        result.maxSample = std::max(result.maxSample, pcm[i]);
+        double x = (pcm[i] - dc) / 128.0;
+
+        double y = highPass.process(shelf.process(x));
+        sum += y * y;
+        if (++count == subBlockSize) {
+            subBlocks.push_back(sum / subBlockSize);
+            sum = 0.0;
+            count = 0;
+        }
+
+        std::copy_backward(history.begin(), history.end() - 1, history.end());
+        history[0] = x;
+        for (int phase = 0; phase < OVERSAMPLING; phase++) {
+            double v = 0.0;
+            for (int j = 0; j < TAPS_PER_PHASE; j++) v += h[j * OVERSAMPLING + phase] * history[j];
+            peak = std::max(peak, std::fabs(v));
+        }
+        peak = std::max(peak, std::fabs(x));
+    }
+    if (peak > 0.0) result.truePeakDb = 20.0 * std::log10(peak);
+
+    std::vector<double> blocks;
+    for (size_t i = 0; i + SUB_BLOCKS_PER_BLOCK <= subBlocks.size(); i++) {
+        double meanSquare = 0.0;
+        for (int j = 0; j < SUB_BLOCKS_PER_BLOCK; j++) meanSquare += subBlocks[i + j];
+        meanSquare /= SUB_BLOCKS_PER_BLOCK;
+        if (meanSquare > 0.0 && loudness(meanSquare) > ABSOLUTE_GATE_LUFS) blocks.push_back(meanSquare);
+    }
+    if (blocks.empty()) return result;
+
+    double mean = 0.0;
+    for (double b : blocks) mean += b;
+    mean /= blocks.size();
+    const double relativeGate = loudness(mean) + RELATIVE_GATE_LU;
+
+    double gated = 0.0;
+    size_t gatedCount = 0;
+    for (double b : blocks) {
+        if (loudness(b) > relativeGate) {
+            gated += b;
+            gatedCount++;
+        }
+    }
+    if (gatedCount) result.integratedLufs = loudness(gated / gatedCount);
+    return result;
+}
+
+double replayGainDb(const LoudnessResult& loudness, double targetLufs)
+{
+    // Silent tracks are left alone
+    double gain = loudness.integratedLufs > LOUDNESS_SILENCE_LUFS ? targetLufs - loudness.integratedLufs : 0.0;
+    if (loudness.maxSample > 0) gain = std::min(gain, 20.0 * std::log10(255.0 / loudness.maxSample));
+    return gain;
+}
+
+bool loadLoudnessIndex(const std::string& path, std::map<std::string, LoudnessEntry>& index)
+{
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        LoudnessEntry entry;
+        std::string name;
+        if (ss >> entry.gainDb >> entry.integratedLufs >> entry.truePeakDb && std::getline(ss >> std::ws, name)) {
+            index[name] = entry;
+        }
+    }
+    return true;
+}
+
+bool saveLoudnessIndex(const std::string& path, const std::map<std::string, LoudnessEntry>& index)
+{
+    std::ofstream f(path);
+    f << "# Replay gain (dB), integrated loudness (LUFS), true peak (dBTP), written by vgm_analyze\n";
+    for (const auto& [name, entry] : index) {
+        char values[64];
+        snprintf(values, sizeof(values), "%+.2f %.2f %.2f", entry.gainDb, entry.integratedLufs, entry.truePeakDb);
+        f << values << " " << name << "\n";
+    }
+    return static_cast<bool>(f);
+}
+
+std::array<uint8_t, 256> loudnessGainTable(double gainDb)
+{
+    std::array<uint8_t, 256> table;
+    const double gain = std::pow(10.0, gainDb / 20.0);
+    for (int i = 0; i < 256; i++) table[i] = static_cast<uint8_t>(std::min(255L, std::lround(i * gain)));
+    return table;
+}
@@ -0,0 +1,48 @@
+/*
+ * loudness.h - EBU R128 / ITU-R BS.1770 loudness and true peak measurement,
+ * replay gain and the loudness index file the player reads its gains from
+ */
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// ReplayGain 2.0 reference level
+constexpr double LOUDNESS_TARGET_LUFS = -18.0;
+// Integrated loudness of tracks without a single block above the absolute gate
+constexpr double LOUDNESS_SILENCE_LUFS = -70.0;
+constexpr const char* LOUDNESS_INDEX_FILE = "loudness_index.txt";
+
+struct LoudnessResult
+{
+    double integratedLufs = LOUDNESS_SILENCE_LUFS;
+    double truePeakDb = -100.0;     // dBTP around the mean value (the APU output is unipolar)
+    uint8_t maxSample = 0;          // largest APU output value, limits the gain before clipping
+};
+
+// Measures 8-bit unsigned mono PCM as produced by the APU
+LoudnessResult measureLoudness(const std::vector<uint8_t>& pcm, int sampleRate);
+
+// Gain in dB that brings the track to targetLufs, reduced so that scaling the
+// APU output by it never exceeds 255
+double replayGainDb(const LoudnessResult& loudness, double targetLufs = LOUDNESS_TARGET_LUFS);
+
+struct LoudnessEntry
+{
+    double gainDb = 0.0;
+    double integratedLufs = LOUDNESS_SILENCE_LUFS;
+    double truePeakDb = 0.0;
+};
+
+// Index format: one "<gain dB> <integrated LUFS> <true peak dBTP> <file name>" line per track
+bool loadLoudnessIndex(const std::string& path, std::map<std::string, LoudnessEntry>& index);
+bool saveLoudnessIndex(const std::string& path, const std::map<std::string, LoudnessEntry>& index);
+
+// Output value for every APU sample value when scaling by gainDb (0 stays silent)
+std::array<uint8_t, 256> loudnessGainTable(double gainDb);
+
+#endif
@@ -5,13 +5,32 @@
 #include <random>
 #include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <map>
 #include <stdexcept>
 #include <string>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
+#include "alloc_counter.h"
 #include "apu2A03.h"
+#include "audio_sink.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include "loudness.h"
+#include "nsf_file.h"
+#include "nsf_render.h"
+#include "pcm_sink.h"
+#include "playback_stats.h"
+#include "player_input.h"
+#include "playlist.h"
+#include "realtime.h"
+#include "track_cache.h"
+#include "vgm_checkpoint.h"
+#include "vgm_chips.h"
+#include "vgm_file.h"
+#include "vgm_render.h"
 
 using namespace std;
 
@@ -25,7 +44,6 @@ using namespace std;
     #include <termios.h>
     #include <unistd.h>
     #include <fcntl.h>
-    #include <dirent.h>
 
     // Enable raw mode and nonblocking input
     void enable_raw_mode(void) {
@@ -46,6 +64,9 @@ using namespace std;
 #endif
 // ---------------------------------------------------------------------
 static SDL_AudioStream *stream = NULL;
+static PlaybackStats stats;
+// Set while seeking: the skipped audio is rendered but not queued
+static bool outputMuted = false;
 
 bool initSdl()
 {
@@ -58,7 +79,7 @@ bool initSdl()
     SDL_AudioSpec spec;
     spec.channels = 1;
     spec.format = SDL_AUDIO_U8;
-    spec.freq = 44100;
+    spec.freq = AUDIO_SAMPLE_RATE;
     stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, NULL, NULL);
     if (!stream) {
         SDL_Log("Couldn't create audio stream: %s", SDL_GetError());
@@ -75,182 +96,432 @@ bool closeSdl()
     return true;
 }
 
-void putAudioStreamData(const void* buf, int len)
-{
-    if (stream) {
-        if (!SDL_PutAudioStreamData(stream, buf, len)) {
+// Plays through the default audio device
+class SdlSink : public AudioSink {
+public:
+    explicit SdlSink(SDL_AudioStream* stream) : stream(stream) {}
+
+    void write(const uint8_t* samples, int count) override
+    {
+        if (!SDL_PutAudioStreamData(stream, samples, count)) {
             SDL_Log("Couldn't put audio data into stream: %s", SDL_GetError());
         }
         SDL_FlushAudioStream(stream);
     }
+    int queued() override { return SDL_GetAudioStreamQueued(stream); }
+    bool flush() override { return true; }
+    void clear() override { SDL_ClearAudioStream(stream); }
+    void setPaused(bool paused) override
+    {
+        if (paused) SDL_PauseAudioStreamDevice(stream);
+        else SDL_ResumeAudioStreamDevice(stream);
+    }
+    void idle() override { SDL_Delay(1); }
+
+private:
+    SDL_AudioStream* stream;
+};
+
+static std::unique_ptr<AudioSink> sink;
+
+// Replay gain of the current track, applied to the APU output
+static std::array<uint8_t, 256> gainTable;
+static bool gainActive = false;
+
+void setTrackGain(double gainDb)
+{
+    gainActive = (gainDb != 0.0);
+    gainTable = loudnessGainTable(gainDb);
+}
+
+void putAudioStreamData(const void* buf, int len)
+{
+    if (sink && !outputMuted) {
+        stats.countSamples(len);
+        uint8_t scaled[AUDIO_BUFFER_SIZE];
+        const uint8_t* src = static_cast<const uint8_t*>(buf);
+        while (len > 0) {
+            int chunk = std::min(len, AUDIO_BUFFER_SIZE);
+            const uint8_t* data = src;
+            if (gainActive) {
+                for (int i = 0; i < chunk; i++) scaled[i] = gainTable[src[i]];
+                data = scaled;
+            }
+            sink->write(data, chunk);
+            src += chunk;
+            len -= chunk;
+        }
+    }
 }
 
 // ---------------------------------------------------------------------
+// Plays VGM register logs and NSF files (NSF songs are played one after another)
 class VgmPlayer {
 public:
     enum class Status { IDLE, FINISHED, PLAYING, QUIT, ST_ERROR, NEXT, PREV };
     VgmPlayer() = default;
     bool load(const std::string& path);
     Status play(Apu2A03& apu);
+    // Clock the second APU of dual-chip VGM files on its own thread
+    void setThreadedChips(bool enable) { threadedChips = enable; }
+    // Queue the input thread posts key commands to
+    void setCommandQueue(PlayerCommandQueue* queue) { commands = queue; }
+    // Memory for keeping recently played tracks loaded and decoded
+    void setCacheCapacity(size_t bytes) { cache.setCapacity(bytes); }
+    // Drops the cached copy of a file that has changed or gone away
+    void forget(const std::string& path) { cache.invalidate(path); }
+    // Play tracks under SCHED_FIFO, lock the data of the playing track into
+    // memory and check the playback loop for heap allocations
+    void setRealtime(bool enable) { realtime = enable; }
+    // Headless renders: saves a checkpoint of the render into 'path' at the
+    // start of every track and every few seconds of VGM output
+    void setCheckpoint(const std::string& path, const PcmSink* output);
+    // Continues from the checkpoint the next time its track is played
+    void resumeFrom(std::unique_ptr<VgmCheckpoint> checkpoint) { resume = std::move(checkpoint); }
 
 private:
-    std::vector<uint8_t> data;
-    size_t dataOffset = 0;
+    static constexpr int MINIMUM_AUDIO = 16384;
+    // NSF songs carry no length, each one is played for this long unless skipped
+    static constexpr uint32_t NSF_SONG_SECONDS = 150;
+
+    static constexpr int SAMPLE_RATE = 44100;
+    static constexpr uint64_t CHECKPOINT_SAMPLES = 5 * SAMPLE_RATE;
+
+    Status playVgm(Apu2A03& apu);
+    Status playNsf(Apu2A03& apu);
+    // Executes the queued commands. Returns PLAYING or the command that ends
+    // the track, seekSeconds accumulates the requested seeks.
+    Status handleCommands(int& seekSeconds);
+    void setPaused(bool pause);
+    // Executes the next command of the stream and records keyframes on the way
+    void stepVgm(VgmChips& chips, size_t& next, uint64_t& position);
+    // Renders muted up to 'target' samples into the stream, starting from the
+    // closest keyframe (or the start of the stream) when that is closer than
+    // the current position
+    void seekVgm(VgmChips& chips, size_t& next, uint64_t& position, uint64_t target);
+    // Reports heap allocations made since 'before' (real time mode, debug
+    // builds); called for every iteration of the playback loops
+    void checkAllocations(uint64_t before);
+    // Zeroes the chips' memory and applies the RAM writes in front of command 'next'
+    void rebuildMemory(VgmChips& chips, size_t next);
+    // Writes the checkpoint with the chip states already stored in it. The
+    // audio buffers of the chips must have been flushed into the sink.
+    void writeCheckpoint(size_t next, uint64_t position);
+
+    bool threadedChips = false;
+    bool realtime = false;
+    // Cleared once the system refused SCHED_FIFO, it is not asked again for every track
+    bool realtimePriority = true;
+    bool paused = false;
+    PlayerCommandQueue* commands = nullptr;
+    TrackCache cache;
+    std::shared_ptr<CachedTrack> track;
+    NsfRenderer nsfRenderer;
+    Bus bus;
+    Cpu6502 cpu;
+
+    std::string checkpointPath;
+    const PcmSink* checkpointOutput = nullptr;
+    std::unique_ptr<VgmCheckpoint> checkpoint;
+    std::vector<uint8_t> checkpointData;
+    std::unique_ptr<VgmCheckpoint> resume;
 };
 
+void VgmPlayer::setCheckpoint(const std::string& path, const PcmSink* output) {
+    checkpointPath = path;
+    checkpointOutput = output;
+    if (!checkpoint) checkpoint = std::make_unique<VgmCheckpoint>();
+}
+
+void VgmPlayer::writeCheckpoint(size_t next, uint64_t position) {
+    sink->flush();
+    checkpoint->track = track->path;
+    checkpoint->command = next;
+    checkpoint->position = position;
+    checkpoint->outputBytes = checkpointOutput->bytesWritten();
+    vgmEncodeCheckpoint(*checkpoint, checkpointData);
+    vgmSaveCheckpoint(checkpointPath, checkpointData);
+}
+
 bool VgmPlayer::load(const std::string& path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) {
-        std::cerr << "Failed to open VGM file: " << path << "\n";
-        return false;
-    }
+    track = cache.get(path);
+    return track != nullptr;
+}
 
-    f.seekg(0, std::ios::end);
-    size_t size = f.tellg();
-    f.seekg(0, std::ios::beg);
+VgmPlayer::Status VgmPlayer::play(Apu2A03& apu) {
+    if (!track) {
+        std::cerr << "No track loaded\n";
+        return Status::ST_ERROR;
+    }
+    // Only the playback itself runs at real time priority, see realtime.h
+    if (realtime && realtimePriority) realtimePriority = setRealtimePriority(REALTIME_DEFAULT_PRIORITY);
+    Status status = track->isNsf ? playNsf(apu) : playVgm(apu);
+    if (realtime && realtimePriority) setNormalPriority();
+    return status;
+}
 
-    data.resize(size);
-    f.read(reinterpret_cast<char*>(data.data()), size);
-    if (!f) {
-        std::cerr << "Failed to read VGM file\n";
-        return false;
+VgmPlayer::Status VgmPlayer::handleCommands(int& seekSeconds) {
+    PlayerCommand command;
+    while (commands && commands->pop(command)) {
+        switch (command.type) {
+        case PlayerCommand::Type::QUIT:
+            return Status::QUIT;
+        case PlayerCommand::Type::NEXT:
+            return Status::NEXT;
+        case PlayerCommand::Type::PREV:
+            return Status::PREV;
+        case PlayerCommand::Type::PAUSE:
+            setPaused(!paused);
+            break;
+        case PlayerCommand::Type::SEEK:
+            seekSeconds += command.seekSeconds;
+            break;
+        }
     }
+    return Status::PLAYING;
+}
 
-    // Check VGM signature
-    if (size < 0x40 || std::string(reinterpret_cast<char*>(&data[0]), 4) != "Vgm ") {
-        std::cerr << "Invalid VGM header\n";
-        return false;
+void VgmPlayer::setPaused(bool pause) {
+    if (pause == paused) return;
+    paused = pause;
+    sink->setPaused(paused);
+    std::cout << (paused ? "Paused\n" : "Resumed\n");
+}
+
+void VgmPlayer::stepVgm(VgmChips& chips, size_t& next, uint64_t& position) {
+    const VgmCommand& cmd = track->commands[next++];
+    if (cmd.type == VgmCommand::Type::DATA_BLOCK) {
+        // Blocks have been decoded when the track was loaded. Compressed stream
+        // data waits for DAC stream commands, which are not supported yet.
+        const VgmDataBlock* block = track->dataBlock(next - 1);
+        if (block && block->type == VGM_BLOCK_NES_RAM_WRITE) chips.writeMemory(block->data->data(), block->data->size());
+        return;
     }
+    chips.apply(cmd);
+    if (cmd.type == VgmCommand::Type::WAIT) {
+        position += cmd.samples;
+        if (track->wantsKeyframe(position)) {
+            // Space for all keyframes has been reserved when the track was loaded
+            VgmKeyframe& keyframe = track->keyframes.emplace_back();
+            keyframe.command = next;
+            keyframe.position = position;
+            chips.saveState(keyframe.chips);
+        }
+    }
+}
 
-    // Data offset (relative to 0x34 + value)
-    uint32_t dataOffsetField = *reinterpret_cast<uint32_t*>(&data[0x34]);
-    dataOffset = dataOffsetField ? (0x34 + dataOffsetField) : 0x40;
+void VgmPlayer::checkAllocations(uint64_t before) {
+    uint64_t count = threadAllocationCount() - before;
+    if (realtime && count > 0) std::cerr << "[rt] " << count << " heap allocation(s) in the playback loop\n";
+}
 
-    if (dataOffset >= size) {
-        std::cerr << "Invalid data offset\n";
-        return false;
+void VgmPlayer::seekVgm(VgmChips& chips, size_t& next, uint64_t& position, uint64_t target) {
+    const VgmKeyframe* keyframe = track->keyframeBefore(target);
+    if (target < position || (keyframe && keyframe->position > position)) {
+        if (keyframe) {
+            chips.restoreState(keyframe->chips);
+            next = keyframe->command;
+            position = keyframe->position;
+        } else {
+            chips.reset();
+            next = 0;
+            position = 0;
+        }
+        // Keyframes hold no memory, it is rebuilt from the RAM writes before the restart point
+        rebuildMemory(chips, next);
     }
 
-    return true;
+    outputMuted = true;
+    const auto& cmds = track->commands;
+    // Stops in front of the end command, the playback loop finishes the stream
+    while (position < target && next < cmds.size() && cmds[next].type != VgmCommand::Type::END) {
+        stepVgm(chips, next, position);
+    }
+    chips.flush();
+    outputMuted = false;
+
+    // Drop the audio queued before the seek
+    sink->clear();
+    std::cout << "Position " << position / SAMPLE_RATE << " s\n";
 }
 
-VgmPlayer::Status VgmPlayer::play(Apu2A03& apu) {
-    if (data.empty()) {
+void VgmPlayer::rebuildMemory(VgmChips& chips, size_t next) {
+    chips.clearMemory();
+    for (const VgmDataBlock& block : track->dataBlocks) {
+        if (block.command >= next) break;
+        if (block.type == VGM_BLOCK_NES_RAM_WRITE) chips.writeMemory(block.data->data(), block.data->size());
+    }
+}
+
+VgmPlayer::Status VgmPlayer::playVgm(Apu2A03& apu) {
+    if (track->vgm.empty()) {
         std::cerr << "No VGM data loaded\n";
         return Status::ST_ERROR;
     }
 
-    size_t pos = dataOffset;
-    const size_t end = data.size();
-    const double samplesPerCpuCycle = (1789773.0 / 44100.0/2); // ≈0.0246 cycles/sample
-    const int minimum_audio = 16384;
-    while (pos < end) {
-        while (SDL_GetAudioStreamQueued(stream) < minimum_audio) {
-            uint8_t cmd = data[pos++];
-
-            switch (cmd) {
-            case 0x66: // End of sound data
-                std::cout << "End of VGM stream\n";
-                return Status::FINISHED;
-
-            case 0xB4: { // NES APU write
-                if (pos + 2 > end) return Status::ST_ERROR;
-                uint8_t addr = data[pos++];
-                uint8_t val = data[pos++];
-                apu.cpuWrite(0x4000 + addr, val);
-                break;
-            }
-
-            case 0x61: { // wait n samples
-                if (pos + 2 > end) return Status::ST_ERROR;
-                uint16_t n = data[pos] | (data[pos + 1] << 8);
-                pos += 2;
-                uint32_t cycles = static_cast<uint32_t>(n * samplesPerCpuCycle);
-                apu.clock(cycles);
-                break;
+    // VGM streams carry no program, the DMC reads what RAM write blocks put on the bus
+    apu.connectBus(&bus);
+    apu.connectCPU(&cpu);
+    // The second chip's worker runs at the priority of this thread, which waits for it at every wait
+    const bool fifo = realtime && realtimePriority;
+    VgmChips chips(apu, track->vgm.isDualChip(), threadedChips, fifo ? REALTIME_DEFAULT_PRIORITY : 0);
+    if (chips.isDual()) std::cout << "Dual-chip VGM\n";
+
+    const auto& cmds = track->commands;
+    // The command stream and the keyframe space are read and written by the render path
+    MemoryLock commandsLock(cmds.data(), realtime ? cmds.size() * sizeof(VgmCommand) : 0);
+    MemoryLock keyframesLock(track->keyframes.data(), realtime ? track->keyframes.capacity() * sizeof(VgmKeyframe) : 0);
+
+    size_t next = 0;        // index of the next command
+    uint64_t position = 0;  // samples played before it
+    if (resume && resume->track == track->path) {
+        if (resume->chipCount == (chips.isDual() ? 2 : 1) && resume->command < cmds.size()) {
+            chips.restoreState(resume->chips);
+            next = resume->command;
+            position = resume->position;
+            rebuildMemory(chips, next);
+            std::cout << "Resuming at " << position / SAMPLE_RATE << " s\n";
+        } else {
+            std::cerr << "Checkpoint does not match the track, rendering it from the start\n";
+        }
+        resume.reset();
+    }
+    uint64_t nextCheckpoint = position;
+
+    while (true) {
+        const uint64_t allocations = threadAllocationCount();
+        int queued = sink->queued();
+        stats.queueLevel(queued);
+        if (queued < MINIMUM_AUDIO && !paused) {
+            if (checkpoint && position >= nextCheckpoint) {
+                // Snapshots hold no audio buffers, everything rendered so far goes to the file first
+                chips.flush();
+                checkpoint->chipCount = chips.isDual() ? 2 : 1;
+                chips.saveState(checkpoint->chips);
+                writeCheckpoint(next, position);
+                nextCheckpoint = position + CHECKPOINT_SAMPLES;
             }
-
-            case 0x62: { // wait 735 samples (60 Hz)
-                apu.clock(static_cast<uint32_t>(735 * samplesPerCpuCycle));
-                break;
+            auto block = stats.beginBlock();
+            while (sink->queued() < MINIMUM_AUDIO) {
+                // Malformed commands have been reported when the file was loaded. The last
+                // samples go out with their track, so every track starts with empty APU
+                // buffers (checkpoints rely on that).
+                if (next == cmds.size()) {
+                    chips.flush();
+                    return track->malformed ? Status::ST_ERROR : Status::FINISHED;
+                }
+                stats.countCommand(cmds[next].type);
+                if (cmds[next].type == VgmCommand::Type::END) {
+                    chips.flush();
+                    std::cout << "End of VGM stream\n";
+                    return Status::FINISHED;
+                }
+                stepVgm(chips, next, position);
             }
+            stats.endBlock(block);
+            if (!sink->flush()) return Status::QUIT;
+        }
+        stats.apuCycles(apu.cycle_count);
+        stats.tick();
+
+        int seekSeconds = 0;
+        Status status = handleCommands(seekSeconds);
+        if (status != Status::PLAYING) return status;
+        if (seekSeconds != 0) {
+            int64_t target = int64_t(position) + int64_t(seekSeconds) * SAMPLE_RATE;
+            seekVgm(chips, next, position, uint64_t(std::max<int64_t>(0, target)));
+        }
+        checkAllocations(allocations);
+        sink->idle();
+    }
+}
 
-            case 0x63: { // wait 882 samples (50 Hz)
-                apu.clock(static_cast<uint32_t>(882 * samplesPerCpuCycle));
-                break;
-            }
+VgmPlayer::Status VgmPlayer::playNsf(Apu2A03& apu) {
+    const NsfFile& nsf = track->nsf;
+    if (nsf.empty()) {
+        std::cerr << "No NSF data loaded\n";
+        return Status::ST_ERROR;
+    }
 
-            case 0x67: // Data block
-                if (pos + 3 > end) return Status::ST_ERROR;
-                {
-                    uint8_t extra_cmd = data[pos++];
-                    uint8_t type = data[pos++];
-                    uint32_t size = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | (data[pos + 3] << 24);
-                    pos += 4;
-                    if (pos + size > end) return Status::ST_ERROR;
-                    // Skip data block for now
-                    pos += size;
+    std::cout << nsf.title() << " - " << nsf.artist() << " (" << nsf.copyright() << ")\n";
+    // The CPU and driver state is not part of checkpoints, NSF files are resumed from their start
+    if (resume && resume->track == track->path) {
+        apu.restoreState(resume->chips[0]);
+        resume.reset();
+    }
+    if (checkpoint) {
+        apu.flushAudioBuffer();
+        checkpoint->chipCount = 1;
+        checkpoint->chips[0].restoreState(apu);
+        writeCheckpoint(0, 0);
+    }
+    int song = nsf.startingSong();
+    while (true) {
+        std::cout << "Song " << song << "/" << nsf.songCount() << "\n";
+        if (!nsfRenderer.start(nsf, apu, song)) return Status::ST_ERROR;
+
+        Status status = Status::PLAYING;
+        const uint64_t songFrames = nsfRenderer.framesFor(NSF_SONG_SECONDS);
+        const uint64_t framesPerSecond = nsfRenderer.framesFor(1);
+        uint64_t frames = songFrames;
+        while (status == Status::PLAYING && frames > 0) {
+            const uint64_t allocations = threadAllocationCount();
+            int queued = sink->queued();
+            stats.queueLevel(queued);
+            if (queued < MINIMUM_AUDIO && !paused) {
+                auto block = stats.beginBlock();
+                while (sink->queued() < MINIMUM_AUDIO && frames > 0) {
+                    nsfRenderer.renderFrame();
+                    frames--;
                 }
-                break;
-            default:
-                if (cmd >= 0x70 && cmd <= 0x7F) {
-                    // wait (n+1) samples
-                    uint8_t n = (cmd & 0x0F) + 1;
-                    uint32_t cycles = static_cast<uint32_t>(n * samplesPerCpuCycle);
-                    apu.clock(cycles);
-                } else {
-                    // Unhandled command, skip or stop
-                    std::cerr << "Unknown VGM command: 0x" 
-                            << std::hex << (int)cmd << std::dec << "\n";
-                    return Status::ST_ERROR;
+                stats.endBlock(block);
+                if (!sink->flush()) return Status::QUIT;
+            }
+            stats.apuCycles(apu.cycle_count);
+            stats.tick();
+            int seekSeconds = 0;
+            status = handleCommands(seekSeconds);
+            if (status != Status::PLAYING) break;
+            if (seekSeconds != 0) {
+                // The driver state cannot be rewound, seeking back replays the song from its start
+                int64_t played = int64_t(songFrames - frames);
+                int64_t target = std::clamp<int64_t>(played + int64_t(seekSeconds) * int64_t(framesPerSecond),
+                    0, int64_t(songFrames));
+                if (target < played) {
+                    if (!nsfRenderer.start(nsf, apu, song)) return Status::ST_ERROR;
+                    played = 0;
                 }
-                break;
+                outputMuted = true;
+                for (; played < target; played++) nsfRenderer.renderFrame();
+                apu.flushAudioBuffer();
+                outputMuted = false;
+                sink->clear();
+                frames = songFrames - uint64_t(played);
+                std::cout << "Position " << played / int64_t(framesPerSecond) << " s\n";
             }
+            checkAllocations(allocations);
+            sink->idle();
         }
 
-#ifdef _WIN32
-        int ch = -1;
-        if (_kbhit()) ch = _getch();
-#else
-        int ch = getchar();
-#endif
-
-        if (ch == 27 || ch == 'q' || ch == 'Q') { // ESC key
-            return Status::QUIT;
-        } else if (ch == 'n' || ch == 'N')  {
-            return Status::NEXT;
-        } else if (ch == 'p' || ch == 'P') {
-            return Status::PREV;
-        } else if (ch != -1) {
-            printf("Key pressed: %d\n", ch);
+        // n/p step through the songs of the file before moving on to other files
+        if (status == Status::QUIT) {
+            return status;
+        } else if (status == Status::PREV) {
+            if (song <= 1) return Status::PREV;
+            song--;
+        } else {
+            if (song >= nsf.songCount()) return status == Status::NEXT ? Status::NEXT : Status::FINISHED;
+            song++;
         }
-        SDL_Delay(1);
     }
-    return Status::FINISHED;
 }
 
 Apu2A03 apu;
-Bus bus;
-Cpu6502 cpu;
 
 void apuInit()
 {
-    apu.connectBus(&bus);
-    apu.connectCPU(&cpu);
-
-    array<uint8_t, 20> initialRegisters = {
-        0x30, 0x08, 0x00, 0x00, // Pulse 1
-        0x30, 0x08, 0x00, 0x00, // Pulse 2
-        0x80, 0x00, 0x00, 0x00, // Triangle
-        0x30, 0x00, 0x00, 0x00, // Noise
-        0x00, 0x00, 0x00, 0x00, // DMC
-    };
-    for (size_t i = 0; i < initialRegisters.size(); i++) {
-        apu.cpuWrite(0x4000 + i, initialRegisters[i]);
-    }
-    // Enable all channels
-    apu.cpuWrite(0x4015, 0x0F);
-    apu.cpuWrite(0x4017, 0x40);
+    apu.setOutputCallback([](void*, const uint8_t* buf, int len) { putAudioStreamData(buf, len); }, nullptr);
+    vgmResetApu(apu);
 }
 
 int main(int argc, char* argv[])
@@ -258,77 +529,210 @@ int main(int argc, char* argv[])
 #ifndef _WIN32
     enable_raw_mode();
 #endif
-    initSdl();
     apuInit();
 
+    // Keys are read on their own thread, the player picks the commands up between renders
+    static PlayerCommandQueue commands;
+    PlayerInput input(commands);
+    input.start();
+
     VgmPlayer vgm;
+    vgm.setCommandQueue(&commands);
+    double statsInterval = 0.0;
+    string statsFile;
+    bool replayGain = true;
+    bool pcmOutput = false;
+    bool realtime = false;
+    string checkpointPath;
+    PcmSinkConfig pcmConfig;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threaded-chips") vgm.setThreadedChips(true);
+        else if (arg == "--no-replay-gain") replayGain = false;
+        else if (arg == "--stats" && i + 1 < argc) statsInterval = atof(argv[++i]);
+        else if (arg == "--stats-file" && i + 1 < argc) statsFile = argv[++i];
+        else if (arg == "--pcm" && i + 1 < argc) {
+            pcmOutput = true;
+            pcmConfig.path = argv[++i];
+        }
+        else if (arg == "--pcm-format" && i + 1 < argc) {
+            if (!parsePcmFormat(argv[++i], pcmConfig.format)) std::cerr << "Unknown PCM format: " << argv[i] << "\n";
+        }
+        else if (arg == "--pcm-channels" && i + 1 < argc) pcmConfig.channels = atoi(argv[++i]);
+        else if (arg == "--pcm-fast") pcmConfig.realtime = false;
+        else if (arg == "--rt") realtime = true;
+        else if (arg == "--checkpoint" && i + 1 < argc) checkpointPath = argv[++i];
+        else if (arg == "--cache-mb" && i + 1 < argc) vgm.setCacheCapacity(size_t(atoi(argv[++i])) * 1024 * 1024);
+        else std::cerr << "Unknown option: " << arg << "\n";
+    }
+
+    // A render killed earlier continues from its checkpoint, the PCM file is cut back to it
+    std::unique_ptr<VgmCheckpoint> resume;
+    if (!checkpointPath.empty() && (!pcmOutput || pcmConfig.path == "-" || realtime)) {
+        std::cerr << "--checkpoint needs --pcm <file> and cannot be used with --rt\n";
+        checkpointPath.clear();
+    }
+    // A QOA file cannot be cut back at an arbitrary sample
+    if (!checkpointPath.empty() && pcmConfig.format == PcmFormat::QOA) {
+        std::cerr << "--checkpoint cannot be used with --pcm-format qoa\n";
+        checkpointPath.clear();
+    }
+    if (!checkpointPath.empty()) {
+        auto loaded = std::make_unique<VgmCheckpoint>();
+        if (vgmLoadCheckpoint(checkpointPath, *loaded)) {
+            pcmConfig.resumeAt = int64_t(loaded->outputBytes);
+            resume = std::move(loaded);
+        }
+    }
+
+    if (pcmOutput) {
+        // Audio goes to stdout, messages move to stderr
+        if (pcmConfig.path == "-") std::cout.rdbuf(std::cerr.rdbuf());
+        auto pcm = std::make_unique<PcmSink>();
+        if (!checkpointPath.empty()) vgm.setCheckpoint(checkpointPath, pcm.get());
+        if (!pcm->open(pcmConfig)) {
+            input.stop();
+#ifndef _WIN32
+            disable_raw_mode();
+#endif
+            return 1;
+        }
+        sink = std::move(pcm);
+    } else {
+        if (!initSdl()) {
+            std::cerr << "No audio device available, use --pcm <path> to write raw PCM instead\n";
+            input.stop();
+#ifndef _WIN32
+            disable_raw_mode();
+#endif
+            closeSdl();
+            return 1;
+        }
+        sink = std::make_unique<SdlSink>(stream);
+    }
+
+    if (realtime) {
+        // This thread renders, under SCHED_FIFO while a track plays; the output
+        // is served from a locked ring by a consumer thread at normal priority
+        sink = std::make_unique<RealtimeSink>(std::move(sink));
+        lockMemory(sink.get(), sizeof(RealtimeSink));
+        lockMemory(&apu, sizeof(apu));
+        lockMemory(&vgm, sizeof(vgm));
+        lockMemory(&stats, sizeof(stats));
+        prefaultStack();
+        vgm.setRealtime(true);
+    }
+    stats.start(statsInterval, statsFile);
     string media_folder = "../../../../";
 
-    vector<string> files;
-    // find .vgm files in the current directory
-    #ifdef _WIN32
-        WIN32_FIND_DATA findFileData;
-        HANDLE hFind = FindFirstFile((media_folder + "*.vgm").c_str(), &findFileData);
-        if (hFind != INVALID_HANDLE_VALUE) {
-            do {
-                if (!(findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-                    files.emplace_back(findFileData.cFileName);
+    // Gains measured by vgm_analyze
+    std::map<string, LoudnessEntry> loudness;
+    if (replayGain) loadLoudnessIndex(media_folder + LOUDNESS_INDEX_FILE, loudness);
+
+    Playlist playlist;
+    playlist.open(media_folder);
+    // Tracks added to, removed from or renamed in the folder while playing are
+    // applied to the playlist, the loudness gains and the track cache
+    vector<PlaylistChange> changes;
+    auto updatePlaylist = [&]() {
+        changes.clear();
+        playlist.update(changes);
+        for (const auto& change : changes) {
+            switch (change.type) {
+            case PlaylistChange::Type::ADDED:
+                std::cout << "Track added: " << change.name << "\n";
+                vgm.forget(media_folder + change.name);
+                break;
+            case PlaylistChange::Type::REMOVED:
+                std::cout << "Track removed: " << change.name << "\n";
+                vgm.forget(media_folder + change.name);
+                loudness.erase(change.name);
+                break;
+            case PlaylistChange::Type::RENAMED: {
+                std::cout << "Track renamed: " << change.oldName << " -> " << change.name << "\n";
+                vgm.forget(media_folder + change.oldName);
+                vgm.forget(media_folder + change.name);
+                auto entry = loudness.find(change.oldName);
+                if (entry != loudness.end()) {
+                    loudness[change.name] = entry->second;
+                    loudness.erase(change.oldName);
                 }
-            } while (FindNextFile(hFind, &findFileData) != 0);
-            FindClose(hFind);
-        }
-    #else
-        //DIR* dir = opendir(".");
-        DIR* dir = opendir(media_folder.c_str());
-        if (dir) {
-            struct dirent* entry;
-            while ((entry = readdir(dir)) != nullptr) {
-                if (entry->d_type == DT_REG && strstr(entry->d_name, ".vgm")) {
-                    files.emplace_back(entry->d_name);
+                break;
+            }
+            case PlaylistChange::Type::MODIFIED:
+                if (change.name == LOUDNESS_INDEX_FILE && replayGain) {
+                    std::cout << "Loudness index updated\n";
+                    loudness.clear();
+                    loadLoudnessIndex(media_folder + LOUDNESS_INDEX_FILE, loudness);
+                } else {
+                    vgm.forget(media_folder + change.name);
                 }
+                break;
             }
-            closedir(dir);
-        } else {
-            std::cerr << "Failed to open current directory.\n";
         }
-    #endif
+    };
 
-    auto it = files.begin();
-    while (it != files.end()) {
-        string file = media_folder + *it;
+    size_t index = 0;
+    if (resume) {
+        updatePlaylist();
+        const string& path = resume->track;
+        const string name = path.compare(0, media_folder.size(), media_folder) == 0 ? path.substr(media_folder.size()) : path;
+        if (playlist.contains(name)) {
+            std::cout << "Resuming the render of " << name << "\n";
+            index = playlist.position(name);
+            vgm.resumeFrom(std::move(resume));
+        } else {
+            std::cerr << "The checkpoint's track " << name << " is gone, the render continues with the next track\n";
+            index = playlist.position(name);
+        }
+    }
+    bool finished = false;
+    while (true) {
+        updatePlaylist();
+        if (index >= playlist.files().size()) {
+            finished = true;
+            break;
+        }
+        string name = playlist.files()[index];
+        string file = media_folder + name;
         std::cout << "Playing file: " << file << "\n";
+
+        auto status = VgmPlayer::Status::ST_ERROR;
         if (!vgm.load(file)) {
             std::cerr << "Failed to load VGM file: " << file << "\n";
-            continue;
+        } else {
+            auto gain = loudness.find(name);
+            setTrackGain(gain != loudness.end() ? gain->second.gainDb : 0.0);
+            status = vgm.play(apu);
         }
-        auto status = vgm.play(apu);
+
+        // The playlist may have changed while playing, navigate from where the track is (or was)
+        updatePlaylist();
+        const size_t count = playlist.files().size();
+        const size_t pos = playlist.position(name);
+        const bool present = playlist.contains(name);
         if (status == VgmPlayer::Status::QUIT) {
             break;
         }
-        else if (status == VgmPlayer::Status::ST_ERROR) {
-            std::cerr << "Error during playback of file: " << file << "\n";
-        }
         else if (status == VgmPlayer::Status::NEXT) {
             // Go to next file if possible
-            auto new_it = std::find(files.begin(), files.end(), *it);
-            if (new_it != files.end() && (new_it + 1) != files.end()) {
-                ++new_it;
-            }
-            it = new_it;
+            index = (present && pos + 1 < count) ? pos + 1 : pos;
         }
         else if (status == VgmPlayer::Status::PREV) {
             // Go back to previous file if possible
-            auto new_it = std::find(files.begin(), files.end(), *it);
-            if (new_it != files.begin() && new_it != files.end()) {
-                --new_it;
-            }
-            it = new_it;
+            index = pos > 0 ? pos - 1 : 0;
         }
-        else if (status == VgmPlayer::Status::FINISHED) {
-            it++;
+        else {
+            if (status == VgmPlayer::Status::ST_ERROR) std::cerr << "Error during playback of file: " << file << "\n";
+            index = present ? pos + 1 : pos;
         }
     }
 
+    input.stop();
+    stats.finish();
+    sink.reset();
+    // A complete render leaves no checkpoint behind
+    if (finished && !checkpointPath.empty()) std::remove(checkpointPath.c_str());
 #ifndef _WIN32
     disable_raw_mode();
 #endif
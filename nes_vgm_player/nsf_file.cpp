@@ -0,0 +1,69 @@
+/*
+ * nsf_file.cpp - NSF (NES Sound Format) file loading
+ */
+#include "nsf_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+bool NsfFile::load(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        std::cerr << "Failed to open NSF file: " << path << "\n";
+        return false;
+    }
+
+    f.seekg(0, std::ios::end);
+    size_t size = f.tellg();
+    f.seekg(0, std::ios::beg);
+
+    data.resize(size);
+    f.read(reinterpret_cast<char*>(data.data()), size);
+    if (!f) {
+        std::cerr << "Failed to read NSF file\n";
+        data.clear();
+        return false;
+    }
+
+    return validate();
+}
+
+bool NsfFile::loadFromMemory(std::vector<uint8_t> bytes) {
+    data = std::move(bytes);
+    return validate();
+}
+
+bool NsfFile::validate() {
+    if (data.size() <= NSF_HEADER_SIZE || memcmp(data.data(), "NESM\x1A", 5) != 0) {
+        std::cerr << "Invalid NSF header\n";
+        data.clear();
+        return false;
+    }
+    if (songCount() == 0 || loadAddress() < 0x6000 || initAddress() < 0x6000 || playAddress() < 0x6000) {
+        std::cerr << "Invalid NSF song table or addresses\n";
+        data.clear();
+        return false;
+    }
+    if (extraSoundChips() != 0) {
+        std::cerr << "NSF uses expansion sound chips, only the 2A03 channels will be played\n";
+    }
+    return true;
+}
+
+uint32_t NsfFile::playPeriodUs() const {
+    uint16_t period = read16(0x6E);
+    return period ? period : NSF_DEFAULT_PLAY_PERIOD_US;
+}
+
+bool NsfFile::isBankswitched() const {
+    for (int i = 0; i < 8; i++) {
+        if (data[0x70 + i] != 0) return true;
+    }
+    return false;
+}
+
+std::string NsfFile::text(size_t offset) const {
+    const char* s = reinterpret_cast<const char*>(&data[offset]);
+    return std::string(s, strnlen(s, 32));
+}
@@ -0,0 +1,45 @@
+/*
+ * nsf_file.h - NSF (NES Sound Format) file loading
+ */
+#ifndef NSF_FILE_H
+#define NSF_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+constexpr size_t NSF_HEADER_SIZE = 0x80;
+constexpr uint32_t NSF_DEFAULT_PLAY_PERIOD_US = 16639; // NTSC, ~60.1 Hz
+
+class NsfFile {
+public:
+    bool load(const std::string& path);
+    bool loadFromMemory(std::vector<uint8_t> bytes);
+
+    bool empty() const { return data.empty(); }
+    int songCount() const { return data[0x06]; }
+    int startingSong() const { return data[0x07]; }   // 1-based
+    uint16_t loadAddress() const { return read16(0x08); }
+    uint16_t initAddress() const { return read16(0x0A); }
+    uint16_t playAddress() const { return read16(0x0C); }
+    std::string title() const { return text(0x0E); }
+    std::string artist() const { return text(0x2E); }
+    std::string copyright() const { return text(0x4E); }
+    uint32_t playPeriodUs() const;
+    bool isBankswitched() const;
+    const uint8_t* initialBanks() const { return &data[0x70]; }
+    uint8_t extraSoundChips() const { return data[0x7B]; }
+
+    const uint8_t* program() const { return data.data() + NSF_HEADER_SIZE; }
+    size_t programSize() const { return data.size() - NSF_HEADER_SIZE; }
+
+private:
+    bool validate();
+    uint16_t read16(size_t offset) const { return data[offset] | (data[offset + 1] << 8); }
+    std::string text(size_t offset) const;
+
+    std::vector<uint8_t> data;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * nsf_render.cpp - NSF playback on the 6502 core
+ */
+#include "nsf_render.h"
+
+#include <iostream>
+
+constexpr uint64_t NTSC_CPU_CLOCK_HZ = 1789773;
+// Upper bound for INIT routines that never return
+constexpr uint64_t NSF_INIT_CYCLE_LIMIT = NTSC_CPU_CLOCK_HZ;
+
+bool NsfRenderer::start(const NsfFile& nsf, Apu2A03& apu, int song)
+{
+    if (nsf.empty() || song < 1 || song > nsf.songCount()) {
+        std::cerr << "Invalid NSF song number: " << song << "\n";
+        return false;
+    }
+
+    apu.connectBus(&bus);
+    apu.connectCPU(&cpu);
+    bus.connectAPU(&apu);
+    bus.connectCPU(&cpu);
+    cpu.connectBus(&bus);
+
+    bus.loadProgram(nsf.program(), nsf.programSize(), nsf.loadAddress(),
+        nsf.isBankswitched() ? nsf.initialBanks() : nullptr);
+    bus.clearRam();
+    bus.syncApu();
+
+    // Sound registers as defined by the NSF specification
+    for (uint16_t addr = 0x4000; addr <= 0x4013; addr++) bus.cpuWrite(addr, 0x00);
+    bus.cpuWrite(0x4015, 0x00);
+    bus.cpuWrite(0x4015, 0x0F);
+    bus.cpuWrite(0x4017, 0x40);
+
+    playAddress = nsf.playAddress();
+    playPeriodUs = nsf.playPeriodUs();
+    periodRemainder = 0;
+
+    cpu.stkp = 0xFD;
+    cpu.status = Cpu6502::U | Cpu6502::I;
+    cpu.a = static_cast<uint8_t>(song - 1);
+    cpu.x = 0; // NTSC
+    cpu.y = 0;
+    callRoutine(nsf.initAddress());
+    runUntilIdle(cpu.clock_count + NSF_INIT_CYCLE_LIMIT);
+    bus.syncApu();
+    frameStart = cpu.clock_count;
+    return true;
+}
+
+void NsfRenderer::renderFrame()
+{
+    periodRemainder += uint64_t(playPeriodUs) * NTSC_CPU_CLOCK_HZ;
+    uint64_t frameEnd = frameStart + periodRemainder / 1000000;
+    periodRemainder %= 1000000;
+
+    // A PLAY routine that overran its period just continues instead of being re-entered
+    if (cpu.pc == Bus::DRIVER_IDLE_ADDRESS) callRoutine(playAddress);
+    runUntilIdle(frameEnd);
+
+    // The driver spins in its idle loop for the rest of the period, skip it
+    if (cpu.pc == Bus::DRIVER_IDLE_ADDRESS && cpu.clock_count < frameEnd) cpu.clock_count = frameEnd;
+    bus.syncApu();
+    frameStart = frameEnd;
+}
+
+uint64_t NsfRenderer::framesFor(uint32_t seconds) const
+{
+    return uint64_t(seconds) * 1000000 / playPeriodUs;
+}
+
+void NsfRenderer::callRoutine(uint16_t address)
+{
+    bus.setDriverTarget(address);
+    cpu.pc = Bus::DRIVER_ADDRESS;
+}
+
+void NsfRenderer::runUntilIdle(uint64_t cycleLimit)
+{
+    while (cpu.pc != Bus::DRIVER_IDLE_ADDRESS && cpu.clock_count < cycleLimit) {
+        cpu.step();
+    }
+}
+
+bool nsfRender(const NsfFile& nsf, int song, uint32_t seconds, std::vector<uint8_t>& pcm)
+{
+    Apu2A03 apu;
+    apu.setOutputCallback([](void* userdata, const uint8_t* buf, int len) {
+        auto out = static_cast<std::vector<uint8_t>*>(userdata);
+        out->insert(out->end(), buf, buf + len);
+    }, &pcm);
+
+    pcm.clear();
+    NsfRenderer renderer;
+    if (!renderer.start(nsf, apu, song)) return false;
+    for (uint64_t frame = renderer.framesFor(seconds); frame > 0; frame--) {
+        renderer.renderFrame();
+    }
+    apu.flushAudioBuffer();
+    return true;
+}
@@ -0,0 +1,40 @@
+/*
+ * nsf_render.h - NSF playback: runs the sound driver on the 6502 core and
+ * clocks the APU in bulk between CPU events (APU register writes, frame ends)
+ */
+#ifndef NSF_RENDER_H
+#define NSF_RENDER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "apu2A03.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include "nsf_file.h"
+
+class NsfRenderer {
+public:
+    // Resets the machine, connects the APU and runs the INIT routine for song (1-based)
+    bool start(const NsfFile& nsf, Apu2A03& apu, int song);
+    // Calls PLAY once and clocks the APU up to the end of the play period
+    void renderFrame();
+    // Number of PLAY calls that fit into the given number of seconds
+    uint64_t framesFor(uint32_t seconds) const;
+
+private:
+    void callRoutine(uint16_t address);
+    void runUntilIdle(uint64_t cycleLimit);
+
+    Bus bus;
+    Cpu6502 cpu;
+    uint16_t playAddress = 0;
+    uint32_t playPeriodUs = NSF_DEFAULT_PLAY_PERIOD_US;
+    uint64_t frameStart = 0;      // CPU cycle the current play period started at
+    uint64_t periodRemainder = 0; // fractional CPU cycles, in units of 1/1000000
+};
+
+// Renders 'seconds' of song (1-based) into 8-bit mono PCM without any audio device
+bool nsfRender(const NsfFile& nsf, int song, uint32_t seconds, std::vector<uint8_t>& pcm);
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * pcm_sink.cpp - Raw PCM output to stdout, a named pipe or a file
+ */
+#include "pcm_sink.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+bool parsePcmFormat(const std::string& name, PcmFormat& format)
+{
+    if (name == "u8") format = PcmFormat::U8;
+    else if (name == "s16" || name == "s16le") format = PcmFormat::S16LE;
+    else if (name == "f32" || name == "f32le") format = PcmFormat::F32LE;
+    else if (name == "qoa") format = PcmFormat::QOA;
+    else return false;
+    return true;
+}
+
+int pcmSampleBytes(PcmFormat format)
+{
+    switch (format) {
+    case PcmFormat::U8: return 1;
+    case PcmFormat::S16LE: return 2;
+    case PcmFormat::F32LE: return 4;
+    case PcmFormat::QOA: return 2;  // encoded from 16-bit samples
+    }
+    return 1;
+}
+
+PcmSink::~PcmSink()
+{
+    close();
+}
+
+bool PcmSink::open(const PcmSinkConfig& cfg)
+{
+    close();
+    config = cfg;
+    config.channels = std::clamp(config.channels, 1, 8);
+    frameBytes = pcmSampleBytes(config.format) * config.channels;
+
+    if (config.path == "-") {
+        fd = 1;
+        ownsFd = false;
+#ifdef _WIN32
+        _setmode(fd, _O_BINARY);
+#endif
+    } else {
+        const bool resume = config.resumeAt >= 0;
+#ifdef _WIN32
+        fd = _open(config.path.c_str(), _O_WRONLY | _O_CREAT | (resume ? 0 : _O_TRUNC) | _O_BINARY, 0644);
+#else
+        fd = ::open(config.path.c_str(), O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+#endif
+        if (fd < 0) {
+            std::cerr << "Failed to open PCM output " << config.path << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        ownsFd = true;
+        if (resume && !resumeFile()) return false;
+    }
+#ifndef _WIN32
+    // A consumer that goes away shows up as a failed write instead of killing the player
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    for (auto& chunk : chunks) chunk.reserve(size_t(CHUNK_SAMPLES) * frameBytes);
+    chunkCount = 0;
+    pendingSamples = 0;
+    writtenBytes = std::max<int64_t>(config.resumeAt, 0);
+    failed = false;
+    paused = false;
+    restartClock();
+
+    qoa.reset();
+    if (config.format == PcmFormat::QOA) {
+        qoa = std::make_unique<QoaEncoder>(config.channels, AUDIO_SAMPLE_RATE);
+        qoaFrame.reserve(size_t(QOA_FRAME_SAMPLES) * config.channels);
+        qoaFrame.clear();
+        qoaSamples = 0;
+        // Written right away, so clear() cannot drop it
+        chunks[0].resize(QOA_HEADER_BYTES);
+        QoaEncoder::writeHeader(0, chunks[0].data());
+        chunkCount = 1;
+        if (!flush()) return false;
+    }
+    return true;
+}
+
+bool PcmSink::resumeFile()
+{
+    // Output written after the resume point is dropped, a shorter file cannot be continued
+#ifdef _WIN32
+    const int64_t size = _lseeki64(fd, 0, SEEK_END);
+    bool ok = size >= config.resumeAt && _chsize_s(fd, config.resumeAt) == 0 &&
+              _lseeki64(fd, config.resumeAt, SEEK_SET) == config.resumeAt;
+#else
+    const int64_t size = lseek(fd, 0, SEEK_END);
+    bool ok = size >= config.resumeAt && ftruncate(fd, config.resumeAt) == 0 &&
+              lseek(fd, config.resumeAt, SEEK_SET) == config.resumeAt;
+#endif
+    if (!ok) {
+        std::cerr << "Cannot resume PCM output " << config.path << " at byte " << config.resumeAt
+                  << " (the file has " << size << ")\n";
+        close();
+    }
+    return ok;
+}
+
+void PcmSink::close()
+{
+    if (fd < 0) return;
+    if (qoa && !failed) encodeQoaFrame();
+    flush();
+    if (qoa && !failed) finishQoa();
+#ifdef _WIN32
+    if (ownsFd) _close(fd);
+#else
+    if (ownsFd) ::close(fd);
+#endif
+    fd = -1;
+}
+
+void PcmSink::convert(const uint8_t* samples, int count, uint8_t* out) const
+{
+    const int channels = config.channels;
+    for (int i = 0; i < count; i++) {
+        int centered = int(samples[i]) - 128;
+        for (int c = 0; c < channels; c++) {
+            switch (config.format) {
+            case PcmFormat::U8:
+                *out++ = samples[i];
+                break;
+            case PcmFormat::S16LE: {
+                uint16_t v = uint16_t(centered * 256);
+                *out++ = uint8_t(v);
+                *out++ = uint8_t(v >> 8);
+                break;
+            }
+            case PcmFormat::F32LE: {
+                uint32_t v = std::bit_cast<uint32_t>(centered / 128.0f);
+                for (int b = 0; b < 4; b++) *out++ = uint8_t(v >> (8 * b));
+                break;
+            }
+            case PcmFormat::QOA:
+                break;
+            }
+        }
+    }
+}
+
+void PcmSink::write(const uint8_t* samples, int count)
+{
+    if (fd < 0 || failed) return;
+    if (qoa) {
+        writeQoa(samples, count);
+        return;
+    }
+    while (count > 0) {
+        if (chunkCount == MAX_CHUNKS) flush();
+        int n = std::min(count, CHUNK_SAMPLES);
+        auto& chunk = chunks[chunkCount++];
+        chunk.resize(size_t(n) * frameBytes);
+        convert(samples, n, chunk.data());
+        pendingSamples += n;
+        samples += n;
+        count -= n;
+    }
+}
+
+void PcmSink::writeQoa(const uint8_t* samples, int count)
+{
+    const int channels = config.channels;
+    const size_t frameSize = size_t(QOA_FRAME_SAMPLES) * channels;
+    for (int i = 0; i < count; i++) {
+        const int16_t v = int16_t((int(samples[i]) - 128) * 256);
+        for (int c = 0; c < channels; c++) qoaFrame.push_back(v);
+        if (qoaFrame.size() == frameSize) encodeQoaFrame();
+    }
+    pendingSamples += count;
+}
+
+void PcmSink::encodeQoaFrame()
+{
+    const int samples = int(qoaFrame.size() / config.channels);
+    if (samples == 0) return;
+    if (chunkCount == MAX_CHUNKS) flush();
+    auto& chunk = chunks[chunkCount++];
+    chunk.resize(QoaEncoder::frameBytes(config.channels, samples));
+    qoa->encodeFrame(qoaFrame.data(), samples, chunk.data());
+    qoaFrame.clear();
+    qoaSamples += samples;
+}
+
+void PcmSink::finishQoa()
+{
+    // Pipes and renders too long for the header stay streams
+    if (!ownsFd || qoaSamples == 0 || qoaSamples > UINT32_MAX) return;
+    uint8_t header[QOA_HEADER_BYTES];
+    QoaEncoder::writeHeader(uint32_t(qoaSamples), header);
+#ifdef _WIN32
+    bool ok = _lseeki64(fd, 0, SEEK_SET) == 0 && _write(fd, header, unsigned(sizeof(header))) == int(sizeof(header));
+#else
+    bool ok = pwrite(fd, header, sizeof(header), 0) == ssize_t(sizeof(header));
+    if (!ok && errno == ESPIPE) return;
+#endif
+    if (!ok) std::cerr << "Failed to write the QOA header of " << config.path << ": " << strerror(errno) << "\n";
+}
+
+bool PcmSink::flush()
+{
+    if (fd < 0 || failed) return !failed;
+    if (chunkCount == 0) return true;
+
+#ifdef _WIN32
+    for (int i = 0; i < chunkCount && !failed; i++) {
+        const uint8_t* data = chunks[i].data();
+        size_t left = chunks[i].size();
+        while (left > 0) {
+            int n = _write(fd, data, unsigned(left));
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+            data += n;
+            left -= n;
+        }
+    }
+#else
+    iovec iov[MAX_CHUNKS];
+    for (int i = 0; i < chunkCount; i++) iov[i] = { chunks[i].data(), chunks[i].size() };
+
+    // Pipes may take part of the data, continue after the last byte written
+    iovec* next = iov;
+    int left = chunkCount;
+    while (left > 0) {
+        ssize_t n = writev(fd, next, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        while (left > 0 && size_t(n) >= next->iov_len) {
+            n -= next->iov_len;
+            next++;
+            left--;
+        }
+        if (left > 0) {
+            next->iov_base = static_cast<uint8_t*>(next->iov_base) + n;
+            next->iov_len -= n;
+        }
+    }
+#endif
+    if (failed) std::cerr << "Failed to write PCM output " << config.path << ": " << strerror(errno) << "\n";
+
+    if (!failed) {
+        for (int i = 0; i < chunkCount; i++) writtenBytes += chunks[i].size();
+    }
+    sentSamples += pendingSamples;
+    pendingSamples = 0;
+    chunkCount = 0;
+    return !failed;
+}
+
+int64_t PcmSink::playedSamples() const
+{
+    auto now = paused ? pauseStart : Clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - clockStart).count();
+    return elapsed * AUDIO_SAMPLE_RATE / 1000000;
+}
+
+void PcmSink::restartClock()
+{
+    clockStart = Clock::now();
+    pauseStart = clockStart;
+    sentSamples = 0;
+}
+
+int PcmSink::queued()
+{
+    if (!config.realtime) return pendingSamples;
+
+    int64_t ahead = sentSamples - playedSamples();
+    // Fell behind the clock (slow consumer or slow rendering): pace from now on
+    // instead of catching up with a burst
+    if (ahead < 0) {
+        restartClock();
+        ahead = 0;
+    }
+    return pendingSamples + int(ahead);
+}
+
+void PcmSink::clear()
+{
+    // Dropped QOA frames do not count, bytes 4 and 5 of a frame hold its sample count
+    if (qoa) {
+        for (int i = 0; i < chunkCount; i++) qoaSamples -= chunks[i][4] << 8 | chunks[i][5];
+    }
+    qoaFrame.clear();
+    chunkCount = 0;
+    pendingSamples = 0;
+    restartClock();
+}
+
+void PcmSink::setPaused(bool pause)
+{
+    if (pause == paused) return;
+    paused = pause;
+    if (paused) pauseStart = Clock::now();
+    else clockStart += Clock::now() - pauseStart;
+}
+
+void PcmSink::idle()
+{
+    // Fast pacing is throttled by the blocking writes, only a paused player needs to wait
+    if (config.realtime || paused) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
@@ -0,0 +1,103 @@
+/*
+ * pcm_sink.h - Raw PCM output to stdout, a named pipe or a file
+ *
+ * For machines without an audio device: the audio is converted to the
+ * requested sample format and written without any header, for example into
+ *   nes_vgm_player --pcm - --pcm-format s16 | ffmpeg -f s16le -ar 44100 -ac 1 -i - out.ogg
+ * The "qoa" format writes a QOA file instead (see qoa_encoder.h), encoded
+ * one frame at a time as the samples come in. The sample count in its header
+ * is filled in when a file is closed, a pipe gets a stream header.
+ * Converted samples are kept in chunks of one APU buffer each and all chunks
+ * go out in a single vectored write per refill. In real time pacing the
+ * queue level is derived from a clock, like an audio device consuming the
+ * samples; in fast pacing the output is as fast as the consumer reads.
+ */
+#ifndef PCM_SINK_H
+#define PCM_SINK_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_sink.h"
+#include "qoa_encoder.h"
+
+enum class PcmFormat { U8, S16LE, F32LE, QOA };
+
+// "u8", "s16" (or "s16le"), "f32" (or "f32le"), "qoa"
+bool parsePcmFormat(const std::string& name, PcmFormat& format);
+int pcmSampleBytes(PcmFormat format);
+
+struct PcmSinkConfig
+{
+    std::string path = "-";         // "-" for stdout
+    PcmFormat format = PcmFormat::S16LE;
+    int channels = 1;               // the mono APU output is duplicated into every channel
+    bool realtime = true;
+    // File output: bytes of an existing file to keep, the output continues
+    // after them (resuming a render). -1 starts a new file.
+    int64_t resumeAt = -1;
+};
+
+class PcmSink : public AudioSink {
+public:
+    ~PcmSink() override;
+
+    // Opens the output; a named pipe blocks until a reader opens it
+    bool open(const PcmSinkConfig& config);
+    void close();
+
+    void write(const uint8_t* samples, int count) override;
+    int queued() override;
+    bool flush() override;
+    void clear() override;
+    void setPaused(bool paused) override;
+    void idle() override;
+
+    // Size of the output up to the last flush, including the bytes kept by resumeAt
+    uint64_t bytesWritten() const { return writtenBytes; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Converted chunks waiting for the next flush
+    static constexpr int MAX_CHUNKS = 32;
+    static constexpr int CHUNK_SAMPLES = 2048;
+
+    // Cuts an existing output file to config.resumeAt and positions behind it
+    bool resumeFile();
+    void convert(const uint8_t* samples, int count, uint8_t* out) const;
+    // QOA: collects samples into qoaFrame and encodes it into a chunk once full
+    void writeQoa(const uint8_t* samples, int count);
+    void encodeQoaFrame();
+    // Fills in the sample count of the header of a QOA file
+    void finishQoa();
+    // Samples the consumer should have played by now (real time pacing)
+    int64_t playedSamples() const;
+    void restartClock();
+
+    PcmSinkConfig config;
+    int fd = -1;
+    bool ownsFd = false;
+    bool failed = false;
+    int frameBytes = 0;
+
+    std::vector<uint8_t> chunks[MAX_CHUNKS];
+    int chunkCount = 0;
+    int pendingSamples = 0;
+    uint64_t writtenBytes = 0;
+
+    std::unique_ptr<QoaEncoder> qoa;
+    std::vector<int16_t> qoaFrame;  // interleaved 16-bit samples of the next frame
+    uint64_t qoaSamples = 0;        // samples per channel encoded so far
+
+    // Real time pacing: samples sent since clockStart, minus the time spent paused
+    Clock::time_point clockStart;
+    Clock::time_point pauseStart;
+    int64_t sentSamples = 0;
+    bool paused = false;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * playback_stats.cpp - Low overhead playback telemetry
+ */
+#include "playback_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+static const char* COMMAND_NAMES[4] = { "apu_writes", "waits", "data_blocks", "ends" };
+
+bool PlaybackStats::start(double intervalSeconds, const std::string& exportPath)
+{
+    printLines = intervalSeconds > 0;
+    interval = printLines ? intervalSeconds : 1.0;
+    path = exportPath;
+    csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    json = !csv && !path.empty();
+    active = printLines || !path.empty();
+    if (!active) return true;
+
+    if (csv) {
+        csvFile.open(path);
+        if (!csvFile) {
+            std::cerr << "Failed to open stats file: " << path << "\n";
+            active = false;
+            return false;
+        }
+        csvFile << "time_s,apu_cycles,samples";
+        for (const char* name : COMMAND_NAMES) csvFile << "," << name;
+        csvFile << ",blocks,block_avg_us,block_max_us,queue_min,queue_max,underruns\n";
+    }
+
+    startTime = intervalStart = Clock::now();
+    writerRunning = true;
+    writer = std::thread(&PlaybackStats::writerLoop, this);
+    return true;
+}
+
+void PlaybackStats::finish()
+{
+    if (!active) return;
+    writerRunning = false;
+    writer.join();
+    // The queue is empty now, the last interval is written on this thread
+    closeInterval(Clock::now());
+    drainSnapshots();
+    if (json && !writeJson()) std::cerr << "Failed to write stats file: " << path << "\n";
+    csvFile.close();
+    active = false;
+}
+
+void PlaybackStats::apuCycles(uint64_t cycleCount)
+{
+    if (cycleCountValid) current.apuCycles += cycleCount - lastCycleCount;
+    lastCycleCount = cycleCount;
+    cycleCountValid = true;
+}
+
+void PlaybackStats::endBlock(Clock::time_point begin)
+{
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+    current.blocks++;
+    current.blockTotalUs += us;
+    current.blockMaxUs = std::max(current.blockMaxUs, us);
+}
+
+void PlaybackStats::queueLevel(int queued)
+{
+    if (current.queueMin < 0 || queued < current.queueMin) current.queueMin = queued;
+    if (queued > current.queueMax) current.queueMax = queued;
+    if (queued == 0 && queueWasFed) current.underruns++;
+    queueWasFed = queued > 0;
+}
+
+void PlaybackStats::tick()
+{
+    if (!active) return;
+    auto now = Clock::now();
+    if (std::chrono::duration<double>(now - intervalStart).count() >= interval) closeInterval(now);
+}
+
+void PlaybackStats::closeInterval(Clock::time_point now)
+{
+    current.length = std::chrono::duration<double>(now - intervalStart).count();
+    current.time = std::chrono::duration<double>(now - startTime).count();
+    if (!closed.push(current)) return;
+    current = Snapshot{};
+    intervalStart = now;
+}
+
+void PlaybackStats::writerLoop()
+{
+    while (writerRunning) {
+        drainSnapshots();
+        std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_PERIOD_MS));
+    }
+    drainSnapshots();
+}
+
+void PlaybackStats::drainSnapshots()
+{
+    Snapshot s;
+    while (closed.pop(s)) {
+        if (printLines) printLine(s);
+        if (csv) writeCsvRow(s);
+        accumulate(total, s);
+        if (json) history.push_back(s);
+    }
+}
+
+void PlaybackStats::printLine(const Snapshot& s) const
+{
+    const double seconds = s.length;
+    double audio = s.samples / 44100.0;
+    fprintf(stderr, "[stats] t=%.1fs cycles=%llu samples=%llu (%.2fx) writes=%llu waits=%llu blocks=%llu "
+        "avg=%lluus max=%lluus queue=%d..%d underruns=%llu\n",
+        s.time, (unsigned long long)s.apuCycles, (unsigned long long)s.samples, seconds > 0 ? audio / seconds : 0.0,
+        (unsigned long long)s.commands[0], (unsigned long long)s.commands[1], (unsigned long long)s.blocks,
+        (unsigned long long)(s.blocks ? s.blockTotalUs / s.blocks : 0), (unsigned long long)s.blockMaxUs,
+        s.queueMin, s.queueMax, (unsigned long long)s.underruns);
+}
+
+void PlaybackStats::writeCsvRow(const Snapshot& s)
+{
+    csvFile << s.time << "," << s.apuCycles << "," << s.samples;
+    for (uint64_t count : s.commands) csvFile << "," << count;
+    csvFile << "," << s.blocks << "," << (s.blocks ? s.blockTotalUs / s.blocks : 0) << "," << s.blockMaxUs
+            << "," << s.queueMin << "," << s.queueMax << "," << s.underruns << "\n";
+    // Flushed per row so the file is usable even if the player gets killed
+    csvFile.flush();
+}
+
+void PlaybackStats::accumulate(Snapshot& total, const Snapshot& s)
+{
+    total.time = s.time;
+    total.apuCycles += s.apuCycles;
+    total.samples += s.samples;
+    for (int i = 0; i < 4; i++) total.commands[i] += s.commands[i];
+    total.blocks += s.blocks;
+    total.blockTotalUs += s.blockTotalUs;
+    total.blockMaxUs = std::max(total.blockMaxUs, s.blockMaxUs);
+    if (s.queueMin >= 0 && (total.queueMin < 0 || s.queueMin < total.queueMin)) total.queueMin = s.queueMin;
+    total.queueMax = std::max(total.queueMax, s.queueMax);
+    total.underruns += s.underruns;
+}
+
+static void writeJsonSnapshot(std::ostream& f, const PlaybackStats::Snapshot& s)
+{
+    f << "{\"time_s\": " << s.time << ", \"apu_cycles\": " << s.apuCycles << ", \"samples\": " << s.samples;
+    for (int i = 0; i < 4; i++) f << ", \"" << COMMAND_NAMES[i] << "\": " << s.commands[i];
+    f << ", \"blocks\": " << s.blocks << ", \"block_avg_us\": " << (s.blocks ? s.blockTotalUs / s.blocks : 0)
+      << ", \"block_max_us\": " << s.blockMaxUs << ", \"queue_min\": " << s.queueMin
+      << ", \"queue_max\": " << s.queueMax << ", \"underruns\": " << s.underruns << "}";
+}
+
+bool PlaybackStats::writeJson()
+{
+    std::ofstream f(path);
+    f << "{\n  \"interval_s\": " << interval << ",\n  \"total\": ";
+    writeJsonSnapshot(f, total);
+    f << ",\n  \"intervals\": [";
+    for (size_t i = 0; i < history.size(); i++) {
+        f << (i ? ",\n    " : "\n    ");
+        writeJsonSnapshot(f, history[i]);
+    }
+    f << "\n  ]\n}\n";
+    return static_cast<bool>(f);
+}
@@ -0,0 +1,108 @@
+/*
+ * playback_stats.h - Low overhead playback telemetry
+ *
+ * Counts commands, APU cycles and samples, times every block of emulation
+ * that refills the audio queue and tracks the queue level (watermarks and
+ * underruns). Counters are plain integers updated from the playback thread.
+ * Once per interval the counters are closed into a snapshot and handed to a
+ * writer thread through a lock-free queue, so the playback thread neither
+ * allocates nor does I/O for the stats. The writer prints the stats line
+ * and/or appends a CSV row and adds the snapshot to the running totals. Only
+ * a JSON export keeps the snapshots, it is written with all of them and the
+ * totals when the player exits.
+ */
+#ifndef PLAYBACK_STATS_H
+#define PLAYBACK_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_queue.h"
+#include "vgm_file.h"
+
+class PlaybackStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Snapshot
+    {
+        double time = 0.0;            // seconds since start() at the end of the interval
+        double length = 0.0;          // seconds the interval lasted
+        uint64_t apuCycles = 0;
+        uint64_t samples = 0;
+        uint64_t commands[4] = {};    // indexed by VgmCommand::Type
+        uint64_t blocks = 0;
+        uint64_t blockTotalUs = 0;
+        uint64_t blockMaxUs = 0;
+        int queueMin = -1;            // bytes queued in the audio stream, -1 if never sampled
+        int queueMax = -1;
+        uint64_t underruns = 0;
+    };
+
+    // intervalSeconds 0 disables the stats lines (snapshots for the export are
+    // then taken every second). exportPath ending in .csv gets one row per
+    // interval, any other path a JSON document on finish().
+    bool start(double intervalSeconds, const std::string& exportPath);
+    void finish();
+    bool enabled() const { return active; }
+
+    void countCommand(VgmCommand::Type type) { current.commands[static_cast<int>(type)]++; }
+    void countSamples(int count) { current.samples += count; }
+    // Feed the APU's cycle_count, the difference to the last call is counted
+    void apuCycles(uint64_t cycleCount);
+
+    Clock::time_point beginBlock() const { return Clock::now(); }
+    void endBlock(Clock::time_point begin);
+
+    // Audio queue level in bytes. Running dry after audio was queued counts as an underrun.
+    void queueLevel(int queued);
+
+    // Closes the interval once it has elapsed
+    void tick();
+
+private:
+    // Snapshots queued while the writer is behind; a full queue keeps the
+    // counters running into the next interval
+    static constexpr size_t QUEUE_SNAPSHOTS = 64;
+    static constexpr int WRITER_PERIOD_MS = 20;
+
+    void closeInterval(Clock::time_point now);
+    void writerLoop();
+    // Writer thread: outputs the queued snapshots and adds them to the totals
+    void drainSnapshots();
+    void printLine(const Snapshot& s) const;
+    void writeCsvRow(const Snapshot& s);
+    bool writeJson();
+    static void accumulate(Snapshot& total, const Snapshot& s);
+
+    bool active = false;
+    bool printLines = false;
+    double interval = 1.0;
+    std::string path;
+    bool csv = false;
+    bool json = false;
+    std::ofstream csvFile;
+
+    Clock::time_point startTime;
+    Clock::time_point intervalStart;
+    uint64_t lastCycleCount = 0;
+    bool cycleCountValid = false;
+    bool queueWasFed = false;
+
+    Snapshot current;
+    SpscQueue<Snapshot, QUEUE_SNAPSHOTS> closed;
+    std::thread writer;
+    std::atomic<bool> writerRunning{false};
+
+    // Owned by the writer thread (and by finish() once it has stopped), like csvFile
+    Snapshot total;
+    // JSON export only, every other output is written as the intervals close
+    std::vector<Snapshot> history;
+};
+
+#endif
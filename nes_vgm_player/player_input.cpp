@@ -0,0 +1,105 @@
+/*
+ * player_input.cpp - Keyboard input thread of the player
+ */
+#include "player_input.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <conio.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+constexpr int KEY_ESC = 27;
+// Poll timeout, bounds how long stop() waits for the thread
+constexpr int POLL_MS = 50;
+// Time the rest of an escape sequence may take to arrive
+constexpr int SEQUENCE_MS = 10;
+
+void PlayerInput::start()
+{
+    if (running.exchange(true)) return;
+    thread = std::thread(&PlayerInput::run, this);
+}
+
+void PlayerInput::stop()
+{
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void PlayerInput::post(PlayerCommand::Type type, int seekSeconds)
+{
+    // A full queue means the player is not taking commands, the key is dropped
+    queue.push({ type, seekSeconds });
+}
+
+#ifdef _WIN32
+int PlayerInput::readKey(int timeoutMs)
+{
+    for (int waited = 0; !_kbhit(); waited += 10) {
+        if (waited >= timeoutMs || !running) return -1;
+        Sleep(10);
+    }
+    return _getch();
+}
+#else
+int PlayerInput::readKey(int timeoutMs)
+{
+    pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) <= 0) return -1;
+    unsigned char ch;
+    ssize_t n = read(STDIN_FILENO, &ch, 1);
+    // No terminal to read from (e.g. stdin is /dev/null on a server)
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) running = false;
+    return n == 1 ? ch : -1;
+}
+#endif
+
+void PlayerInput::run()
+{
+    while (running) {
+        int ch = readKey(POLL_MS);
+        if (ch == -1) continue;
+
+        int seek = 0;
+#ifdef _WIN32
+        // Arrow keys arrive as a 0 or 224 prefix and a scan code
+        if (ch == 0 || ch == 224) {
+            int code = readKey(SEQUENCE_MS);
+            if (code == 77) seek = SEEK_STEP_SECONDS;
+            else if (code == 75) seek = -SEEK_STEP_SECONDS;
+            else continue;
+        }
+#else
+        // Arrow keys arrive as ESC [ C / ESC [ D, a lone ESC is the key itself
+        if (ch == KEY_ESC) {
+            int next = readKey(SEQUENCE_MS);
+            if (next == '[') {
+                int code = readKey(SEQUENCE_MS);
+                if (code == 'C') seek = SEEK_STEP_SECONDS;
+                else if (code == 'D') seek = -SEEK_STEP_SECONDS;
+                else continue;
+            }
+        }
+#endif
+        if (seek != 0) {
+            post(PlayerCommand::Type::SEEK, seek);
+        } else if (ch == KEY_ESC || ch == 'q' || ch == 'Q') {
+            post(PlayerCommand::Type::QUIT);
+        } else if (ch == 'n' || ch == 'N') {
+            post(PlayerCommand::Type::NEXT);
+        } else if (ch == 'p' || ch == 'P') {
+            post(PlayerCommand::Type::PREV);
+        } else if (ch == ' ') {
+            post(PlayerCommand::Type::PAUSE);
+        } else if (ch == '.') {
+            post(PlayerCommand::Type::SEEK, SEEK_STEP_SECONDS);
+        } else if (ch == ',') {
+            post(PlayerCommand::Type::SEEK, -SEEK_STEP_SECONDS);
+        }
+    }
+}
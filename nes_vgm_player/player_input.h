@@ -0,0 +1,50 @@
+/*
+ * player_input.h - Keyboard input thread of the player
+ *
+ * Reads the terminal on its own thread and posts player commands through a
+ * lock-free queue, so the render loop never waits for or polls the keyboard.
+ *   n / p        next / previous track (or NSF song)
+ *   q / ESC      quit
+ *   space        pause / resume
+ *   right / .    seek forward, left / , seek back
+ */
+#ifndef PLAYER_INPUT_H
+#define PLAYER_INPUT_H
+
+#include <atomic>
+#include <thread>
+
+#include "spsc_queue.h"
+
+struct PlayerCommand
+{
+    enum class Type { NEXT, PREV, QUIT, SEEK, PAUSE };
+
+    Type type = Type::QUIT;
+    int seekSeconds = 0;    // SEEK: relative position change
+};
+
+using PlayerCommandQueue = SpscQueue<PlayerCommand, 64>;
+
+class PlayerInput {
+public:
+    static constexpr int SEEK_STEP_SECONDS = 5;
+
+    explicit PlayerInput(PlayerCommandQueue& queue) : queue(queue) {}
+    ~PlayerInput() { stop(); }
+
+    void start();
+    void stop();
+
+private:
+    void run();
+    // Returns the next key, -1 if none arrived within timeoutMs
+    int readKey(int timeoutMs);
+    void post(PlayerCommand::Type type, int seekSeconds = 0);
+
+    PlayerCommandQueue& queue;
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * playlist.cpp - The .vgm and .nsf files of the media folder
+ */
+#include "playlist.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+Playlist::~Playlist()
+{
+#ifndef _WIN32
+    if (watchFd >= 0) close(watchFd);
+#endif
+}
+
+bool Playlist::isTrack(const std::string& name)
+{
+    if (name.size() < 4) return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".vgm" || ext == ".nsf";
+}
+
+std::vector<std::string> Playlist::scan() const
+{
+    std::vector<std::string> found;
+#ifdef _WIN32
+    for (const char* pattern : { "*.vgm", "*.nsf" }) {
+        WIN32_FIND_DATA findFileData;
+        HANDLE hFind = FindFirstFile((folder + pattern).c_str(), &findFileData);
+        if (hFind != INVALID_HANDLE_VALUE) {
+            do {
+                if (!(findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                    found.emplace_back(findFileData.cFileName);
+                }
+            } while (FindNextFile(hFind, &findFileData) != 0);
+            FindClose(hFind);
+        }
+    }
+#else
+    DIR* dir = opendir(folder.c_str());
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_type == DT_REG && isTrack(entry->d_name)) found.emplace_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+bool Playlist::open(const std::string& path)
+{
+    folder = path;
+#ifndef _WIN32
+    if (watchFd >= 0) close(watchFd);
+    // Watch before scanning so that nothing written in between is missed
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd >= 0 && inotify_add_watch(watchFd, folder.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        std::cerr << "Cannot watch " << folder << ", new tracks need a restart\n";
+        close(watchFd);
+        watchFd = -1;
+    }
+
+    DIR* dir = opendir(folder.c_str());
+    if (!dir) {
+        std::cerr << "Failed to open media folder: " << folder << "\n";
+        return false;
+    }
+    closedir(dir);
+#endif
+    names = scan();
+    return true;
+}
+
+size_t Playlist::position(const std::string& name) const
+{
+    return std::lower_bound(names.begin(), names.end(), name) - names.begin();
+}
+
+bool Playlist::contains(const std::string& name) const
+{
+    return std::binary_search(names.begin(), names.end(), name);
+}
+
+void Playlist::add(const std::string& name)
+{
+    auto it = std::lower_bound(names.begin(), names.end(), name);
+    if (it == names.end() || *it != name) names.insert(it, name);
+}
+
+void Playlist::remove(const std::string& name)
+{
+    auto it = std::lower_bound(names.begin(), names.end(), name);
+    if (it != names.end() && *it == name) names.erase(it);
+}
+
+// After an event queue overflow the list is compared against a fresh scan
+void Playlist::rescan(std::vector<PlaylistChange>& changes)
+{
+    std::vector<std::string> found = scan();
+    for (const auto& name : names) {
+        if (!std::binary_search(found.begin(), found.end(), name)) {
+            changes.push_back({ PlaylistChange::Type::REMOVED, name, {} });
+        }
+    }
+    for (const auto& name : found) {
+        if (!std::binary_search(names.begin(), names.end(), name)) {
+            changes.push_back({ PlaylistChange::Type::ADDED, name, {} });
+        }
+    }
+    names = std::move(found);
+}
+
+#ifdef _WIN32
+void Playlist::update(std::vector<PlaylistChange>&)
+{
+}
+#else
+void Playlist::update(std::vector<PlaylistChange>& changes)
+{
+    if (watchFd < 0) return;
+
+    // The first half of a rename, completed by an IN_MOVED_TO with the same cookie
+    uint32_t moveCookie = 0;
+    std::string movedFrom;
+    auto flushMove = [&]() {
+        if (movedFrom.empty()) return;
+        if (isTrack(movedFrom)) {
+            remove(movedFrom);
+            changes.push_back({ PlaylistChange::Type::REMOVED, movedFrom, {} });
+        }
+        movedFrom.clear();
+    };
+
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t len = read(watchFd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+
+        for (char* p = buffer; p < buffer + len;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            std::string name = event->len ? event->name : "";
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                flushMove();
+                rescan(changes);
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                std::cerr << "Media folder " << folder << " went away, the playlist is no longer updated\n";
+                close(watchFd);
+                watchFd = -1;
+                return;
+            } else if (event->mask & IN_ISDIR) {
+                continue;
+            } else if (event->mask & IN_MOVED_FROM) {
+                flushMove();
+                movedFrom = name;
+                moveCookie = event->cookie;
+            } else if (event->mask & IN_MOVED_TO) {
+                const bool renamed = !movedFrom.empty() && event->cookie == moveCookie;
+                const bool wasTrack = renamed && isTrack(movedFrom);
+                std::string oldName = renamed ? movedFrom : "";
+                if (renamed) movedFrom.clear();
+                flushMove();
+
+                if (wasTrack) remove(oldName);
+                if (isTrack(name)) {
+                    add(name);
+                    if (wasTrack) changes.push_back({ PlaylistChange::Type::RENAMED, name, oldName });
+                    else changes.push_back({ PlaylistChange::Type::ADDED, name, {} });
+                } else if (wasTrack) {
+                    changes.push_back({ PlaylistChange::Type::REMOVED, oldName, {} });
+                } else {
+                    changes.push_back({ PlaylistChange::Type::MODIFIED, name, {} });
+                }
+            } else if (event->mask & IN_DELETE) {
+                flushMove();
+                if (isTrack(name) && contains(name)) {
+                    remove(name);
+                    changes.push_back({ PlaylistChange::Type::REMOVED, name, {} });
+                }
+            } else if (event->mask & IN_CLOSE_WRITE) {
+                flushMove();
+                if (isTrack(name) && !contains(name)) {
+                    add(name);
+                    changes.push_back({ PlaylistChange::Type::ADDED, name, {} });
+                } else {
+                    changes.push_back({ PlaylistChange::Type::MODIFIED, name, {} });
+                }
+            }
+        }
+    }
+    // No IN_MOVED_TO followed: the file has been moved out of the folder
+    flushMove();
+}
+#endif
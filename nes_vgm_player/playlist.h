@@ -0,0 +1,61 @@
+/*
+ * playlist.h - The .vgm and .nsf files of the media folder
+ *
+ * The folder is scanned once, after that it is watched with inotify (Linux)
+ * and the list is updated incrementally from the reported changes: files
+ * that have been written or moved into the folder are added, deleted or
+ * moved out files are removed and renames within the folder keep their
+ * place in the reported changes so that metadata can follow them. Other
+ * platforms only get the initial scan.
+ */
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PlaylistChange
+{
+    enum class Type { ADDED, REMOVED, RENAMED, MODIFIED };
+
+    Type type = Type::ADDED;
+    std::string name;       // file name inside the folder (the new name for RENAMED)
+    std::string oldName;    // RENAMED only
+};
+
+class Playlist {
+public:
+    Playlist() = default;
+    ~Playlist();
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+
+    // Scans the folder and starts watching it. Returns false if it cannot be read.
+    bool open(const std::string& folder);
+    // Applies the changes made to the folder since the last call (without
+    // blocking) and appends them to 'changes'. Also reports modified files
+    // that are not tracks, e.g. index files kept in the folder.
+    void update(std::vector<PlaylistChange>& changes);
+
+    // Track file names, sorted
+    const std::vector<std::string>& files() const { return names; }
+    // Index of name, or of the track that follows it if it is not in the list
+    size_t position(const std::string& name) const;
+    bool contains(const std::string& name) const;
+    bool watching() const { return watchFd >= 0; }
+
+    static bool isTrack(const std::string& name);
+
+private:
+    std::vector<std::string> scan() const;
+    void rescan(std::vector<PlaylistChange>& changes);
+    void add(const std::string& name);
+    void remove(const std::string& name);
+
+    std::string folder;
+    std::vector<std::string> names;
+    int watchFd = -1;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * qoa_encoder.cpp - Encoder for the "Quite OK Audio" lossy format
+ */
+#include "qoa_encoder.h"
+
+#include <algorithm>
+
+constexpr uint32_t MAGIC = 0x716f6166;  // "qoaf"
+
+// round((s + 1) ^ 2.75)
+static constexpr int32_t scalefactor_table[16] =
+{ 1, 7, 21, 45, 84, 138, 211, 304, 421, 562, 731, 928, 1157, 1419, 1715, 2048 };
+
+// Rounded up 65536 / scale factor, divides without a division
+static constexpr int32_t reciprocal_table[16] =
+{ 65536, 9363, 3121, 1457, 781, 475, 311, 216, 156, 117, 90, 71, 57, 47, 39, 32 };
+
+// Residual divided by the scale factor (-8..8) to its 3-bit code
+static constexpr uint8_t quant_table[17] =
+{ 7, 7, 7, 5, 5, 3, 3, 1, 0, 0, 2, 2, 4, 4, 6, 6, 6 };
+
+// Scale factor times 0.75, -0.75, 2.5, -2.5, 4.5, -4.5, 7, -7 (rounded) per code
+static constexpr int32_t dequant_table[16][8] =
+{
+    {    1,    -1,    3,    -3,    5,    -5,     7,     -7 },
+    {    5,    -5,   18,   -18,   32,   -32,    49,    -49 },
+    {   16,   -16,   53,   -53,   95,   -95,   147,   -147 },
+    {   34,   -34,  113,  -113,  203,  -203,   315,   -315 },
+    {   63,   -63,  210,  -210,  378,  -378,   588,   -588 },
+    {  104,  -104,  345,  -345,  621,  -621,   966,   -966 },
+    {  158,  -158,  528,  -528,  950,  -950,  1477,  -1477 },
+    {  228,  -228,  760,  -760, 1368, -1368,  2128,  -2128 },
+    {  316,  -316, 1053, -1053, 1895, -1895,  2947,  -2947 },
+    {  422,  -422, 1405, -1405, 2529, -2529,  3934,  -3934 },
+    {  548,  -548, 1828, -1828, 3290, -3290,  5117,  -5117 },
+    {  696,  -696, 2320, -2320, 4176, -4176,  6496,  -6496 },
+    {  868,  -868, 2893, -2893, 5207, -5207,  8099,  -8099 },
+    { 1064, -1064, 3548, -3548, 6386, -6386,  9933,  -9933 },
+    { 1286, -1286, 4288, -4288, 7718, -7718, 12005, -12005 },
+    { 1536, -1536, 5120, -5120, 9216, -9216, 14336, -14336 },
+};
+
+static uint8_t* put64(uint8_t* out, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--) *out++ = uint8_t(value >> (8 * i));
+    return out;
+}
+
+QoaEncoder::QoaEncoder(int channels, int sampleRate)
+    : channelCount(std::clamp(channels, 1, QOA_MAX_CHANNELS)), sampleRate(sampleRate)
+{
+}
+
+void QoaEncoder::writeHeader(uint32_t samples, uint8_t* out)
+{
+    put64(out, uint64_t(MAGIC) << 32 | samples);
+}
+
+size_t QoaEncoder::frameBytes(int channels, int samples)
+{
+    const size_t slices = (size_t(samples) + QOA_SLICE_SAMPLES - 1) / QOA_SLICE_SAMPLES;
+    return 8 + size_t(channels) * (16 + slices * 8);
+}
+
+void QoaEncoder::encodeFrame(const int16_t* samples, int count, uint8_t* out)
+{
+    const int channels = channelCount;
+    out = put64(out, uint64_t(channels) << 56 | uint64_t(sampleRate) << 32 | uint64_t(count) << 16 |
+                     frameBytes(channels, count));
+    for (int c = 0; c < channels; c++) {
+        uint64_t history = 0, weights = 0;
+        for (int i = 0; i < 4; i++) {
+            history = history << 16 | uint16_t(lms[c].history[i]);
+            weights = weights << 16 | uint16_t(lms[c].weights[i]);
+        }
+        out = put64(out, history);
+        out = put64(out, weights);
+    }
+
+    for (int start = 0; start < count; start += QOA_SLICE_SAMPLES) {
+        const int length = std::min(QOA_SLICE_SAMPLES, count - start);
+        for (int c = 0; c < channels; c++) out = put64(out, encodeSlice(c, samples + size_t(start) * channels + c, length));
+    }
+}
+
+uint64_t QoaEncoder::encodeSlice(int channel, const int16_t* in, int length)
+{
+    // Tries every scale factor, starting with the previous slice's: a trial
+    // stops as soon as its error exceeds the best one so far, which after a
+    // good first guess is within a few samples
+    uint64_t bestRank = UINT64_MAX;
+    uint64_t bestSlice = 0;
+    Lms bestLms;
+    int bestScalefactor = 0;
+    for (int n = 0; n < 16; n++) {
+        const int sf = (scalefactor[channel] + n) & 15;
+        const int32_t limit = 9 * scalefactor_table[sf];
+        Lms trial = lms[channel];
+        int32_t* history = trial.history;
+        int32_t* weights = trial.weights;
+        uint64_t slice = sf;
+        uint64_t rank = 0;
+        for (int i = 0; i < length; i++) {
+            const int32_t sample = in[size_t(i) * channelCount];
+            // Wrapping 32-bit arithmetic like the decoders
+            const int32_t predicted = int32_t(uint32_t(weights[0]) * uint32_t(history[0]) +
+                                              uint32_t(weights[1]) * uint32_t(history[1]) +
+                                              uint32_t(weights[2]) * uint32_t(history[2]) +
+                                              uint32_t(weights[3]) * uint32_t(history[3])) >> 13;
+
+            // Residual divided by the scale factor, rounded away from zero;
+            // residuals beyond 9 steps give 8 anyway, limiting them first
+            // keeps the product in 32 bits
+            const int32_t residual = std::clamp(sample - predicted, -limit, limit);
+            int32_t scaled = (residual * reciprocal_table[sf] + (1 << 15)) >> 16;
+            scaled += ((residual > 0) - (residual < 0)) - ((scaled > 0) - (scaled < 0));
+            const int quantized = quant_table[std::clamp(scaled, -8, 8) + 8];
+            const int32_t dequantized = dequant_table[sf][quantized];
+            const int32_t reconstructed = std::clamp(predicted + dequantized, -32768, 32767);
+
+            // Large weights make the predictor unstable, they add to the error
+            const uint32_t weightSquares = uint32_t(weights[0]) * uint32_t(weights[0]) +
+                                           uint32_t(weights[1]) * uint32_t(weights[1]) +
+                                           uint32_t(weights[2]) * uint32_t(weights[2]) +
+                                           uint32_t(weights[3]) * uint32_t(weights[3]);
+            const uint32_t penalty = uint32_t(std::max(int32_t(weightSquares >> 18) - 0x8ff, 0));
+            const uint32_t error = uint32_t(sample - reconstructed);
+            rank += uint64_t(error * error) + penalty * penalty;
+            if (rank > bestRank) break;
+
+            const int32_t delta = dequantized >> 4;
+            for (int k = 0; k < 4; k++) weights[k] += history[k] < 0 ? -delta : delta;
+            for (int k = 0; k < 3; k++) history[k] = history[k + 1];
+            history[3] = reconstructed;
+            slice = slice << 3 | quantized;
+        }
+        if (rank < bestRank) {
+            bestRank = rank;
+            bestSlice = slice;
+            bestLms = trial;
+            bestScalefactor = sf;
+        }
+    }
+
+    scalefactor[channel] = bestScalefactor;
+    lms[channel] = bestLms;
+    // A short last slice is padded with zero codes
+    return bestSlice << ((QOA_SLICE_SAMPLES - length) * 3);
+}
@@ -0,0 +1,59 @@
+/*
+ * qoa_encoder.h - Encoder for the "Quite OK Audio" lossy format (https://qoaformat.org)
+ *
+ * QOA stores 20 samples in 64 bits (3.2 bits per sample, 1/5 of 16-bit PCM)
+ * with a small LMS predictor per channel, and encodes much faster than real
+ * time. A file is an 8 byte header followed by frames:
+ *   file header:  "qoaf", uint32 samples per channel (0: stream of unknown length)
+ *   frame header: uint8 channels, uint24 sample rate, uint16 samples per channel,
+ *                 uint16 frame size in bytes
+ *   per channel:  LMS history and weights, 4 x int16 each
+ *   slices:       up to 256 x channels uint64, interleaved by channel; each one
+ *                 a 4-bit scale factor and 20 3-bit quantized residuals
+ * All values big endian. Every frame holds QOA_FRAME_SAMPLES per channel
+ * except the last one, and carries the predictor state it starts with.
+ */
+#ifndef QOA_ENCODER_H
+#define QOA_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr int QOA_SLICE_SAMPLES = 20;
+constexpr int QOA_FRAME_SAMPLES = 256 * QOA_SLICE_SAMPLES;
+constexpr int QOA_MAX_CHANNELS = 8;
+constexpr size_t QOA_HEADER_BYTES = 8;
+
+class QoaEncoder
+{
+public:
+    QoaEncoder(int channels, int sampleRate);
+
+    int channels() const { return channelCount; }
+    // 'samples' per channel, 0 for a stream
+    static void writeHeader(uint32_t samples, uint8_t* out);
+    // Encoded size of a frame of 'samples' samples per channel
+    static size_t frameBytes(int channels, int samples);
+    // Encodes 'samples' (1 to QOA_FRAME_SAMPLES) interleaved samples per
+    // channel into frameBytes() bytes at 'out'
+    void encodeFrame(const int16_t* samples, int count, uint8_t* out);
+
+private:
+    struct Lms
+    {
+        int32_t history[4] = { 0, 0, 0, 0 };
+        int32_t weights[4] = { 0, 0, -(1 << 13), 1 << 14 };
+    };
+
+    // Encodes a slice of one channel with the scale factor that gives the
+    // smallest error and advances its predictor
+    uint64_t encodeSlice(int channel, const int16_t* in, int length);
+
+    int channelCount;
+    int sampleRate;
+    Lms lms[QOA_MAX_CHANNELS];
+    // Scale factor of the previous slice, where the search of the next one starts
+    int scalefactor[QOA_MAX_CHANNELS] = {};
+};
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * realtime.cpp - Real time mode of the render path
+ */
+#include "realtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+// Stack the render path may use without page faults
+constexpr size_t PREFAULT_STACK_BYTES = 256 * 1024;
+
+bool setRealtimePriority(int priority)
+{
+#ifdef _WIN32
+    (void)priority;
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        std::cerr << "Cannot raise the render thread priority\n";
+        return false;
+    }
+#else
+    sched_param param = {};
+    param.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        std::cerr << "Cannot use SCHED_FIFO for the render thread (" << strerror(err)
+                  << "), it keeps running at normal priority\n";
+        return false;
+    }
+#endif
+    return true;
+}
+
+void setNormalPriority()
+{
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+#else
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+#endif
+}
+
+bool lockMemory(const void* data, size_t size)
+{
+#ifdef _WIN32
+    bool ok = VirtualLock(const_cast<void*>(data), size);
+#else
+    bool ok = mlock(data, size) == 0;
+#endif
+    if (!ok) std::cerr << "Cannot lock " << size << " bytes into memory (locked memory limit?)\n";
+    return ok;
+}
+
+void unlockMemory(const void* data, size_t size)
+{
+#ifdef _WIN32
+    VirtualUnlock(const_cast<void*>(data), size);
+#else
+    munlock(data, size);
+#endif
+}
+
+void prefaultStack()
+{
+    uint8_t stack[PREFAULT_STACK_BYTES];
+    // Volatile writes, so that the untouched array is not optimized away
+    volatile uint8_t* page = stack;
+    for (size_t i = 0; i < PREFAULT_STACK_BYTES; i += 4096) page[i] = 0;
+}
+
+RealtimeSink::RealtimeSink(std::unique_ptr<AudioSink> out)
+    : output(std::move(out))
+{
+    consumer = std::thread(&RealtimeSink::consumerLoop, this);
+}
+
+RealtimeSink::~RealtimeSink()
+{
+    running = false;
+    if (consumer.joinable()) consumer.join();
+}
+
+void RealtimeSink::write(const uint8_t* samples, int count)
+{
+    size_t left = count;
+    while (left > 0 && !failed) {
+        size_t pushed = ring.push(samples, left);
+        samples += pushed;
+        left -= pushed;
+        if (left > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+int RealtimeSink::queued()
+{
+    return int(ring.size()) + outputQueued.load(std::memory_order_relaxed);
+}
+
+bool RealtimeSink::flush()
+{
+    return !failed;
+}
+
+void RealtimeSink::clear()
+{
+    clearRequested = true;
+    while (clearRequested && running) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void RealtimeSink::setPaused(bool paused)
+{
+    pauseRequested = paused;
+}
+
+void RealtimeSink::idle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void RealtimeSink::consumerLoop()
+{
+    bool paused = false;
+    while (running) {
+        if (clearRequested) {
+            while (ring.pop(chunk, CONSUMER_CHUNK) > 0) {}
+            output->clear();
+            outputQueued = 0;
+            clearRequested = false;
+        }
+        if (pauseRequested != paused) {
+            paused = pauseRequested;
+            output->setPaused(paused);
+        }
+
+        // Everything rendered so far goes out with one flush
+        size_t total = 0;
+        while (total < RING_SAMPLES) {
+            size_t count = ring.pop(chunk, CONSUMER_CHUNK);
+            if (count == 0) break;
+            output->write(chunk, int(count));
+            total += count;
+        }
+        if (!output->flush()) failed = true;
+        outputQueued = output->queued();
+        if (total == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Hand over what the producer rendered before it stopped
+    size_t count;
+    while ((count = ring.pop(chunk, CONSUMER_CHUNK)) > 0) output->write(chunk, int(count));
+    output->flush();
+}
@@ -0,0 +1,104 @@
+/*
+ * realtime.h - Real time mode of the render path
+ *
+ * The producer thread (the one running the emulation) runs under SCHED_FIFO
+ * while a track plays and the memory it touches is locked into RAM. Its
+ * audio goes into a preallocated lock-free ring; a consumer thread at normal
+ * priority passes it on to the actual output, so the producer makes no
+ * output calls that may block or allocate.
+ *
+ * What is covered: every iteration of a track's playback loop, i.e. rendering
+ * into the ring, the telemetry counters and closing stats intervals (their
+ * output is written by the stats writer thread), and the key commands
+ * (pause, seek, track change). Debug builds count the heap allocations of
+ * each iteration and report any. A seek still prints its new position and
+ * waits for the consumer to drop the queued audio.
+ * Not covered: loading a track, starting an NSF song, updating the playlist
+ * and the messages between tracks. The producer drops back to normal
+ * priority between tracks for these.
+ *
+ * With --threaded-chips the second chip of a dual-chip track is clocked by a
+ * worker the producer waits for at every VGM wait. The worker runs under
+ * SCHED_FIFO at the producer's priority for the track, so the producer never
+ * waits on a normal priority thread.
+ */
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "audio_sink.h"
+#include "spsc_queue.h"
+
+constexpr int REALTIME_DEFAULT_PRIORITY = 50;
+
+// Moves the calling thread to SCHED_FIFO with the given priority. Returns
+// false (and reports) if the system does not permit it.
+bool setRealtimePriority(int priority);
+// Moves the calling thread back to the normal scheduling policy
+void setNormalPriority();
+
+// Locks the pages of [data, data + size) into RAM, which also faults them in
+bool lockMemory(const void* data, size_t size);
+void unlockMemory(const void* data, size_t size);
+
+// Faults in the top of the calling thread's stack so that deeper calls on the
+// render path do not page fault
+void prefaultStack();
+
+// Keeps a memory range locked for its lifetime
+class MemoryLock {
+public:
+    MemoryLock(const void* data, size_t size) : data(data), size(size) { locked = size && lockMemory(data, size); }
+    ~MemoryLock() { if (locked) unlockMemory(data, size); }
+    MemoryLock(const MemoryLock&) = delete;
+    MemoryLock& operator=(const MemoryLock&) = delete;
+
+private:
+    const void* data;
+    size_t size;
+    bool locked = false;
+};
+
+class RealtimeSink : public AudioSink {
+public:
+    // Takes over the output and starts the consumer thread
+    explicit RealtimeSink(std::unique_ptr<AudioSink> output);
+    ~RealtimeSink() override;
+    RealtimeSink(const RealtimeSink&) = delete;
+    RealtimeSink& operator=(const RealtimeSink&) = delete;
+
+    // Waits for ring space if the consumer falls behind
+    void write(const uint8_t* samples, int count) override;
+    int queued() override;
+    bool flush() override;
+    // Blocks until the consumer has dropped the ring and the output queue
+    void clear() override;
+    void setPaused(bool paused) override;
+    void idle() override;
+
+private:
+    // Holds the longest VGM wait (65535 samples) rendered at once
+    static constexpr size_t RING_SAMPLES = 131072;
+    static constexpr size_t CONSUMER_CHUNK = 4096;
+
+    void consumerLoop();
+
+    std::unique_ptr<AudioSink> output;
+    SpscQueue<uint8_t, RING_SAMPLES> ring;
+    uint8_t chunk[CONSUMER_CHUNK];
+
+    std::thread consumer;
+    std::atomic<bool> running{true};
+    std::atomic<bool> clearRequested{false};
+    std::atomic<bool> pauseRequested{false};
+    std::atomic<bool> failed{false};
+    // Output queue level as last seen by the consumer
+    std::atomic<int> outputQueued{0};
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * spsc_queue.h - Bounded lock-free queue for one producer and one consumer thread
+ *
+ * push() is only called by the producer, pop() only by the consumer. Neither
+ * blocks, allocates or makes system calls. CAPACITY must be a power of two.
+ */
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    // Returns false if the queue is full
+    bool push(const T& item)
+    {
+        const size_t tail = write.load(std::memory_order_relaxed);
+        if (tail - read.load(std::memory_order_acquire) == CAPACITY) return false;
+        items[tail & (CAPACITY - 1)] = item;
+        write.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& item)
+    {
+        const size_t head = read.load(std::memory_order_relaxed);
+        if (head == write.load(std::memory_order_acquire)) return false;
+        item = items[head & (CAPACITY - 1)];
+        read.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Copies as many of the items as fit, returns how many were pushed
+    size_t push(const T* data, size_t count)
+    {
+        const size_t tail = write.load(std::memory_order_relaxed);
+        count = std::min(count, CAPACITY - (tail - read.load(std::memory_order_acquire)));
+        for (size_t i = 0; i < count; i++) items[(tail + i) & (CAPACITY - 1)] = data[i];
+        write.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Takes up to count items, returns how many were popped
+    size_t pop(T* data, size_t count)
+    {
+        const size_t head = read.load(std::memory_order_relaxed);
+        count = std::min(count, write.load(std::memory_order_acquire) - head);
+        for (size_t i = 0; i < count; i++) data[i] = items[(head + i) & (CAPACITY - 1)];
+        read.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t size() const
+    {
+        // read first: the later write index can only be ahead of it
+        const size_t head = read.load(std::memory_order_acquire);
+        return write.load(std::memory_order_acquire) - head;
+    }
+    bool empty() const { return read.load(std::memory_order_acquire) == write.load(std::memory_order_acquire); }
+
+private:
+    T items[CAPACITY];
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> write{0};
+    alignas(64) std::atomic<size_t> read{0};
+};
+
+#endif
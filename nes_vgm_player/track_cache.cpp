@@ -0,0 +1,144 @@
+/*
+ * track_cache.cpp - LRU cache of loaded tracks
+ */
+#include "track_cache.h"
+
+#include <algorithm>
+#include <iostream>
+
+size_t CachedTrack::memoryBytes() const
+{
+    size_t bytes = sizeof(CachedTrack) + path.capacity() + vgm.bytes().capacity();
+    if (!nsf.empty()) bytes += NSF_HEADER_SIZE + nsf.programSize();
+    bytes += commands.capacity() * sizeof(VgmCommand);
+    bytes += keyframes.capacity() * sizeof(VgmKeyframe);
+    // The block contents are accounted by the block cache
+    bytes += dataBlocks.capacity() * sizeof(VgmDataBlock);
+    return bytes;
+}
+
+bool CachedTrack::wantsKeyframe(uint64_t position) const
+{
+    return position >= (keyframes.size() + 1) * VGM_KEYFRAME_SAMPLES;
+}
+
+const VgmKeyframe* CachedTrack::keyframeBefore(uint64_t position) const
+{
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), position,
+        [](uint64_t pos, const VgmKeyframe& keyframe) { return pos < keyframe.position; });
+    return it == keyframes.begin() ? nullptr : &*(it - 1);
+}
+
+const VgmDataBlock* CachedTrack::dataBlock(size_t command) const
+{
+    auto it = std::lower_bound(dataBlocks.begin(), dataBlocks.end(), command,
+        [](const VgmDataBlock& block, size_t index) { return block.command < index; });
+    return it != dataBlocks.end() && it->command == command ? &*it : nullptr;
+}
+
+std::shared_ptr<CachedTrack> TrackCache::load(const std::string& path)
+{
+    auto track = std::make_shared<CachedTrack>();
+    track->path = path;
+
+    std::error_code ec;
+    track->modified = std::filesystem::last_write_time(path, ec);
+    track->fileSize = std::filesystem::file_size(path, ec);
+
+    std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    track->isNsf = (ext == ".nsf");
+    if (track->isNsf) return track->nsf.load(path) ? track : nullptr;
+    if (!track->vgm.load(path)) return nullptr;
+
+    // Decode the whole stream once, playback and seeking then only walk the vector
+    const VgmFile& vgm = track->vgm;
+    size_t pos = vgm.dataOffset();
+    const size_t end = vgm.bytes().size();
+    VgmCommand cmd;
+    uint64_t samples = 0;
+    VgmBlockData table;     // last decompression table
+    while (pos < end) {
+        if (!vgm.parseCommand(pos, cmd)) {
+            track->malformed = true;
+            break;
+        }
+        pos += cmd.length;
+        track->commands.push_back(cmd);
+        if (cmd.type == VgmCommand::Type::WAIT) samples += cmd.samples;
+        if (cmd.type == VgmCommand::Type::END) break;
+        if (cmd.type != VgmCommand::Type::DATA_BLOCK) continue;
+
+        // Blocks are decompressed here once, and only once for all tracks holding the same block
+        const uint8_t* payload = vgm.bytes().data() + cmd.blockData;
+        const bool compressed = cmd.blockType >= VGM_BLOCK_COMPRESSED_FIRST && cmd.blockType <= VGM_BLOCK_COMPRESSED_LAST;
+        if (cmd.blockType == VGM_BLOCK_DECOMPRESSION_TABLE) {
+            table = blockCache.get(cmd.blockType, payload, cmd.blockSize, nullptr);
+        } else if (compressed || cmd.blockType == VGM_BLOCK_NES_RAM_WRITE) {
+            VgmBlockData data = blockCache.get(cmd.blockType, payload, cmd.blockSize, table.get());
+            if (data) track->dataBlocks.push_back({ track->commands.size() - 1, cmd.blockType, std::move(data) });
+        }
+    }
+    track->commands.shrink_to_fit();
+    track->dataBlocks.shrink_to_fit();
+    // Recording keyframes while playing must not allocate
+    track->keyframes.reserve(samples / VGM_KEYFRAME_SAMPLES);
+    return track;
+}
+
+std::shared_ptr<CachedTrack> TrackCache::get(const std::string& path)
+{
+    auto it = index.find(path);
+    if (it != index.end()) {
+        const auto& track = *it->second;
+        std::error_code ec;
+        // A file that changed on disk is loaded again
+        if (std::filesystem::last_write_time(path, ec) == track->modified && !ec &&
+            std::filesystem::file_size(path, ec) == track->fileSize && !ec) {
+            entries.splice(entries.begin(), entries, it->second);
+            hitCount++;
+            return entries.front();
+        }
+        invalidate(path);
+    }
+
+    missCount++;
+    auto track = load(path);
+    if (!track) return nullptr;
+    entries.push_front(track);
+    index[path] = entries.begin();
+    trim();
+    return track;
+}
+
+void TrackCache::invalidate(const std::string& path)
+{
+    auto it = index.find(path);
+    if (it == index.end()) return;
+    entries.erase(it->second);
+    index.erase(it);
+}
+
+void TrackCache::setCapacity(size_t bytes)
+{
+    capacity = bytes;
+    trim();
+}
+
+size_t TrackCache::memoryBytes() const
+{
+    size_t bytes = blockCache.memoryBytes();
+    for (const auto& track : entries) bytes += track->memoryBytes();
+    return bytes;
+}
+
+void TrackCache::trim()
+{
+    // Keyframes make entries grow while they are played, so sizes are summed on every trim
+    size_t bytes = memoryBytes();
+    while (entries.size() > 1 && bytes > capacity) {
+        bytes -= entries.back()->memoryBytes();
+        index.erase(entries.back()->path);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * track_cache.h - LRU cache of loaded tracks
+ *
+ * Keeps recently played files in memory, VGM files together with their
+ * decoded command stream, data blocks and the seek keyframes recorded while
+ * playing, so
+ * going back and forth in the playlist neither reads nor parses the file
+ * again. The cache is bounded by the memory of its entries; tracks that are
+ * still being played stay alive (shared_ptr) when they are evicted.
+ */
+#ifndef TRACK_CACHE_H
+#define TRACK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "apu2A03.h"
+#include "nsf_file.h"
+#include "vgm_data_blocks.h"
+#include "vgm_file.h"
+
+// Keyframe distance in 44.1 kHz samples
+constexpr uint64_t VGM_KEYFRAME_SAMPLES = 10 * 44100;
+constexpr size_t TRACK_CACHE_DEFAULT_BYTES = 64 * 1024 * 1024;
+
+// Emulation state at a command boundary, seeking starts from the closest one
+struct VgmKeyframe
+{
+    size_t command = 0;             // index of the next command
+    uint64_t position = 0;          // samples played before it
+    Apu2A03 chips[2];               // chip states, the second one for dual-chip files
+};
+
+// Decoded contents of a data block, shared with other tracks holding the same block
+struct VgmDataBlock
+{
+    size_t command = 0;             // index of the DATA_BLOCK command
+    uint8_t type = 0;
+    VgmBlockData data;
+};
+
+struct CachedTrack
+{
+    std::string path;
+    bool isNsf = false;
+    VgmFile vgm;
+    NsfFile nsf;
+    // VGM: decoded command stream, ends with the END command unless the
+    // stream is malformed or stops without one
+    std::vector<VgmCommand> commands;
+    bool malformed = false;
+    // VGM: RAM write and compressed blocks in stream order
+    std::vector<VgmDataBlock> dataBlocks;
+    // VGM: one keyframe every VGM_KEYFRAME_SAMPLES, added while playing
+    std::vector<VgmKeyframe> keyframes;
+
+    std::filesystem::file_time_type modified;
+    uintmax_t fileSize = 0;
+
+    size_t memoryBytes() const;
+    // True once playback has reached the time of the next keyframe
+    bool wantsKeyframe(uint64_t position) const;
+    // Last keyframe at or before position, nullptr if there is none
+    const VgmKeyframe* keyframeBefore(uint64_t position) const;
+    // Block of the DATA_BLOCK command at index command, nullptr if it is not kept
+    const VgmDataBlock* dataBlock(size_t command) const;
+};
+
+class TrackCache {
+public:
+    explicit TrackCache(size_t capacityBytes = TRACK_CACHE_DEFAULT_BYTES) : capacity(capacityBytes) {}
+
+    // Returns the cached track, (re)loading it if it is not cached or the file
+    // has changed. Returns nullptr (and reports) if the file cannot be loaded.
+    std::shared_ptr<CachedTrack> get(const std::string& path);
+    void invalidate(const std::string& path);
+    void setCapacity(size_t bytes);
+
+    // Includes the data blocks, which are counted once however many tracks share them
+    size_t memoryBytes() const;
+    const VgmBlockCache& blocks() const { return blockCache; }
+    size_t count() const { return entries.size(); }
+    uint64_t hits() const { return hitCount; }
+    uint64_t misses() const { return missCount; }
+
+private:
+    using Entries = std::list<std::shared_ptr<CachedTrack>>;
+
+    std::shared_ptr<CachedTrack> load(const std::string& path);
+    // Evicts least recently used tracks until the cache fits, keeps the most recent one
+    void trim();
+
+    size_t capacity;
+    Entries entries;    // most recently used first
+    std::unordered_map<std::string, Entries::iterator> index;
+    VgmBlockCache blockCache;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * vgm_analyze.cpp - Loudness analysis of a VGM library
+ *
+ * Renders every .vgm file of a directory headless on a pool of worker
+ * threads, measures integrated loudness (EBU R128) and true peak, and writes
+ * the replay gain of every track to the loudness index in that directory.
+ * The player applies these gains during playback.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loudness.h"
+#include "vgm_file.h"
+#include "vgm_render.h"
+
+using namespace std;
+
+const int SAMPLE_RATE = 44100;
+
+struct TrackAnalysis
+{
+    string name;
+    LoudnessResult loudness;
+    double gainDb = 0.0;
+    double audioSeconds = 0.0;
+    bool ok = false;
+};
+
+static void analyzeTrack(const std::filesystem::path& path, double targetLufs, TrackAnalysis& result)
+{
+    VgmFile vgm;
+    vector<uint8_t> pcm;
+    if (!vgm.load(path.string()) || !vgmRender(vgm, pcm)) return;
+
+    result.loudness = measureLoudness(pcm, SAMPLE_RATE);
+    result.gainDb = replayGainDb(result.loudness, targetLufs);
+    result.audioSeconds = double(pcm.size()) / SAMPLE_RATE;
+    result.ok = true;
+}
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " <vgm directory> [--index <file>] [--threads <n>] [--target <LUFS>]\n"
+              << "  --index <file>   loudness index to write (default: <vgm directory>/" << LOUDNESS_INDEX_FILE << ")\n"
+              << "  --threads <n>    worker threads (default: number of CPU cores)\n"
+              << "  --target <LUFS>  loudness the replay gain aims for (default: " << LOUDNESS_TARGET_LUFS << ")\n";
+}
+
+int main(int argc, char* argv[])
+{
+    string dir;
+    string indexPath;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    double targetLufs = LOUDNESS_TARGET_LUFS;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--index" && i + 1 < argc) indexPath = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--target" && i + 1 < argc) targetLufs = atof(argv[++i]);
+        else if (dir.empty() && arg[0] != '-') dir = arg;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dir.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (indexPath.empty()) indexPath = (std::filesystem::path(dir) / LOUDNESS_INDEX_FILE).string();
+
+    vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".vgm") files.push_back(entry.path());
+    }
+    if (ec) {
+        std::cerr << "Failed to open directory: " << dir << "\n";
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    // Workers take the next unprocessed track until all are done
+    vector<TrackAnalysis> results(files.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            results[i].name = files[i].filename().string();
+            analyzeTrack(files[i], targetLufs, results[i]);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> pool;
+    threads = std::min<int>(threads, std::max<size_t>(1, files.size()));
+    for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Keep entries of tracks that are not in this directory scan
+    std::map<string, LoudnessEntry> index;
+    loadLoudnessIndex(indexPath, index);
+
+    int failures = 0;
+    double totalAudio = 0.0;
+    printf("%-32s %10s %10s %10s %9s\n", "track", "audio s", "LUFS", "dBTP", "gain dB");
+    for (const auto& r : results) {
+        if (!r.ok) {
+            printf("%-32s failed to render\n", r.name.c_str());
+            failures++;
+            continue;
+        }
+        printf("%-32s %10.2f %10.2f %10.2f %+9.2f\n", r.name.c_str(), r.audioSeconds,
+            r.loudness.integratedLufs, r.loudness.truePeakDb, r.gainDb);
+        index[r.name] = { r.gainDb, r.loudness.integratedLufs, r.loudness.truePeakDb };
+        totalAudio += r.audioSeconds;
+    }
+    printf("%zu tracks, %.1f s of audio analyzed in %.2f s on %d threads\n",
+        results.size(), totalAudio, elapsed.count(), threads);
+
+    if (!saveLoudnessIndex(indexPath, index)) {
+        std::cerr << "Failed to write loudness index: " << indexPath << "\n";
+        return 1;
+    }
+    std::cout << "Loudness index written to " << indexPath << "\n";
+    return failures ? 1 : 0;
+}
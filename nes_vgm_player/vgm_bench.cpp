@@ -0,0 +1,227 @@
+/*
+ * vgm_bench.cpp - End-to-end render throughput benchmark with golden PCM hashes
+ *
+ * Renders every .vgm file of a directory without an audio device, reports the
+ * realtime factor per track and for the whole corpus, and compares a hash of
+ * the rendered PCM against the hashes stored in a golden file. Any APU change
+ * is thereby shown to be bit-exact or intentionally different (--update).
+ * With --batch the corpus is rendered by the multi-lane APU instead, which has
+ * to reproduce the same hashes.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fnv1a.h"
+#include "vgm_file.h"
+#include "vgm_render.h"
+
+using namespace std;
+
+const double SAMPLE_RATE = 44100.0;
+const char* DEFAULT_GOLDEN_FILE = "golden_pcm.txt";
+
+struct TrackResult
+{
+    string name;
+    size_t samples = 0;
+    double renderSeconds = 0.0;
+    uint64_t hash = 0;
+    bool ok = false;
+};
+
+// Golden file format: one "<16 hex digit hash> <file name>" line per track
+static map<string, uint64_t> loadGolden(const string& path)
+{
+    map<string, uint64_t> golden;
+    std::ifstream f(path);
+    string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        string hash, name;
+        if (ss >> hash && std::getline(ss >> std::ws, name)) {
+            golden[name] = std::stoull(hash, nullptr, 16);
+        }
+    }
+    return golden;
+}
+
+static bool saveGolden(const string& path, const vector<TrackResult>& results)
+{
+    std::ofstream f(path);
+    f << "# PCM hashes (FNV-1a 64) written by vgm_bench --update\n";
+    for (const auto& r : results) {
+        if (!r.ok) continue;
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)r.hash);
+        f << hash << " " << r.name << "\n";
+    }
+    return static_cast<bool>(f);
+}
+
+static bool renderTrack(const std::filesystem::path& path, int runs, TrackResult& result)
+{
+    VgmFile vgm;
+    if (!vgm.load(path.string())) return false;
+
+    vector<uint8_t> pcm;
+    double best = 0.0;
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!vgmRender(vgm, pcm)) return false;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+
+    result.samples = pcm.size();
+    result.renderSeconds = best;
+    result.hash = fnv1a64(pcm.data(), pcm.size());
+    result.ok = true;
+    return true;
+}
+
+// Renders all tracks through the multi-lane APU, only the total time is measured
+static bool renderBatch(const vector<std::filesystem::path>& paths, int runs, vector<TrackResult>& results, double& seconds)
+{
+    vector<VgmFile> files(paths.size());
+    vector<const VgmFile*> filePtrs;
+    results.assign(paths.size(), {});
+    for (size_t i = 0; i < paths.size(); i++) {
+        results[i].name = paths[i].filename().string();
+        if (!files[i].load(paths[i].string())) return false;
+        filePtrs.push_back(&files[i]);
+    }
+
+    vector<vector<uint8_t>> pcm;
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!vgmRenderBatch(filePtrs, pcm)) return false;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < seconds) seconds = elapsed.count();
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        results[i].samples = pcm[i].size();
+        results[i].hash = fnv1a64(pcm[i].data(), pcm[i].size());
+        results[i].ok = true;
+    }
+    return true;
+}
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " <vgm directory> [--golden <file>] [--update] [--runs <n>] [--batch]\n"
+              << "  --golden <file>  golden hash file (default: <vgm directory>/" << DEFAULT_GOLDEN_FILE << ")\n"
+              << "  --update         write the current hashes to the golden file\n"
+              << "  --runs <n>       render each track n times and report the fastest run\n"
+              << "  --batch          render the tracks in the lanes of the multi-instance APU\n";
+}
+
+int main(int argc, char* argv[])
+{
+    string dir;
+    string goldenPath;
+    bool update = false;
+    int runs = 1;
+    bool batch = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--golden" && i + 1 < argc) goldenPath = argv[++i];
+        else if (arg == "--update") update = true;
+        else if (arg == "--batch") batch = true;
+        else if (arg == "--runs" && i + 1 < argc) runs = std::max(1, atoi(argv[++i]));
+        else if (dir.empty() && arg[0] != '-') dir = arg;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dir.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (goldenPath.empty()) goldenPath = (std::filesystem::path(dir) / DEFAULT_GOLDEN_FILE).string();
+
+    vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".vgm") files.push_back(entry.path());
+    }
+    if (ec) {
+        std::cerr << "Failed to open directory: " << dir << "\n";
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    const auto golden = loadGolden(goldenPath);
+    vector<TrackResult> results;
+    size_t totalSamples = 0;
+    double totalSeconds = 0.0;
+    int failures = 0;
+
+    vector<TrackResult> batchResults;
+    if (batch && !renderBatch(files, runs, batchResults, totalSeconds)) {
+        std::cerr << "Failed to render the corpus in batch mode\n";
+        return 1;
+    }
+
+    printf("%-32s %10s %10s %10s  %-16s %s\n", "track", "audio s", "render s", "realtime", "pcm hash", "golden");
+    for (size_t i = 0; i < files.size(); i++) {
+        TrackResult r;
+        r.name = files[i].filename().string();
+        if (batch) {
+            r = batchResults[i];
+        } else if (!renderTrack(files[i], runs, r)) {
+            printf("%-32s failed to render\n", r.name.c_str());
+            failures++;
+            results.push_back(r);
+            continue;
+        }
+
+        const char* status = "new";
+        auto it = golden.find(r.name);
+        if (it != golden.end()) {
+            status = (it->second == r.hash) ? "ok" : "MISMATCH";
+            if (it->second != r.hash && !update) failures++;
+        }
+
+        double audioSeconds = r.samples / SAMPLE_RATE;
+        if (batch) {
+            printf("%-32s %10.2f %10s %10s  %016llx %s\n", r.name.c_str(), audioSeconds, "-", "-",
+                (unsigned long long)r.hash, status);
+        } else {
+            printf("%-32s %10.2f %10.4f %9.1fx  %016llx %s\n", r.name.c_str(), audioSeconds, r.renderSeconds,
+                r.renderSeconds > 0 ? audioSeconds / r.renderSeconds : 0.0, (unsigned long long)r.hash, status);
+        }
+        totalSamples += r.samples;
+        totalSeconds += r.renderSeconds;
+        results.push_back(r);
+    }
+
+    double totalAudio = totalSamples / SAMPLE_RATE;
+    printf("%-32s %10.2f %10.4f %9.1fx\n", "TOTAL", totalAudio, totalSeconds,
+        totalSeconds > 0 ? totalAudio / totalSeconds : 0.0);
+
+    if (update) {
+        if (!saveGolden(goldenPath, results)) {
+            std::cerr << "Failed to write golden file: " << goldenPath << "\n";
+            return 1;
+        }
+        std::cout << "Golden hashes written to " << goldenPath << "\n";
+    }
+
+    if (failures) {
+        std::cerr << failures << " track(s) failed or differ from the golden hashes\n";
+        return 1;
+    }
+    return 0;
+}
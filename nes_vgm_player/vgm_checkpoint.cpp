@@ -0,0 +1,102 @@
+/*
+ * vgm_checkpoint.cpp - Resumable snapshots of a headless render
+ */
+#include "vgm_checkpoint.h"
+#include "fnv1a.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// "VGCK" read as a little endian value
+constexpr uint32_t MAGIC = 'V' | ('G' << 8) | ('C' << 16) | ('K' << 24);
+
+static void put(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+static uint64_t get(const uint8_t* p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= uint64_t(p[i]) << (8 * i);
+    return value;
+}
+
+void vgmEncodeCheckpoint(const VgmCheckpoint& checkpoint, std::vector<uint8_t>& out)
+{
+    const size_t stateSize = Apu2A03::stateSize();
+    out.clear();
+    put(out, MAGIC, 4);
+    put(out, VGM_CHECKPOINT_VERSION, 2);
+    put(out, stateSize, 2);
+    put(out, checkpoint.command, 8);
+    put(out, checkpoint.position, 8);
+    put(out, checkpoint.outputBytes, 8);
+    put(out, checkpoint.track.size(), 2);
+    out.insert(out.end(), checkpoint.track.begin(), checkpoint.track.end());
+    put(out, checkpoint.chipCount, 1);
+    for (int chip = 0; chip < checkpoint.chipCount; chip++) {
+        out.resize(out.size() + stateSize);
+        checkpoint.chips[chip].writeState(out.data() + out.size() - stateSize);
+    }
+    put(out, fnv1a64(out.data(), out.size()), 8);
+}
+
+bool vgmDecodeCheckpoint(const uint8_t* data, size_t size, VgmCheckpoint& checkpoint)
+{
+    // Magic, version, state size, command, position, output bytes, track length
+    const size_t fixedSize = 4 + 2 + 2 + 8 + 8 + 8 + 2;
+    if (size < fixedSize + 1 + 8 || get(data, 4) != MAGIC) return false;
+    if (get(data + size - 8, 8) != fnv1a64(data, size - 8)) return false;
+    const size_t stateSize = Apu2A03::stateSize();
+    if (get(data + 4, 2) != VGM_CHECKPOINT_VERSION || get(data + 6, 2) != stateSize) return false;
+
+    const size_t trackSize = get(data + 32, 2);
+    const uint8_t* p = data + fixedSize;
+    if (fixedSize + trackSize + 1 + 8 > size) return false;
+    const int chipCount = p[trackSize];
+    if (chipCount < 1 || chipCount > 2 || fixedSize + trackSize + 1 + chipCount * stateSize + 8 != size) return false;
+
+    checkpoint.command = get(data + 8, 8);
+    checkpoint.position = get(data + 16, 8);
+    checkpoint.outputBytes = get(data + 24, 8);
+    checkpoint.track.assign(reinterpret_cast<const char*>(p), trackSize);
+    checkpoint.chipCount = chipCount;
+    p += trackSize + 1;
+    for (int chip = 0; chip < chipCount; chip++, p += stateSize) checkpoint.chips[chip].readState(p);
+    return true;
+}
+
+bool vgmSaveCheckpoint(const std::string& path, const std::vector<uint8_t>& encoded)
+{
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream f(temporary, std::ios::binary | std::ios::trunc);
+        f.write(reinterpret_cast<const char*>(encoded.data()), std::streamsize(encoded.size()));
+        if (!f) {
+            std::cerr << "Failed to write checkpoint " << temporary << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        std::cerr << "Failed to replace checkpoint " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool vgmLoadCheckpoint(const std::string& path, VgmCheckpoint& checkpoint)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    if (!vgmDecodeCheckpoint(data.data(), data.size(), checkpoint)) {
+        std::cerr << "Ignoring damaged or incompatible checkpoint " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * vgm_checkpoint.h - Resumable snapshots of a headless render
+ *
+ * A checkpoint records the track being rendered, the position in its command
+ * stream, the emulation state of its chip(s) and how much output has been
+ * written, so a render that is killed can continue from the last checkpoint
+ * instead of starting over. Encoding (little endian, a few hundred bytes):
+ *   "VGCK", uint16 version, uint16 APU state size,
+ *   uint64 command index, uint64 position in samples, uint64 output bytes,
+ *   uint16 track length, track, uint8 chip count, APU state per chip,
+ *   uint64 FNV-1a of all bytes before it
+ * Checkpoints of another version or APU state size are rejected.
+ */
+#ifndef VGM_CHECKPOINT_H
+#define VGM_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "apu2A03.h"
+
+constexpr uint16_t VGM_CHECKPOINT_VERSION = 1;
+
+struct VgmCheckpoint
+{
+    std::string track;          // path of the track
+    uint64_t command = 0;       // index of the next command (VGM)
+    uint64_t position = 0;      // samples rendered before it
+    uint64_t outputBytes = 0;   // size of the output file up to this point
+    int chipCount = 1;
+    Apu2A03 chips[2];
+};
+
+// Encodes into 'out', reusing its memory
+void vgmEncodeCheckpoint(const VgmCheckpoint& checkpoint, std::vector<uint8_t>& out);
+bool vgmDecodeCheckpoint(const uint8_t* data, size_t size, VgmCheckpoint& checkpoint);
+
+// Replaces the file atomically (write to a temporary file, then rename), so a
+// render killed while saving still finds the previous checkpoint
+bool vgmSaveCheckpoint(const std::string& path, const std::vector<uint8_t>& encoded);
+// Returns false if there is no checkpoint, reports a damaged one
+bool vgmLoadCheckpoint(const std::string& path, VgmCheckpoint& checkpoint);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * vgm_chips.cpp - The APU(s) a VGM stream plays on
+ */
+#include "vgm_chips.h"
+#include "realtime.h"
+#include "vgm_render.h"
+
+#include <algorithm>
+
+VgmChips::VgmChips(Apu2A03& primary, bool dual, bool threaded, int workerPriority)
+    : primary(primary), workerPriority(workerPriority)
+{
+    clearMemory();
+    if (!dual) return;
+
+    secondary = std::make_unique<Apu2A03>();
+    secondary->connectBus(&bus);
+    secondary->connectCPU(&cpu);
+    bus.clearDataMemory();
+    vgmResetApu(*secondary);
+    // The outputs are mixed sample by sample: samples the primary still holds
+    // go out unmixed, then both chips generate their samples at the same cycles
+    primary.flushAudioBuffer();
+    secondary->alignSampleClock(primary);
+
+    output_callback = primary.outputCallback();
+    output_userdata = primary.outputUserdata();
+    const size_t longestWait = 0xFFFF + AUDIO_BUFFER_SIZE;
+    pending[0].reserve(longestWait);
+    pending[1].reserve(longestWait);
+    mixed.reserve(longestWait);
+    primary.setOutputCallback(collect, &pending[0]);
+    secondary->setOutputCallback(collect, &pending[1]);
+
+    if (threaded) worker = std::thread(&VgmChips::workerLoop, this);
+}
+
+VgmChips::~VgmChips()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            workerStop = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+    if (secondary) primary.setOutputCallback(output_callback, output_userdata);
+}
+
+void VgmChips::apply(const VgmCommand& cmd)
+{
+    if (!secondary) {
+        // Writes to a second chip the file does not declare are ignored
+        if (cmd.type != VgmCommand::Type::APU_WRITE || cmd.chip == 0) vgmApplyCommand(primary, cmd);
+        return;
+    }
+
+    switch (cmd.type) {
+    case VgmCommand::Type::APU_WRITE:
+        vgmApplyCommand(cmd.chip ? *secondary : primary, cmd);
+        break;
+    case VgmCommand::Type::WAIT:
+        // Both chips run on the primary's timing
+        clockBoth(primary.waitCycles(cmd.samples));
+        mixPending();
+        break;
+    default:
+        break;
+    }
+}
+
+void VgmChips::flush()
+{
+    primary.flushAudioBuffer();
+    if (!secondary) return;
+    secondary->flushAudioBuffer();
+    mixPending();
+}
+
+void VgmChips::writeMemory(const uint8_t* block, size_t size)
+{
+    if (Bus* primaryBus = primary.connectedBus()) vgmWriteRam(*primaryBus, block, size);
+    if (secondary) vgmWriteRam(bus, block, size);
+}
+
+void VgmChips::clearMemory()
+{
+    if (Bus* primaryBus = primary.connectedBus()) primaryBus->clearDataMemory();
+    if (secondary) bus.clearDataMemory();
+}
+
+void VgmChips::reset()
+{
+    vgmResetApu(primary);
+    if (!secondary) return;
+    vgmResetApu(*secondary);
+    pending[0].clear();
+    pending[1].clear();
+}
+
+void VgmChips::saveState(Apu2A03 (&states)[2]) const
+{
+    states[0] = primary;
+    if (secondary) states[1] = *secondary;
+}
+
+void VgmChips::restoreState(const Apu2A03 (&states)[2])
+{
+    primary.restoreState(states[0]);
+    if (!secondary) return;
+    secondary->restoreState(states[1]);
+    pending[0].clear();
+    pending[1].clear();
+}
+
+void VgmChips::collect(void* userdata, const uint8_t* buf, int len)
+{
+    auto out = static_cast<std::vector<uint8_t>*>(userdata);
+    out->insert(out->end(), buf, buf + len);
+}
+
+// Both chips generate their samples at the same cycles, so after clocking
+// both the pending buffers hold the same number of samples
+void VgmChips::mixPending()
+{
+    size_t count = std::min(pending[0].size(), pending[1].size());
+    if (count == 0) return;
+
+    mixed.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t val = pending[0][i] + pending[1][i];
+        mixed[i] = val > 255 ? 255 : uint8_t(val);
+    }
+    pending[0].erase(pending[0].begin(), pending[0].begin() + count);
+    pending[1].erase(pending[1].begin(), pending[1].begin() + count);
+    if (output_callback) output_callback(output_userdata, mixed.data(), int(count));
+}
+
+void VgmChips::clockBoth(uint32_t cycles)
+{
+    if (!worker.joinable()) {
+        primary.clock(cycles);
+        secondary->clock(cycles);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workerCycles = cycles;
+        workerBusy = true;
+    }
+    cv.notify_all();
+    primary.clock(cycles);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !workerBusy; });
+}
+
+void VgmChips::workerLoop()
+{
+    // The calling thread waits for this one at every wait: a lower priority
+    // than the caller's would stall it (priority inversion)
+    if (workerPriority > 0) setRealtimePriority(workerPriority);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return workerBusy || workerStop; });
+        if (workerStop) return;
+
+        uint32_t cycles = workerCycles;
+        lock.unlock();
+        secondary->clock(cycles);
+        lock.lock();
+        workerBusy = false;
+        cv.notify_all();
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * vgm_chips.h - The APU(s) a VGM stream plays on
+ *
+ * Dual-chip files (bit 30 of the NES APU clock field) address a second 2A03
+ * through bit 7 of the register byte. The second chip gets its own APU, both
+ * are clocked for every wait and their outputs are summed (clamped like the
+ * APU mixer does). Optionally the second chip is clocked on a worker thread
+ * while the first one runs on the calling thread.
+ */
+#ifndef VGM_CHIPS_H
+#define VGM_CHIPS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "apu2A03.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include "vgm_file.h"
+
+class VgmChips {
+public:
+    // For single-chip files all commands go straight to 'primary'. For dual-chip
+    // files the primary's output callback is taken over until destruction and
+    // receives the mixed output of both chips instead. 'workerPriority' runs
+    // the worker of a threaded dual-chip file under SCHED_FIFO (0: normal
+    // priority), see realtime.h.
+    VgmChips(Apu2A03& primary, bool dual, bool threaded, int workerPriority = 0);
+    ~VgmChips();
+    VgmChips(const VgmChips&) = delete;
+    VgmChips& operator=(const VgmChips&) = delete;
+
+    bool isDual() const { return secondary != nullptr; }
+    // Executes an APU_WRITE or WAIT command on the chip(s) it addresses
+    void apply(const VgmCommand& cmd);
+    // Emits the samples still buffered in the APU(s)
+    void flush();
+    // Back to the power-on register state for playing the stream from the start
+    void reset();
+    // Applies an NES RAM write block (16-bit start address, data) to the
+    // memory the DMC of each chip reads from
+    void writeMemory(const uint8_t* block, size_t size);
+    // Zeroes that memory again
+    void clearMemory();
+    // Emulation state of the chip(s) between commands, for seeking. states[1]
+    // is only used for dual-chip files.
+    void saveState(Apu2A03 (&states)[2]) const;
+    void restoreState(const Apu2A03 (&states)[2]);
+
+private:
+    static void collect(void* userdata, const uint8_t* buf, int len);
+    void mixPending();
+    void clockBoth(uint32_t cycles);
+    void workerLoop();
+
+    Apu2A03& primary;
+    AudioOutputCallback output_callback = nullptr;
+    void* output_userdata = nullptr;
+
+    std::unique_ptr<Apu2A03> secondary;
+    Bus bus;
+    Cpu6502 cpu;
+
+    // Output of each chip that has not been mixed yet. Each APU only appends
+    // to its own buffer, mixing happens once both chips have been clocked.
+    // Reserved for the longest wait, so that playing does not allocate.
+    std::vector<uint8_t> pending[2];
+    std::vector<uint8_t> mixed;
+
+    // Worker clocking the second chip
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int workerPriority = 0;
+    uint32_t workerCycles = 0;
+    bool workerBusy = false;
+    bool workerStop = false;
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * vgm_data_blocks.cpp - Decoding and sharing of VGM data blocks
+ */
+#include "vgm_data_blocks.h"
+#include "fnv1a.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Compressed block header: compression type, uncompressed size, bits
+// decompressed, bits compressed, sub-type (n-bit) and a 16-bit value
+constexpr size_t COMPRESSED_HEADER_SIZE = 10;
+constexpr uint8_t COMPRESSION_NBIT = 0x00;
+constexpr uint8_t COMPRESSION_DPCM = 0x01;
+constexpr uint8_t NBIT_COPY = 0x00;
+constexpr uint8_t NBIT_SHIFT_LEFT = 0x01;
+constexpr uint8_t NBIT_TABLE = 0x02;
+// Table header: compression type, sub-type, bits decompressed, bits compressed, value count
+constexpr size_t TABLE_HEADER_SIZE = 6;
+// Expired cache entries are pruned every this many insertions
+constexpr size_t PRUNE_INTERVAL = 64;
+
+static uint32_t read16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t read32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+// Reads bit fields most significant bit first
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    bool read(int bits, uint32_t& value)
+    {
+        value = 0;
+        for (int i = 0; i < bits; i++) {
+            if (pos >= size) return false;
+            value = (value << 1) | ((data[pos] >> (7 - bit)) & 1);
+            if (++bit == 8) {
+                bit = 0;
+                pos++;
+            }
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    int bit = 0;
+};
+
+bool vgmDecompressBlock(const uint8_t* payload, size_t size, const std::vector<uint8_t>* table, std::vector<uint8_t>& out)
+{
+    if (size < COMPRESSED_HEADER_SIZE) {
+        std::cerr << "Truncated compressed data block\n";
+        return false;
+    }
+    const uint8_t compression = payload[0];
+    const uint32_t outSize = read32(payload + 1);
+    const int bitsOut = payload[5];
+    const int bitsIn = payload[6];
+    const uint8_t subType = payload[7];
+    const uint32_t value = read16(payload + 8);
+    const int bytesOut = (bitsOut + 7) / 8;
+    if (bitsOut < 1 || bitsOut > 16 || bitsIn < 1 || bitsIn > 16 || compression > COMPRESSION_DPCM ||
+        (compression == COMPRESSION_NBIT && subType > NBIT_TABLE)) {
+        std::cerr << "Unsupported data block compression " << int(compression) << "/" << int(subType) << "\n";
+        return false;
+    }
+
+    // DPCM and n-bit table compression map every compressed value through the table
+    const bool useTable = compression == COMPRESSION_DPCM || subType == NBIT_TABLE;
+    const uint8_t* entries = nullptr;
+    size_t entryCount = 0;
+    int entryBytes = 0;
+    if (useTable) {
+        if (!table || table->size() < TABLE_HEADER_SIZE || (*table)[0] != compression) {
+            std::cerr << "Compressed data block without a matching decompression table\n";
+            return false;
+        }
+        entryBytes = ((*table)[2] + 7) / 8;
+        entryCount = std::min<size_t>(read16(table->data() + 4), (table->size() - TABLE_HEADER_SIZE) / entryBytes);
+        entries = table->data() + TABLE_HEADER_SIZE;
+    }
+    auto tableValue = [&](uint32_t index) -> uint32_t {
+        if (index >= entryCount) return 0;
+        const uint8_t* e = entries + index * entryBytes;
+        return entryBytes == 1 ? e[0] : read16(e);
+    };
+
+    out.clear();
+    out.reserve(outSize);
+    BitReader bits(payload + COMPRESSED_HEADER_SIZE, size - COMPRESSED_HEADER_SIZE);
+    const uint32_t mask = (1u << bitsOut) - 1;
+    uint32_t state = value;     // DPCM: running value, starting at the start value
+    uint32_t in;
+    while (out.size() + bytesOut <= outSize && bits.read(bitsIn, in)) {
+        uint32_t sample;
+        if (compression == COMPRESSION_DPCM) {
+            state = (state + tableValue(in)) & mask;
+            sample = state;
+        } else if (subType == NBIT_COPY) {
+            sample = in + value;
+        } else if (subType == NBIT_SHIFT_LEFT) {
+            sample = (in << (bitsOut - bitsIn)) + value;
+        } else {
+            sample = tableValue(in) + value;
+        }
+        out.push_back(uint8_t(sample));
+        if (bytesOut == 2) out.push_back(uint8_t(sample >> 8));
+    }
+    return true;
+}
+
+VgmBlockData VgmBlockCache::get(uint8_t type, const uint8_t* payload, size_t size, const std::vector<uint8_t>* table)
+{
+    const bool compressed = type >= VGM_BLOCK_COMPRESSED_FIRST && type <= VGM_BLOCK_COMPRESSED_LAST;
+    uint64_t key = fnv1a64(&type, 1);
+    key = fnv1a64(payload, size, key);
+    if (compressed && table) key = fnv1a64(table->data(), table->size(), key);
+
+    const bool hasTable = compressed && table;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [first, last] = blocks.equal_range(key);
+    for (auto it = first; it != last; ++it) {
+        const Entry& entry = it->second;
+        auto data = entry.data.lock();
+        if (!data || entry.type != type) continue;
+        const bool same = compressed
+            ? entry.payload.size() == size && std::memcmp(entry.payload.data(), payload, size) == 0 &&
+              entry.hasTable == hasTable && (!hasTable || entry.table == *table)
+            : data->size() == size && std::memcmp(data->data(), payload, size) == 0;
+        if (same) {
+            shareCount++;
+            return data;
+        }
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    Entry entry;
+    entry.type = type;
+    if (compressed) {
+        if (!vgmDecompressBlock(payload, size, table, *data)) return nullptr;
+        decodeCount++;
+        entry.payload.assign(payload, payload + size);
+        if (hasTable) entry.table = *table;
+        entry.hasTable = hasTable;
+    } else {
+        data->assign(payload, payload + size);
+    }
+    entry.data = data;
+    blocks.emplace(key, std::move(entry));
+    if (blocks.size() % PRUNE_INTERVAL == 0) prune();
+    return data;
+}
+
+void VgmBlockCache::prune()
+{
+    for (auto it = blocks.begin(); it != blocks.end();) {
+        if (it->second.data.expired()) it = blocks.erase(it);
+        else ++it;
+    }
+}
+
+size_t VgmBlockCache::memoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (const auto& [key, entry] : blocks) {
+        if (auto data = entry.data.lock()) {
+            bytes += sizeof(*data) + data->capacity() + entry.payload.capacity() + entry.table.capacity();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,67 @@
+/*
+ * vgm_data_blocks.h - Decoding and sharing of VGM data blocks
+ *
+ * Data blocks (command 0x67) are decoded once when a file is loaded:
+ * compressed stream data (types 0x40-0x7E) is decompressed with the
+ * bit packing or DPCM scheme of its header, using the most recent
+ * decompression table (type 0x7F) where needed. The decoded contents are
+ * kept in a cache keyed by a hash of the encoded block, so identical blocks
+ * of different tracks (e.g. the DPCM samples of an album) share a single
+ * copy, which every APU reading from it uses. A hash match is only shared
+ * after the block has been compared with the cached one.
+ */
+#ifndef VGM_DATA_BLOCKS_H
+#define VGM_DATA_BLOCKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint8_t VGM_BLOCK_COMPRESSED_FIRST = 0x40;
+constexpr uint8_t VGM_BLOCK_COMPRESSED_LAST = 0x7E;
+constexpr uint8_t VGM_BLOCK_DECOMPRESSION_TABLE = 0x7F;
+
+using VgmBlockData = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Decompresses the payload of a compressed block. 'table' is the payload of
+// the last decompression table block (nullptr if there was none). Returns
+// false (and reports) for unsupported or truncated blocks.
+bool vgmDecompressBlock(const uint8_t* payload, size_t size, const std::vector<uint8_t>* table, std::vector<uint8_t>& out);
+
+class VgmBlockCache {
+public:
+    // Decoded contents of a block: compressed blocks are decompressed, other
+    // blocks are used as they are. Blocks with equal contents (and table) are
+    // decoded once and shared while any track holds them.
+    VgmBlockData get(uint8_t type, const uint8_t* payload, size_t size, const std::vector<uint8_t>* table);
+
+    size_t memoryBytes() const;
+    uint64_t decoded() const { return decodeCount; }
+    uint64_t shared() const { return shareCount; }
+
+private:
+    struct Entry
+    {
+        uint8_t type = 0;
+        // Compressed blocks keep their encoded payload and table for the
+        // comparison, the decoded data of other blocks is their payload
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> table;
+        bool hasTable = false;
+        std::weak_ptr<const std::vector<uint8_t>> data;
+    };
+
+    // Expired entries are dropped from time to time
+    void prune();
+
+    mutable std::mutex mutex;
+    // Blocks whose hashes collide are kept side by side
+    std::unordered_multimap<uint64_t, Entry> blocks;
+    uint64_t decodeCount = 0;
+    uint64_t shareCount = 0;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * vgm_file.cpp - VGM (Video Game Music) file loading and command decoding
+ */
+#include "vgm_file.h"
+
+#include <fstream>
+#include <iostream>
+
+bool VgmFile::load(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        std::cerr << "Failed to open VGM file: " << path << "\n";
+        return false;
+    }
+
+    f.seekg(0, std::ios::end);
+    size_t size = f.tellg();
+    f.seekg(0, std::ios::beg);
+
+    data.resize(size);
+    f.read(reinterpret_cast<char*>(data.data()), size);
+    if (!f) {
+        std::cerr << "Failed to read VGM file\n";
+        data.clear();
+        return false;
+    }
+
+    return validate();
+}
+
+bool VgmFile::loadFromMemory(std::vector<uint8_t> bytes) {
+    data = std::move(bytes);
+    return validate();
+}
+
+bool VgmFile::validate() {
+    // Check VGM signature
+    if (data.size() < 0x40 || std::string(reinterpret_cast<char*>(&data[0]), 4) != "Vgm ") {
+        std::cerr << "Invalid VGM header\n";
+        data.clear();
+        return false;
+    }
+
+    // Data offset (relative to 0x34 + value)
+    uint32_t dataOffsetField = read32(VGM_DATA_OFFSET);
+    dataStart = dataOffsetField ? (VGM_DATA_OFFSET + dataOffsetField) : 0x40;
+
+    if (dataStart >= data.size()) {
+        std::cerr << "Invalid data offset\n";
+        data.clear();
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t VgmFile::read32(size_t offset) const {
+    if (offset + 4 > data.size()) return 0;
+    return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (uint32_t(data[offset + 3]) << 24);
+}
+
+size_t VgmFile::relativeField(size_t offset) const {
+    uint32_t value = read32(offset);
+    return value ? offset + value : 0;
+}
+
+bool VgmFile::parseCommand(size_t pos, VgmCommand& cmd) const {
+    const size_t end = data.size();
+    if (pos >= end) {
+        std::cerr << "Unexpected end of VGM data\n";
+        return false;
+    }
+
+    cmd = VgmCommand{};
+    cmd.opcode = data[pos];
+    cmd.length = 1;
+
+    switch (cmd.opcode) {
+    case 0x66: // End of sound data
+        cmd.type = VgmCommand::Type::END;
+        return true;
+
+    case 0xB4: // NES APU write, bit 7 of the register selects the second chip
+        if (pos + 3 > end) return false;
+        cmd.type = VgmCommand::Type::APU_WRITE;
+        cmd.chip = data[pos + 1] >> 7;
+        cmd.reg = data[pos + 1] & 0x7F;
+        cmd.value = data[pos + 2];
+        cmd.length = 3;
+        return true;
+
+    case 0x61: // wait n samples
+        if (pos + 3 > end) return false;
+        cmd.type = VgmCommand::Type::WAIT;
+        cmd.samples = data[pos + 1] | (data[pos + 2] << 8);
+        cmd.length = 3;
+        return true;
+
+    case 0x62: // wait 735 samples (60 Hz)
+        cmd.type = VgmCommand::Type::WAIT;
+        cmd.samples = 735;
+        return true;
+
+    case 0x63: // wait 882 samples (50 Hz)
+        cmd.type = VgmCommand::Type::WAIT;
+        cmd.samples = 882;
+        return true;
+
+    case 0x67: // Data block: 0x67 0x66 tt ss ss ss ss <data>
+        if (pos + 7 > end) return false;
+        cmd.type = VgmCommand::Type::DATA_BLOCK;
+        cmd.blockType = data[pos + 2];
+        cmd.blockSize = read32(pos + 3);
+        cmd.blockData = pos + 7;
+        if (cmd.blockData + cmd.blockSize > end) return false;
+        cmd.length = 7 + cmd.blockSize;
+        return true;
+
+    default:
+        if (cmd.opcode >= 0x70 && cmd.opcode <= 0x7F) {
+            // wait (n+1) samples
+            cmd.type = VgmCommand::Type::WAIT;
+            cmd.samples = (cmd.opcode & 0x0F) + 1;
+            return true;
+        }
+        std::cerr << "Unknown VGM command: 0x"
+                << std::hex << (int)cmd.opcode << std::dec << "\n";
+        return false;
+    }
+}
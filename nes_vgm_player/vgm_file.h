@@ -0,0 +1,71 @@
+/*
+ * vgm_file.h - VGM (Video Game Music) file loading and command decoding
+ */
+#ifndef VGM_FILE_H
+#define VGM_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Header fields (offsets are relative to the start of the file)
+constexpr size_t VGM_EOF_OFFSET = 0x04;
+constexpr size_t VGM_GD3_OFFSET = 0x14;
+constexpr size_t VGM_TOTAL_SAMPLES = 0x18;
+constexpr size_t VGM_LOOP_OFFSET = 0x1C;
+constexpr size_t VGM_DATA_OFFSET = 0x34;
+constexpr size_t VGM_NES_APU_CLOCK = 0x84;
+
+// Bit 30 of a chip clock field: the file uses two chips of that type
+constexpr uint32_t VGM_DUAL_CHIP_FLAG = 0x40000000;
+
+// Data block types the NES APU can consume
+constexpr uint8_t VGM_BLOCK_NES_RAM_WRITE = 0xC2;
+
+struct VgmCommand
+{
+    enum class Type { APU_WRITE, WAIT, DATA_BLOCK, END };
+
+    Type type = Type::END;
+    uint8_t opcode = 0;
+    size_t length = 0;        // encoded size in bytes, including the opcode
+    uint8_t chip = 0;         // APU_WRITE: 0 = first APU, 1 = second APU (dual-chip files)
+    uint8_t reg = 0;          // APU_WRITE: register offset from 0x4000
+    uint8_t value = 0;        // APU_WRITE: register value
+    uint32_t samples = 0;     // WAIT: number of 44.1 kHz samples
+    uint8_t blockType = 0;    // DATA_BLOCK: block type
+    size_t blockData = 0;     // DATA_BLOCK: file offset of the payload
+    uint32_t blockSize = 0;   // DATA_BLOCK: payload size
+};
+
+class VgmFile {
+public:
+    bool load(const std::string& path);
+    bool loadFromMemory(std::vector<uint8_t> bytes);
+
+    bool empty() const { return data.empty(); }
+    const std::vector<uint8_t>& bytes() const { return data; }
+    size_t dataOffset() const { return dataStart; }
+    // Absolute offsets, 0 if the file has no loop point / GD3 tag
+    size_t loopOffset() const { return relativeField(VGM_LOOP_OFFSET); }
+    size_t gd3Offset() const { return relativeField(VGM_GD3_OFFSET); }
+    uint32_t totalSamples() const { return read32(VGM_TOTAL_SAMPLES); }
+    // 0 if the header is too old to carry the NES APU clock
+    uint32_t nesApuClock() const { return dataStart >= VGM_NES_APU_CLOCK + 4 ? read32(VGM_NES_APU_CLOCK) : 0; }
+    bool isDualChip() const { return (nesApuClock() & VGM_DUAL_CHIP_FLAG) != 0; }
+
+    // Decodes the command at pos. Returns false (and reports) on malformed or unknown commands.
+    bool parseCommand(size_t pos, VgmCommand& cmd) const;
+
+    uint32_t read32(size_t offset) const;
+
+private:
+    bool validate();
+    size_t relativeField(size_t offset) const;
+
+    std::vector<uint8_t> data;
+    size_t dataStart = 0;
+};
+
+#endif
@@ -0,0 +1,372 @@
+/*
+ * vgm_optimize.cpp - Offline VGM stream optimizer
+ *
+ * Rewrites a VGM file so that the player has less to decode while the rendered
+ * PCM stays bit-identical:
+ *  - APU writes that provably leave the APU state unchanged are dropped
+ *  - adjacent waits are merged (the APU carries the fraction of a cycle from
+ *    wait to wait, so a merged wait clocks it for exactly the same cycles)
+ *  - data blocks no APU channel can ever read are stripped
+ * Both streams are rendered afterwards and the output is only written if the
+ * PCM matches.
+ */
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "apu2A03.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include "vgm_file.h"
+#include "vgm_render.h"
+
+using namespace std;
+
+struct Stats
+{
+    size_t writes = 0;
+    size_t droppedWrites = 0;
+    size_t waits = 0;
+    size_t emittedWaits = 0;
+    size_t blocks = 0;
+    size_t droppedBlocks = 0;
+};
+
+struct DecodedCommand
+{
+    size_t offset;
+    VgmCommand cmd;
+};
+
+static bool decodeStream(const VgmFile& vgm, vector<DecodedCommand>& commands)
+{
+    size_t pos = vgm.dataOffset();
+    const size_t end = vgm.bytes().size();
+    while (pos < end) {
+        DecodedCommand dc{pos, {}};
+        if (!vgm.parseCommand(pos, dc.cmd)) return false;
+        commands.push_back(dc);
+        pos += dc.cmd.length;
+        if (dc.cmd.type == VgmCommand::Type::END) return true;
+    }
+    // Streams without an end command are terminated by the end of the file
+    commands.push_back({pos, VgmCommand{}});
+    return true;
+}
+
+// Runs the stream on shadow APUs (one per chip) starting at index 'first' and
+// marks every write that leaves the complete state of its APU unchanged.
+// Writes to a second chip of a single-chip file are ignored by the players.
+// RAM write blocks go to the shadow buses like in the players, so the DMC
+// fetches the same samples; a trial copy of an APU shares its chip's bus.
+static void markNoopWrites(const VgmFile& vgm, const vector<DecodedCommand>& commands, size_t first, Apu2A03 (&apu)[2], bool dual,
+    vector<bool>& noop)
+{
+    for (size_t i = first; i < commands.size(); i++) {
+        const VgmCommand& cmd = commands[i].cmd;
+        if (cmd.type == VgmCommand::Type::APU_WRITE) {
+            if (cmd.chip && !dual) {
+                noop[i] = true;
+                continue;
+            }
+            Apu2A03& chip = apu[cmd.chip];
+            Apu2A03 after = chip;
+            vgmApplyCommand(after, cmd);
+            noop[i] = (after == chip);
+            if (!noop[i]) chip = after;
+        } else if (cmd.type == VgmCommand::Type::DATA_BLOCK && cmd.blockType == VGM_BLOCK_NES_RAM_WRITE) {
+            vgmWriteRam(*apu[0].connectedBus(), vgm.bytes().data() + cmd.blockData, cmd.blockSize);
+            if (dual) vgmWriteRam(*apu[1].connectedBus(), vgm.bytes().data() + cmd.blockData, cmd.blockSize);
+        } else {
+            vgmApplyCommand(apu[0], cmd);
+            if (dual) vgmApplyCommand(apu[1], cmd);
+        }
+    }
+}
+
+// DMC sample ranges ($4012/$4013) the stream can make the APU fetch from
+static vector<pair<uint32_t, uint32_t>> collectDmcRanges(const vector<DecodedCommand>& commands)
+{
+    vector<pair<uint32_t, uint32_t>> ranges;
+    uint8_t address[2] = {};
+    uint8_t length[2] = {};
+    for (const auto& dc : commands) {
+        const VgmCommand& cmd = dc.cmd;
+        if (cmd.type != VgmCommand::Type::APU_WRITE) continue;
+        if (cmd.reg == 0x12) address[cmd.chip] = cmd.value;
+        else if (cmd.reg == 0x13) length[cmd.chip] = cmd.value;
+        else if (cmd.reg != 0x15 || !(cmd.value & 0x10)) continue;
+
+        uint32_t start = 0xC000 | (uint32_t(address[cmd.chip]) << 6);
+        ranges.emplace_back(start, start + (uint32_t(length[cmd.chip]) << 4) + 1);
+    }
+    return ranges;
+}
+
+static bool isBlockReferenced(const VgmFile& vgm, const VgmCommand& cmd, const vector<pair<uint32_t, uint32_t>>& dmcRanges)
+{
+    // RAM writes are the only blocks that end up in memory the APU reads from
+    if (cmd.blockType != VGM_BLOCK_NES_RAM_WRITE || cmd.blockSize < 2) return false;
+
+    const auto& data = vgm.bytes();
+    uint32_t start = data[cmd.blockData] | (data[cmd.blockData + 1] << 8);
+    uint32_t end = start + cmd.blockSize - 2;
+    for (const auto& range : dmcRanges) {
+        if (start < range.second && range.first < end) return true;
+    }
+    return false;
+}
+
+static void put32(vector<uint8_t>& out, size_t offset, uint32_t value)
+{
+    out[offset] = value & 0xFF;
+    out[offset + 1] = (value >> 8) & 0xFF;
+    out[offset + 2] = (value >> 16) & 0xFF;
+    out[offset + 3] = (value >> 24) & 0xFF;
+}
+
+static void emitWait(vector<uint8_t>& out, uint32_t samples, Stats& stats)
+{
+    if (samples == 0) return;
+    stats.emittedWaits++;
+    if (samples == 735) {
+        out.push_back(0x62);
+    } else if (samples == 882) {
+        out.push_back(0x63);
+    } else if (samples <= 16) {
+        out.push_back(0x70 + (samples - 1));
+    } else {
+        out.push_back(0x61);
+        out.push_back(samples & 0xFF);
+        out.push_back((samples >> 8) & 0xFF);
+    }
+}
+
+static bool optimize(const VgmFile& vgm, vector<uint8_t>& out, Stats& stats)
+{
+    vector<DecodedCommand> commands;
+    if (!decodeStream(vgm, commands)) return false;
+
+    const auto& data = vgm.bytes();
+    const size_t loopOffset = vgm.loopOffset();
+    size_t loopIndex = commands.size();
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (commands[i].offset == loopOffset) loopIndex = i;
+    }
+
+    // A write inside the loop body is only dropped if it is also a no-op when
+    // the loop is entered again with the state from the end of the stream.
+    Bus bus[2];
+    Cpu6502 cpu[2];
+    Apu2A03 apu[2];
+    for (int chip = 0; chip < 2; chip++) {
+        bus[chip].clearDataMemory();
+        apu[chip].connectBus(&bus[chip]);
+        apu[chip].connectCPU(&cpu[chip]);
+        vgmResetApu(apu[chip]);
+    }
+    const bool dual = vgm.isDualChip();
+    vector<bool> noop(commands.size(), false);
+    markNoopWrites(vgm, commands, 0, apu, dual, noop);
+    if (loopIndex < commands.size()) {
+        vector<bool> noopLooped(commands.size(), false);
+        markNoopWrites(vgm, commands, loopIndex, apu, dual, noopLooped);
+        for (size_t i = loopIndex; i < commands.size(); i++) noop[i] = noop[i] && noopLooped[i];
+    }
+
+    const auto dmcRanges = collectDmcRanges(commands);
+
+    out.assign(data.begin(), data.begin() + vgm.dataOffset());
+    size_t newLoopOffset = 0;
+    uint32_t pendingSamples = 0;
+    for (size_t i = 0; i < commands.size(); i++) {
+        const VgmCommand& cmd = commands[i].cmd;
+        if (i == loopIndex) {
+            emitWait(out, pendingSamples, stats);
+            pendingSamples = 0;
+            newLoopOffset = out.size();
+        }
+
+        switch (cmd.type) {
+        case VgmCommand::Type::APU_WRITE:
+            stats.writes++;
+            if (noop[i]) {
+                stats.droppedWrites++;
+                break;
+            }
+            emitWait(out, pendingSamples, stats);
+            pendingSamples = 0;
+            out.insert(out.end(), { 0xB4, uint8_t(cmd.reg | (cmd.chip << 7)), cmd.value });
+            break;
+
+        case VgmCommand::Type::WAIT: {
+            stats.waits++;
+            if (pendingSamples + cmd.samples > 0xFFFF) {
+                emitWait(out, pendingSamples, stats);
+                pendingSamples = 0;
+            }
+            pendingSamples += cmd.samples;
+            break;
+        }
+
+        case VgmCommand::Type::DATA_BLOCK:
+            stats.blocks++;
+            if (!isBlockReferenced(vgm, cmd, dmcRanges)) {
+                stats.droppedBlocks++;
+                break;
+            }
+            emitWait(out, pendingSamples, stats);
+            pendingSamples = 0;
+            out.insert(out.end(), data.begin() + commands[i].offset, data.begin() + commands[i].offset + cmd.length);
+            break;
+
+        case VgmCommand::Type::END:
+            emitWait(out, pendingSamples, stats);
+            pendingSamples = 0;
+            out.push_back(0x66);
+            break;
+        }
+    }
+
+    // Carry over the GD3 tag and fix up the header offsets
+    const size_t gd3Offset = vgm.gd3Offset();
+    size_t newGd3Offset = 0;
+    if (gd3Offset && gd3Offset + 12 <= data.size()) {
+        size_t gd3Size = 12 + vgm.read32(gd3Offset + 8);
+        if (gd3Offset + gd3Size <= data.size()) {
+            newGd3Offset = out.size();
+            out.insert(out.end(), data.begin() + gd3Offset, data.begin() + gd3Offset + gd3Size);
+        }
+    }
+    put32(out, VGM_EOF_OFFSET, out.size() - VGM_EOF_OFFSET);
+    put32(out, VGM_GD3_OFFSET, newGd3Offset ? newGd3Offset - VGM_GD3_OFFSET : 0);
+    put32(out, VGM_LOOP_OFFSET, newLoopOffset ? newLoopOffset - VGM_LOOP_OFFSET : 0);
+    return true;
+}
+
+// Optimizes 'input' and renders both streams; false (reported) unless the
+// optimized stream parses and renders to the same PCM
+static bool optimizeVerified(const VgmFile& input, vector<uint8_t>& bytes, Stats& stats, size_t& samples)
+{
+    if (!optimize(input, bytes, stats)) {
+        std::cerr << "Failed to parse VGM stream\n";
+        return false;
+    }
+
+    VgmFile output;
+    if (!output.loadFromMemory(bytes)) {
+        std::cerr << "Optimized stream is not a valid VGM file\n";
+        return false;
+    }
+
+    vector<uint8_t> reference, optimized;
+    if (!vgmRender(input, reference) || !vgmRender(output, optimized)) {
+        std::cerr << "Failed to render VGM stream\n";
+        return false;
+    }
+    if (reference != optimized) {
+        std::cerr << "Rendered PCM differs after optimization, output not written\n";
+        return false;
+    }
+    samples = reference.size();
+    return true;
+}
+
+// A VGM file around the given commands (an end command is appended)
+static vector<uint8_t> buildStream(const vector<uint8_t>& commands, bool dual)
+{
+    const size_t dataStart = 0x100;
+    vector<uint8_t> bytes(dataStart, 0);
+    bytes[0] = 'V'; bytes[1] = 'g'; bytes[2] = 'm'; bytes[3] = ' ';
+    put32(bytes, 0x08, 0x161);  // version 1.61, the first with the NES APU
+    put32(bytes, VGM_DATA_OFFSET, dataStart - VGM_DATA_OFFSET);
+    put32(bytes, VGM_NES_APU_CLOCK, 1789772 | (dual ? VGM_DUAL_CHIP_FLAG : 0));
+    bytes.insert(bytes.end(), commands.begin(), commands.end());
+    bytes.push_back(0x66);
+    put32(bytes, VGM_EOF_OFFSET, bytes.size() - VGM_EOF_OFFSET);
+    return bytes;
+}
+
+// The DMC plays samples of 0xFF from an NES RAM write block, raising its
+// output level; setting the level back to 0 afterwards is only a no-op if the
+// samples are not there. The optimizer has to keep that write.
+static vector<uint8_t> dmcRamBlockCommands(int chips)
+{
+    vector<uint8_t> commands = { 0x67, 0x66, VGM_BLOCK_NES_RAM_WRITE, 19, 0, 0, 0, 0x00, 0xC0 };
+    commands.insert(commands.end(), 17, 0xFF);
+    for (int chip = 0; chip < chips; chip++) {
+        const uint8_t select = uint8_t(chip << 7);
+        // Fastest rate, sample at $C000, 17 bytes, level 0, start
+        commands.insert(commands.end(), { 0xB4, uint8_t(select | 0x10), 0x0F, 0xB4, uint8_t(select | 0x12), 0x00,
+                                          0xB4, uint8_t(select | 0x13), 0x01, 0xB4, uint8_t(select | 0x11), 0x00,
+                                          0xB4, uint8_t(select | 0x15), 0x10 });
+    }
+    commands.insert(commands.end(), { 0x61, 0xD0, 0x07 });
+    for (int chip = 0; chip < chips; chip++) commands.insert(commands.end(), { 0xB4, uint8_t(chip << 7 | 0x11), 0x00 });
+    commands.insert(commands.end(), { 0x61, 0xD0, 0x07 });
+    return commands;
+}
+
+// Runs the streams of the cases a corpus may not cover through the optimizer
+static int selfTest()
+{
+    struct TestCase
+    {
+        const char* name;
+        vector<uint8_t> bytes;
+    };
+    const TestCase cases[] = {
+        { "DMC samples from a RAM write block", buildStream(dmcRamBlockCommands(1), false) },
+        { "DMC samples from a RAM write block, dual chip", buildStream(dmcRamBlockCommands(2), true) },
+    };
+
+    int failures = 0;
+    for (const TestCase& test : cases) {
+        VgmFile input;
+        Stats stats;
+        vector<uint8_t> bytes;
+        size_t samples = 0;
+        const bool ok = input.loadFromMemory(test.bytes) && optimizeVerified(input, bytes, stats, samples);
+        std::cout << (ok ? "ok        " : "FAILED    ") << test.name << "\n";
+        if (!ok) failures++;
+    }
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 2 && string(argv[1]) == "--self-test") return selfTest();
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.vgm> <output.vgm>\n"
+                  << "       " << argv[0] << " --self-test\n";
+        return 1;
+    }
+
+    VgmFile input;
+    if (!input.load(argv[1])) return 1;
+
+    Stats stats;
+    vector<uint8_t> bytes;
+    size_t samples = 0;
+    if (!optimizeVerified(input, bytes, stats, samples)) {
+        std::cerr << "Input: " << argv[1] << "\n";
+        return 1;
+    }
+
+    std::ofstream f(argv[2], std::ios::binary);
+    f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    if (!f) {
+        std::cerr << "Failed to write VGM file: " << argv[2] << "\n";
+        return 1;
+    }
+
+    std::cout << "APU writes:  " << stats.writes << " -> " << stats.writes - stats.droppedWrites << "\n"
+              << "Waits:       " << stats.waits << " -> " << stats.emittedWaits << "\n"
+              << "Data blocks: " << stats.blocks << " -> " << stats.blocks - stats.droppedBlocks << "\n"
+              << "File size:   " << input.bytes().size() << " -> " << bytes.size() << " bytes\n"
+              << "PCM verified: " << samples << " samples identical\n";
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * vgm_render.cpp - Applying VGM commands to the APU and headless rendering
+ */
+#include "vgm_render.h"
+#include "bus.h"
+#include "cpu6502.h"
+#include "vgm_chips.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+
+static const std::array<uint8_t, 20> initialRegisters = {
+    0x30, 0x08, 0x00, 0x00, // Pulse 1
+    0x30, 0x08, 0x00, 0x00, // Pulse 2
+    0x80, 0x00, 0x00, 0x00, // Triangle
+    0x30, 0x00, 0x00, 0x00, // Noise
+    0x00, 0x00, 0x00, 0x00, // DMC
+};
+
+void vgmResetApu(Apu2A03& apu)
+{
+    for (size_t i = 0; i < initialRegisters.size(); i++) {
+        apu.cpuWrite(0x4000 + i, initialRegisters[i]);
+    }
+    // Enable all channels
+    apu.cpuWrite(0x4015, 0x0F);
+    apu.cpuWrite(0x4017, 0x40);
+    apu.resetWaitScheduler();
+}
+
+void vgmResetApu(Apu2A03xN& apu, int lane)
+{
+    for (size_t i = 0; i < initialRegisters.size(); i++) {
+        apu.cpuWrite(lane, 0x4000 + i, initialRegisters[i]);
+    }
+    apu.cpuWrite(lane, 0x4015, 0x0F);
+    apu.cpuWrite(lane, 0x4017, 0x40);
+}
+
+void vgmApplyCommand(Apu2A03& apu, const VgmCommand& cmd)
+{
+    switch (cmd.type) {
+    case VgmCommand::Type::APU_WRITE:
+        apu.cpuWrite(0x4000 + cmd.reg, cmd.value);
+        break;
+    case VgmCommand::Type::WAIT:
+        apu.clock(apu.waitCycles(cmd.samples));
+        break;
+    default:
+        break;
+    }
+}
+
+void vgmWriteRam(Bus& bus, const uint8_t* block, size_t size)
+{
+    if (size < 2) return;
+    bus.writeDataMemory(block[0] | (block[1] << 8), block + 2, size - 2);
+}
+
+static void appendPcm(void* userdata, const uint8_t* buf, int len)
+{
+    auto out = static_cast<std::vector<uint8_t>*>(userdata);
+    out->insert(out->end(), buf, buf + len);
+}
+
+bool vgmRender(const VgmFile& vgm, std::vector<uint8_t>& pcm, bool threadedChips)
+{
+    Bus bus;
+    Cpu6502 cpu;
+    Apu2A03 apu;
+    apu.connectBus(&bus);
+    apu.connectCPU(&cpu);
+    apu.setOutputCallback(appendPcm, &pcm);
+    vgmResetApu(apu);
+    VgmChips chips(apu, vgm.isDualChip(), threadedChips);
+
+    pcm.clear();
+    size_t pos = vgm.dataOffset();
+    const size_t end = vgm.bytes().size();
+    VgmCommand cmd;
+    while (pos < end) {
+        if (!vgm.parseCommand(pos, cmd)) return false;
+        pos += cmd.length;
+        if (cmd.type == VgmCommand::Type::END) break;
+        if (cmd.type == VgmCommand::Type::DATA_BLOCK && cmd.blockType == VGM_BLOCK_NES_RAM_WRITE) {
+            chips.writeMemory(vgm.bytes().data() + cmd.blockData, cmd.blockSize);
+        } else {
+            chips.apply(cmd);
+        }
+    }
+    chips.flush();
+    return true;
+}
+
+// All lanes are clocked in lockstep: every pass runs the commands of each lane
+// up to its next wait and then clocks the APU until the earliest wait is over.
+static bool renderLanes(const VgmFile* const* files, std::vector<uint8_t>* pcm, int count)
+{
+    struct Lane
+    {
+        Bus bus;
+        Cpu6502 cpu;
+        size_t pos = 0;
+        ApuScheduler scheduler;
+        uint32_t pendingCycles = 0;
+        bool active = false;
+    };
+    auto lanes = std::make_unique<std::array<Lane, Apu2A03xN::LANES>>();
+    auto apu = std::make_unique<Apu2A03xN>();
+
+    for (int l = 0; l < count; l++) {
+        Lane& lane = (*lanes)[l];
+        lane.bus.clearDataMemory();
+        apu->connectBus(l, &lane.bus);
+        apu->connectCPU(l, &lane.cpu);
+        apu->setOutputCallback(l, appendPcm, &pcm[l]);
+        vgmResetApu(*apu, l);
+        pcm[l].clear();
+        lane.pos = files[l]->dataOffset();
+        lane.active = true;
+    }
+
+    VgmCommand cmd;
+    while (true) {
+        uint32_t step = UINT32_MAX;
+        for (int l = 0; l < count; l++) {
+            Lane& lane = (*lanes)[l];
+            const VgmFile& vgm = *files[l];
+            while (lane.active && lane.pendingCycles == 0) {
+                if (lane.pos >= vgm.bytes().size()) {
+                    apu->finishLane(l);
+                    lane.active = false;
+                    break;
+                }
+                if (!vgm.parseCommand(lane.pos, cmd)) return false;
+                lane.pos += cmd.length;
+                if (cmd.type == VgmCommand::Type::END) {
+                    apu->finishLane(l);
+                    lane.active = false;
+                } else if (cmd.type == VgmCommand::Type::APU_WRITE && cmd.chip == 0) {
+                    apu->cpuWrite(l, 0x4000 + cmd.reg, cmd.value);
+                } else if (cmd.type == VgmCommand::Type::WAIT) {
+                    lane.pendingCycles = lane.scheduler.cycles(cmd.samples);
+                } else if (cmd.type == VgmCommand::Type::DATA_BLOCK && cmd.blockType == VGM_BLOCK_NES_RAM_WRITE) {
+                    vgmWriteRam(lane.bus, vgm.bytes().data() + cmd.blockData, cmd.blockSize);
+                }
+            }
+            if (lane.active) step = std::min(step, lane.pendingCycles);
+        }
+        if (step == UINT32_MAX) return true;
+
+        apu->clock(step);
+        for (int l = 0; l < count; l++) {
+            if ((*lanes)[l].active) (*lanes)[l].pendingCycles -= step;
+        }
+    }
+}
+
+bool vgmRenderBatch(const std::vector<const VgmFile*>& files, std::vector<std::vector<uint8_t>>& pcm)
+{
+    pcm.assign(files.size(), {});
+    std::vector<const VgmFile*> laneFiles;
+    std::vector<size_t> laneIndex;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (files[i]->isDualChip()) {
+            if (!vgmRender(*files[i], pcm[i])) return false;
+        } else {
+            laneFiles.push_back(files[i]);
+            laneIndex.push_back(i);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> lanePcm(laneFiles.size());
+    for (size_t first = 0; first < laneFiles.size(); first += Apu2A03xN::LANES) {
+        int count = static_cast<int>(std::min<size_t>(Apu2A03xN::LANES, laneFiles.size() - first));
+        if (!renderLanes(&laneFiles[first], &lanePcm[first], count)) return false;
+    }
+    for (size_t i = 0; i < laneFiles.size(); i++) pcm[laneIndex[i]] = std::move(lanePcm[i]);
+    return true;
+}
@@ -0,0 +1,37 @@
+/*
+ * vgm_render.h - Applying VGM commands to the APU and headless rendering
+ */
+#ifndef VGM_RENDER_H
+#define VGM_RENDER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "apu2A03.h"
+#include "apu2A03_multi.h"
+#include "bus.h"
+#include "vgm_file.h"
+
+// Puts the APU into the register state the player starts every track from,
+// with no fraction of a cycle carried over from earlier waits
+void vgmResetApu(Apu2A03& apu);
+void vgmResetApu(Apu2A03xN& apu, int lane);
+
+// Executes a single APU_WRITE or WAIT command (other command types are ignored).
+// Waits are converted with the APU's own scheduler, see Apu2A03::waitCycles().
+// The chip the write addresses is not checked, see VgmChips for dual-chip files.
+void vgmApplyCommand(Apu2A03& apu, const VgmCommand& cmd);
+
+// Copies an NES RAM write block (16-bit start address, then the data) into
+// the memory the DMC reads from, see Bus::clearDataMemory()
+void vgmWriteRam(Bus& bus, const uint8_t* block, size_t size);
+
+// Renders the whole stream (up to the end command) into 8-bit mono PCM without any audio device.
+// 'threadedChips' clocks the second APU of dual-chip files on a worker thread.
+bool vgmRender(const VgmFile& vgm, std::vector<uint8_t>& pcm, bool threadedChips = false);
+
+// Renders several streams at once, Apu2A03xN::LANES tracks per pass. The PCM of
+// every track is identical to vgmRender(). Dual-chip files are rendered by vgmRender().
+bool vgmRenderBatch(const std::vector<const VgmFile*>& files, std::vector<std::vector<uint8_t>>& pcm);
+
+#endif
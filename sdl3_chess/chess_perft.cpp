@@ -0,0 +1,174 @@
+/*
+ * chess_perft.cpp - Move generator node counts and speed
+ *
+ * Counts the leaf nodes of the legal move tree of a position to a given depth
+ * (perft). The counts of the standard test positions are known, so any
+ * difference points at a move generator bug: --divide prints the count below
+ * each root move to find the move it is in. With --suite all standard
+ * positions are checked. The root moves can be split across threads, each
+ * with its own copy of the game.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chess_rules.h"
+
+using namespace std;
+
+const char* START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+struct PerftPosition
+{
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+};
+
+// https://www.chessprogramming.org/Perft_Results
+const PerftPosition SUITE[] = {
+    { "start",    START_FEN, 5, 4865609 },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603 },
+    { "pos3",     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083 },
+    { "pos4",     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5, 15833292 },
+    { "pos4b",    "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1", 5, 15833292 },
+    { "pos5",     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487 },
+    { "pos6",     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+};
+
+// Leaf nodes below the position; the last ply is counted, not played
+static uint64_t perft(Game& game, int depth)
+{
+    MoveList moves;
+    game.generateLegalMoves(moves);
+    if (depth <= 1) return depth == 1 ? moves.size() : 1;
+
+    uint64_t nodes = 0;
+    for (Move move : moves) {
+        game.gameState().makeMove(move);
+        nodes += perft(game, depth - 1);
+        game.gameState().unmakeMove();
+    }
+    return nodes;
+}
+
+// Counts the nodes below each root move; workers take the next root move until all are done
+static uint64_t perftRoot(const Game& root, int depth, int threads, vector<uint64_t>& divide, MoveList& rootMoves)
+{
+    rootMoves.clear();
+    root.generateLegalMoves(rootMoves);
+    divide.assign(rootMoves.size(), 0);
+    if (depth <= 1) {
+        fill(divide.begin(), divide.end(), 1);
+        return depth == 1 ? rootMoves.size() : 1;
+    }
+
+    atomic<int> next{0};
+    auto worker = [&]() {
+        Game game = root;
+        for (int i = next++; i < rootMoves.size(); i = next++) {
+            game.gameState().makeMove(rootMoves[i]);
+            divide[i] = perft(game, depth - 1);
+            game.gameState().unmakeMove();
+        }
+    };
+
+    threads = min(threads, max(1, rootMoves.size()));
+    if (threads == 1) {
+        worker();
+    } else {
+        vector<thread> pool;
+        for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+        for (auto& t : pool) t.join();
+    }
+
+    uint64_t nodes = 0;
+    for (uint64_t n : divide) nodes += n;
+    return nodes;
+}
+
+static void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " [--fen <FEN>] [--depth <n>] [--divide] [--threads <n>]\n"
+         << "       " << prog << " --suite [--threads <n>]\n"
+         << "  --fen <FEN>    position to count (default: start position)\n"
+         << "  --depth <n>    plies to count (default: 5)\n"
+         << "  --divide       print the node count below each root move\n"
+         << "  --threads <n>  split the root moves across n threads (default: 1)\n"
+         << "  --suite        check the standard test positions against their known counts\n";
+}
+
+int main(int argc, char* argv[])
+{
+    string fen = START_FEN;
+    int depth = 5;
+    int threads = 1;
+    bool divide = false;
+    bool suite = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--fen" && i + 1 < argc) fen = argv[++i];
+        else if (arg == "--depth" && i + 1 < argc) depth = max(0, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc) threads = max(1, atoi(argv[++i]));
+        else if (arg == "--divide") divide = true;
+        else if (arg == "--suite") suite = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    vector<uint64_t> counts;
+    MoveList rootMoves;
+    if (!suite) {
+        Game game;
+        if (!game.start(fen)) {
+            cerr << "Invalid FEN: " << fen << "\n";
+            return 1;
+        }
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = perftRoot(game, depth, threads, counts, rootMoves);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        if (divide) {
+            for (int i = 0; i < rootMoves.size(); i++) printf("%-6s %llu\n", rootMoves[i].toUci().c_str(), (unsigned long long)counts[i]);
+            printf("\n");
+        }
+        printf("depth %d: %llu nodes in %.3f s, %.2f Mnodes/s\n", depth, (unsigned long long)nodes, elapsed.count(),
+            nodes / max(elapsed.count(), 1e-9) / 1e6);
+        return 0;
+    }
+
+    int failures = 0;
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0.0;
+    printf("%-10s %5s %12s %10s %10s  %s\n", "position", "depth", "nodes", "s", "Mnodes/s", "expected");
+    for (const PerftPosition& position : SUITE) {
+        Game game;
+        game.start(position.fen);
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = perftRoot(game, position.depth, threads, counts, rootMoves);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        bool ok = nodes == position.nodes;
+        printf("%-10s %5d %12llu %10.3f %10.2f  %s\n", position.name, position.depth, (unsigned long long)nodes,
+            elapsed.count(), nodes / max(elapsed.count(), 1e-9) / 1e6, ok ? "ok" : "MISMATCH");
+        if (!ok) failures++;
+        totalNodes += nodes;
+        totalSeconds += elapsed.count();
+    }
+    printf("%-10s %5s %12llu %10.3f %10.2f\n", "TOTAL", "", (unsigned long long)totalNodes, totalSeconds,
+        totalNodes / max(totalSeconds, 1e-9) / 1e6);
+
+    if (failures) {
+        cerr << failures << " position(s) do not match their known node count\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,688 @@
+/*
+ * chess_rules.cpp - Chess position, move generation and game rules
+ */
+#include "chess_rules.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+string Move::toUci() const
+{
+    string uci = { char('a' + from() % BOARD_SIZE), char('1' + from() / BOARD_SIZE),
+                   char('a' + to() % BOARD_SIZE), char('1' + to() / BOARD_SIZE) };
+    if (kind() == PROMOTION)
+    {
+        uci += "qrnb"[int(promotion()) - int(PieceType::QUEEN)];
+    }
+    return uci;
+}
+
+string GameState::generateFen() const
+{
+    string fen;
+    for (int y = BOARD_SIZE - 1; y >= 0; --y) {
+        int empty = 0;
+        for (int x = 0; x < BOARD_SIZE; ++x) {
+            Piece piece = pieceAt({x, y});
+            if (piece.first == PieceType::NONE) {
+                ++empty;
+            } else {
+                if (empty > 0) {
+                    fen += to_string(empty);
+                    empty = 0;
+                }
+                char c = ' ';
+                switch (piece.first) {
+                    case PieceType::KING:   c = 'k'; break;
+                    case PieceType::QUEEN:  c = 'q'; break;
+                    case PieceType::ROOK:   c = 'r'; break;
+                    case PieceType::BISHOP: c = 'b'; break;
+                    case PieceType::KNIGHT: c = 'n'; break;
+                    case PieceType::PAWN:   c = 'p'; break;
+                    default: break;
+                }
+                if (piece.second == PieceColor::WHITE)
+                    c = toupper(c);
+                fen += c;
+            }
+        }
+        if (empty > 0) fen += to_string(empty);
+        if (y > 0) fen += '/';
+    }
+
+    // Turn
+    fen += ' ';
+    fen += (_turn == PieceColor::WHITE) ? 'w' : 'b';
+
+    // Castling rights
+    string castling;
+    if (_castlingRights & WHITE_KINGSIDE) castling += 'K';
+    if (_castlingRights & WHITE_QUEENSIDE) castling += 'Q';
+    if (_castlingRights & BLACK_KINGSIDE) castling += 'k';
+    if (_castlingRights & BLACK_QUEENSIDE) castling += 'q';
+    if (castling.empty()) castling = "-";
+    fen += ' ';
+    fen += castling;
+
+    // En passant, only given when a pawn can capture on it
+    fen += ' ';
+    if (_enPassant >= 0)
+    {
+        fen += char('a' + _enPassant % BOARD_SIZE);
+        fen += char('1' + _enPassant / BOARD_SIZE);
+    }
+    else
+    {
+        fen += '-';
+    }
+
+    // Halfmove clock and fullmove number
+    fen += ' ' + to_string(_halfmoveClock) + ' ' + to_string(_fullmoveNumber);
+
+    return fen;
+}
+
+void GameState::initializeBoard()
+{
+    fill(&_pieces[0][0], &_pieces[0][0] + COLORS * PIECE_TYPES, Bitboard(0));
+    fill(begin(_occupancy), end(_occupancy), Bitboard(0));
+    _castlingRights = ALL_CASTLING_RIGHTS;
+    _enPassant = -1;
+    _halfmoveClock = 0;
+    _fullmoveNumber = 1;
+    _turn = PieceColor::WHITE;
+    _undoStack.clear();
+    _undoStack.reserve(UNDO_RESERVE);
+    _startFen.clear();
+    for (int x = 0; x < BOARD_SIZE; ++x)
+    {
+        setPiece({x, 1}, {PieceType::PAWN, PieceColor::WHITE});
+        setPiece({x, 6}, {PieceType::PAWN, PieceColor::BLACK});
+    }
+
+    const PieceType backRank[BOARD_SIZE] = {
+        PieceType::ROOK, PieceType::KNIGHT, PieceType::BISHOP, PieceType::QUEEN,
+        PieceType::KING, PieceType::BISHOP, PieceType::KNIGHT, PieceType::ROOK
+    };
+    for (int x = 0; x < BOARD_SIZE; ++x)
+    {
+        setPiece({x, 0}, {backRank[x], PieceColor::WHITE});
+        setPiece({x, 7}, {backRank[x], PieceColor::BLACK});
+    }
+    _key = computeKey();
+}
+
+bool GameState::loadFen(const string& fen)
+{
+    istringstream in(fen);
+    string placement, turn, castling, enPassant;
+    int halfmoveClock = 0;
+    int fullmoveNumber = 1;
+    if (!(in >> placement >> turn >> castling >> enPassant))
+    {
+        return false;
+    }
+    in >> halfmoveClock >> fullmoveNumber;
+
+    // Built aside, so a record that turns out to be invalid changes nothing
+    GameState state;
+    int x = 0;
+    int y = BOARD_SIZE - 1;
+    for (char c : placement)
+    {
+        const char* type = strchr("kqrnbp", tolower(c));
+        if (c == '/')
+        {
+            if (x != BOARD_SIZE || y == 0) return false;
+            --y;
+            x = 0;
+        }
+        else if (c >= '1' && c <= '8')
+        {
+            x += c - '0';
+        }
+        else if (type && *type && x < BOARD_SIZE)
+        {
+            PieceColor color = isupper(c) ? PieceColor::WHITE : PieceColor::BLACK;
+            state.putPiece(squareIndex({x, y}), PieceType(type - "kqrnbp"), color);
+            ++x;
+        }
+        else
+        {
+            return false;
+        }
+        if (x > BOARD_SIZE) return false;
+    }
+    if (x != BOARD_SIZE || y != 0 ||
+        popcount(state.pieces(PieceType::KING, PieceColor::WHITE)) != 1 ||
+        popcount(state.pieces(PieceType::KING, PieceColor::BLACK)) != 1)
+    {
+        return false;
+    }
+
+    if (turn != "w" && turn != "b") return false;
+    state._turn = (turn == "w") ? PieceColor::WHITE : PieceColor::BLACK;
+
+    state._castlingRights = 0;
+    if (castling != "-")
+    {
+        for (char c : castling)
+        {
+            const char* right = strchr("KQkq", c);
+            if (!right || !*right) return false;
+            state._castlingRights |= uint8_t(1 << (right - "KQkq"));
+        }
+    }
+
+    state._enPassant = -1;
+    if (enPassant != "-")
+    {
+        if (enPassant.size() != 2 || enPassant[0] < 'a' || enPassant[0] > 'h' || (enPassant[1] != '3' && enPassant[1] != '6'))
+        {
+            return false;
+        }
+        int index = squareIndex({enPassant[0] - 'a', enPassant[1] - '1'});
+        if (ATTACKS.pawn[int(opponent(state._turn))][index] & state.pieces(PieceType::PAWN, state._turn))
+        {
+            state._enPassant = int8_t(index);
+        }
+    }
+    state._halfmoveClock = uint16_t(clamp(halfmoveClock, 0, 0xFFFF));
+    state._fullmoveNumber = uint16_t(clamp(fullmoveNumber, 1, 0xFFFF));
+    state._key = state.computeKey();
+    state._undoStack.reserve(UNDO_RESERVE);
+    state._startFen = state.generateFen();
+
+    *this = std::move(state);
+    return true;
+}
+
+Piece GameState::pieceAt(int index) const
+{
+    Bitboard bit = squareBit(index);
+    for (int color = 0; color < COLORS; ++color)
+    {
+        if (!(_occupancy[color] & bit)) continue;
+        for (int type = 0; type < PIECE_TYPES; ++type)
+        {
+            if (_pieces[color][type] & bit) return {PieceType(type), PieceColor(color)};
+        }
+    }
+    return {PieceType::NONE, PieceColor::NONE};
+}
+
+void GameState::setPiece(Square sq, Piece piece)
+{
+    int index = squareIndex(sq);
+    Piece old = pieceAt(index);
+    if (old.first != PieceType::NONE)
+    {
+        removePiece(index, old.first, old.second);
+    }
+    if (piece.first != PieceType::NONE && piece.second != PieceColor::NONE)
+    {
+        putPiece(index, piece.first, piece.second);
+    }
+}
+
+uint64_t GameState::computeKey() const
+{
+    uint64_t key = ZOBRIST.castling[_castlingRights];
+    for (int color = 0; color < COLORS; ++color)
+    {
+        for (int type = 0; type < PIECE_TYPES; ++type)
+        {
+            Bitboard pieces = _pieces[color][type];
+            while (pieces)
+            {
+                key ^= ZOBRIST.pieces[color][type][popLowestSquare(pieces)];
+            }
+        }
+    }
+    if (_enPassant >= 0) key ^= ZOBRIST.enPassant[_enPassant % BOARD_SIZE];
+    if (_turn == PieceColor::BLACK) key ^= ZOBRIST.blackToMove;
+    return key;
+}
+
+int GameState::repetitions() const
+{
+    int count = 0;
+    int size = int(_undoStack.size());
+    int oldest = max(0, size - int(_halfmoveClock));
+    // Every other entry has the same side to move
+    for (int i = size - 2; i >= oldest; i -= 2)
+    {
+        if (_undoStack[i].key == _key) ++count;
+    }
+    return count;
+}
+
+void GameState::makeMove(Move move)
+{
+    int from = move.from();
+    int to = move.to();
+    Piece piece = pieceAt(from);
+    UndoRecord undo = { move, PieceType::NONE, _castlingRights, _enPassant, _halfmoveClock, _key };
+
+    // En passant: the captured pawn is beside the origin, not on the target
+    int captureIndex = move.kind() == Move::EN_PASSANT ? to % BOARD_SIZE + from - from % BOARD_SIZE : to;
+    undo.captured = pieceAt(captureIndex).first;
+    if (undo.captured != PieceType::NONE)
+    {
+        removePiece(captureIndex, undo.captured, opponent(piece.second));
+    }
+    shiftPiece(from, to, piece.first, piece.second);
+
+    if (move.kind() == Move::CASTLING)
+    {
+        int rookFrom, rookTo;
+        castlingRookSquares(to, rookFrom, rookTo);
+        shiftPiece(rookFrom, rookTo, PieceType::ROOK, piece.second);
+    }
+    else if (move.kind() == Move::PROMOTION)
+    {
+        removePiece(to, PieceType::PAWN, piece.second);
+        putPiece(to, move.promotion(), piece.second);
+    }
+
+    int enPassant = -1;
+    if (piece.first == PieceType::PAWN && abs(to - from) == 2 * BOARD_SIZE &&
+        (ATTACKS.pawn[int(piece.second)][(from + to) / 2] & _pieces[int(opponent(piece.second))][int(PieceType::PAWN)]))
+    {
+        enPassant = (from + to) / 2;
+    }
+    setEnPassant(enPassant);
+    _halfmoveClock = (piece.first == PieceType::PAWN || undo.captured != PieceType::NONE) ? 0 : _halfmoveClock + 1;
+    if (piece.second == PieceColor::BLACK) ++_fullmoveNumber;
+    _key ^= ZOBRIST.castling[_castlingRights];
+    _castlingRights &= CASTLING_RIGHTS_KEPT[from] & CASTLING_RIGHTS_KEPT[to];
+    _key ^= ZOBRIST.castling[_castlingRights];
+    _undoStack.push_back(undo);
+    switchTurn();
+}
+
+void GameState::unmakeMove()
+{
+    if (_undoStack.empty()) return;
+    UndoRecord undo = _undoStack.back();
+    _undoStack.pop_back();
+    switchTurn();
+
+    int from = undo.move.from();
+    int to = undo.move.to();
+    PieceType type = pieceAt(to).first;
+    if (undo.move.kind() == Move::PROMOTION)
+    {
+        removePiece(to, type, _turn);
+        type = PieceType::PAWN;
+        putPiece(to, type, _turn);
+    }
+    shiftPiece(to, from, type, _turn);
+
+    if (undo.move.kind() == Move::CASTLING)
+    {
+        int rookFrom, rookTo;
+        castlingRookSquares(to, rookFrom, rookTo);
+        shiftPiece(rookTo, rookFrom, PieceType::ROOK, _turn);
+    }
+    if (undo.captured != PieceType::NONE)
+    {
+        int captureIndex = undo.move.kind() == Move::EN_PASSANT ? to % BOARD_SIZE + from - from % BOARD_SIZE : to;
+        putPiece(captureIndex, undo.captured, opponent(_turn));
+    }
+
+    if (_turn == PieceColor::BLACK) --_fullmoveNumber;
+    _castlingRights = undo.castlingRights;
+    _enPassant = undo.enPassant;
+    _halfmoveClock = undo.halfmoveClock;
+    _key = undo.key;
+}
+
+Move GameState::moveFor(Square from, Square to, PieceType promotion) const
+{
+    int fromIndex = squareIndex(from);
+    int toIndex = squareIndex(to);
+    PieceType type = pieceAt(fromIndex).first;
+    if (type == PieceType::KING && to.second == from.second && abs(to.first - from.first) == 2)
+    {
+        return Move(fromIndex, toIndex, Move::CASTLING);
+    }
+    if (type == PieceType::PAWN && (to.second == 0 || to.second == BOARD_SIZE - 1))
+    {
+        return Move(fromIndex, toIndex, Move::PROMOTION, promotion);
+    }
+    if (type == PieceType::PAWN && toIndex == _enPassant)
+    {
+        return Move(fromIndex, toIndex, Move::EN_PASSANT);
+    }
+    return Move(fromIndex, toIndex);
+}
+
+bool GameState::isAttacked(int index, PieceColor byColor, Bitboard occupied) const
+{
+    int by = int(byColor);
+    Bitboard queens = _pieces[by][int(PieceType::QUEEN)];
+    // A pawn of 'byColor' attacks the square if a pawn of the other colour on it would attack the pawn
+    return (ATTACKS.pawn[1 - by][index] & _pieces[by][int(PieceType::PAWN)]) ||
+           (ATTACKS.knight[index] & _pieces[by][int(PieceType::KNIGHT)]) ||
+           (ATTACKS.king[index] & _pieces[by][int(PieceType::KING)]) ||
+           (bishopAttacks(index, occupied) & (_pieces[by][int(PieceType::BISHOP)] | queens)) ||
+           (rookAttacks(index, occupied) & (_pieces[by][int(PieceType::ROOK)] | queens));
+}
+
+Bitboard GameState::attackers(int index, PieceColor byColor) const
+{
+    int by = int(byColor);
+    Bitboard occupied = occupancy();
+    Bitboard queens = _pieces[by][int(PieceType::QUEEN)];
+    return (ATTACKS.pawn[1 - by][index] & _pieces[by][int(PieceType::PAWN)]) |
+           (ATTACKS.knight[index] & _pieces[by][int(PieceType::KNIGHT)]) |
+           (ATTACKS.king[index] & _pieces[by][int(PieceType::KING)]) |
+           (bishopAttacks(index, occupied) & (_pieces[by][int(PieceType::BISHOP)] | queens)) |
+           (rookAttacks(index, occupied) & (_pieces[by][int(PieceType::ROOK)] | queens));
+}
+
+
+void Game::start()
+{
+    _state.initializeBoard();
+    _state.clearSelection();
+    _state.possibleMoves().clear();
+    _state.setTurn(PieceColor::WHITE);
+}
+
+bool Game::start(const string& fen)
+{
+    if (!_state.loadFen(fen))
+    {
+        return false;
+    }
+    _state.clearSelection();
+    _state.possibleMoves().clear();
+    return true;
+}
+
+MoveList Game::getAllPossibleMoves() const
+{
+    MoveList allMoves;
+    generateLegalMoves(allMoves);
+    return allMoves;
+}
+
+bool Game::hasLegalMove() const
+{
+    MoveList moves;
+    generateLegalMoves(moves);
+    return !moves.empty();
+}
+
+Game::GameResult Game::isGameOver() const
+{
+    if (!hasLegalMove())
+    {
+        if (isCheck(*this, _state.currentTurn()))
+        {
+            // Checkmate
+            return (_state.currentTurn() == PieceColor::WHITE) ? GameResult::BLACK_WIN : GameResult::WHITE_WIN;
+        }
+        else
+        {
+            // Stalemate
+            return GameResult::DRAW;
+        }
+    }
+    else if (_state.halfmoveClock() >= 100 || _state.repetitions() >= 2)
+    {
+        // Fifty-move rule or threefold repetition
+        return GameResult::DRAW;
+    }
+    else
+    {
+        return GameResult::ONGOING;
+    }
+}
+
+bool Game::isCheck(const Game& game, PieceColor color)
+{
+    Bitboard king = game.gameState().pieces(PieceType::KING, color);
+    return king && game.gameState().isAttacked(countr_zero(king), opponent(color));
+}
+
+bool Game::isValidState(const Game& game)
+{
+    if (game.gameState().currentTurn() != PieceColor::WHITE && game.gameState().currentTurn() != PieceColor::BLACK)
+    {
+        return false;
+    }
+
+    if (isCheck(game, PieceColor::WHITE) && game.gameState().currentTurn() == PieceColor::BLACK)
+    {
+        return false;
+    }
+
+    if (isCheck(game, PieceColor::BLACK) && game.gameState().currentTurn() == PieceColor::WHITE)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Adds the moves of a pawn to each target, four of them for each promotion
+static void addPawnMoves(int from, Bitboard targets, MoveList& moves)
+{
+    const Bitboard lastRanks = 0xFF000000000000FFull;
+    while (targets)
+    {
+        int to = popLowestSquare(targets);
+        if (squareBit(to) & lastRanks)
+        {
+            moves.add(Move(from, to, Move::PROMOTION, PieceType::QUEEN));
+            moves.add(Move(from, to, Move::PROMOTION, PieceType::ROOK));
+            moves.add(Move(from, to, Move::PROMOTION, PieceType::BISHOP));
+            moves.add(Move(from, to, Move::PROMOTION, PieceType::KNIGHT));
+        }
+        else
+        {
+            moves.add(Move(from, to));
+        }
+    }
+}
+
+void Game::generateLegalMoves(MoveList& moves) const
+{
+    PieceColor us = _state.currentTurn();
+    PieceColor them = opponent(us);
+    Bitboard kingBit = _state.pieces(PieceType::KING, us);
+    if (!kingBit) return;
+
+    int king = countr_zero(kingBit);
+    Bitboard occupied = _state.occupancy();
+    Bitboard own = _state.occupancy(us);
+    Bitboard enemy = _state.occupancy(them);
+    Bitboard enemyRooks = _state.pieces(PieceType::ROOK, them) | _state.pieces(PieceType::QUEEN, them);
+    Bitboard enemyBishops = _state.pieces(PieceType::BISHOP, them) | _state.pieces(PieceType::QUEEN, them);
+
+    // King moves, tested without the king on the board so it cannot step back along a checking line
+    Bitboard targets = ATTACKS.king[king] & ~own;
+    while (targets)
+    {
+        int to = popLowestSquare(targets);
+        if (!_state.isAttacked(to, them, occupied ^ kingBit))
+        {
+            moves.add(Move(king, to));
+        }
+    }
+
+    // In double check only the king can move. In single check the other
+    // pieces have to capture the checker or block its line.
+    Bitboard checkers = _state.attackers(king, them);
+    if (popcount(checkers) > 1) return;
+    Bitboard targetMask = checkers ? checkers | squaresBetween(king, countr_zero(checkers)) : ~own;
+
+    // A piece alone between the king and an enemy slider may only move along that line
+    Bitboard pinned = 0;
+    Bitboard snipers = (rookAttacks(king, enemy) & enemyRooks) | (bishopAttacks(king, enemy) & enemyBishops);
+    while (snipers)
+    {
+        Bitboard blockers = squaresBetween(king, popLowestSquare(snipers)) & occupied;
+        if (blockers && !(blockers & (blockers - 1)))
+        {
+            pinned |= blockers & own;
+        }
+    }
+
+    for (PieceType type : {PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT})
+    {
+        Bitboard pieces = _state.pieces(type, us);
+        while (pieces)
+        {
+            int from = popLowestSquare(pieces);
+            Bitboard allowed = (pinned & squareBit(from)) ? targetMask & rayThrough(king, from) : targetMask;
+            switch (type)
+            {
+                case PieceType::QUEEN:  targets = bishopAttacks(from, occupied) | rookAttacks(from, occupied); break;
+                case PieceType::ROOK:   targets = rookAttacks(from, occupied); break;
+                case PieceType::BISHOP: targets = bishopAttacks(from, occupied); break;
+                default:                targets = ATTACKS.knight[from]; break;
+            }
+            targets &= allowed;
+            while (targets)
+            {
+                moves.add(Move(from, popLowestSquare(targets)));
+            }
+        }
+    }
+
+    int forward = (us == PieceColor::WHITE) ? BOARD_SIZE : -BOARD_SIZE;
+    Bitboard startRank = (us == PieceColor::WHITE) ? 0x000000000000FF00ull : 0x00FF000000000000ull;
+    Bitboard pawns = _state.pieces(PieceType::PAWN, us);
+    while (pawns)
+    {
+        int from = popLowestSquare(pawns);
+        targets = ATTACKS.pawn[int(us)][from] & enemy;
+        if (!(occupied & squareBit(from + forward)))
+        {
+            targets |= squareBit(from + forward);
+            if ((squareBit(from) & startRank) && !(occupied & squareBit(from + 2 * forward)))
+                targets |= squareBit(from + 2 * forward);
+        }
+        targets &= (pinned & squareBit(from)) ? targetMask & rayThrough(king, from) : targetMask;
+        addPawnMoves(from, targets, moves);
+    }
+
+    // En passant removes two pawns from the board at once, which can uncover
+    // the king in ways the pin test misses (both pawns between the king and a
+    // rook on the same rank), so the position after it is checked directly
+    int enPassant = _state.enPassantSquare();
+    if (enPassant >= 0)
+    {
+        int captured = enPassant - forward;
+        Bitboard enemyLeapers = _state.pieces(PieceType::KNIGHT, them) | _state.pieces(PieceType::PAWN, them);
+        Bitboard capturers = ATTACKS.pawn[int(them)][enPassant] & _state.pieces(PieceType::PAWN, us);
+        while (capturers)
+        {
+            int from = popLowestSquare(capturers);
+            Bitboard after = (occupied ^ squareBit(from) ^ squareBit(captured)) | squareBit(enPassant);
+            bool exposed = (rookAttacks(king, after) & enemyRooks) || (bishopAttacks(king, after) & enemyBishops) ||
+                           (checkers & enemyLeapers & ~squareBit(captured));
+            if (!exposed)
+            {
+                moves.add(Move(from, enPassant, Move::EN_PASSANT));
+            }
+        }
+    }
+
+    // Castling needs the right, an empty path and the king neither in check
+    // nor passing or landing on an attacked square
+    if (!checkers)
+    {
+        int rank = (us == PieceColor::WHITE) ? 0 : 7 * BOARD_SIZE;
+        uint8_t kingSide = (us == PieceColor::WHITE) ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+        uint8_t queenSide = (us == PieceColor::WHITE) ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+        Bitboard rooks = _state.pieces(PieceType::ROOK, us);
+        if (king == rank + 4)
+        {
+            if ((_state.castlingRights() & kingSide) && (rooks & squareBit(rank + 7)) &&
+                !(occupied & (Bitboard(0x60) << rank)) &&
+                !_state.isAttacked(rank + 5, them) && !_state.isAttacked(rank + 6, them))
+            {
+                moves.add(Move(king, rank + 6, Move::CASTLING));
+            }
+            if ((_state.castlingRights() & queenSide) && (rooks & squareBit(rank)) &&
+                !(occupied & (Bitboard(0x0E) << rank)) &&
+                !_state.isAttacked(rank + 3, them) && !_state.isAttacked(rank + 2, them))
+            {
+                moves.add(Move(king, rank + 2, Move::CASTLING));
+            }
+        }
+    }
+}
+
+MoveList Game::getPossibleMoves() const
+{
+    MoveList allMoves;
+    MoveList filteredMoves;
+    if (_state.getSelectedSquare() == GameState::INVALID_SQUARE)
+    {
+        return filteredMoves;
+    }
+
+    generateLegalMoves(allMoves);
+    int from = squareIndex(_state.getSelectedSquare());
+    for (Move move : allMoves)
+    {
+        if (move.from() == from)
+        {
+            filteredMoves.add(move);
+        }
+    }
+
+    return filteredMoves;
+}
+
+bool Game::select(Square sq)
+{
+    Piece piece = _state.pieceAt(sq);
+    if (piece.first != PieceType::NONE && piece.second == _state.currentTurn())
+    {
+        _state.selectSquare(sq);
+        _state.possibleMoves() = getPossibleMoves();
+        return true;
+    }
+    return false;
+}
+
+bool Game::isValidMove(Square to) const
+{
+    return _state.getSelectedSquare() != GameState::INVALID_SQUARE &&
+           ranges::any_of(_state.possibleMoves(), [&](Move move) { return move.to() == squareIndex(to); });
+}
+
+bool Game::move(Square to)
+{
+    Square from = _state.getSelectedSquare();
+    if (from == GameState::INVALID_SQUARE)
+    {
+        return false;
+    }
+    return move(_state.moveFor(from, to));
+}
+
+bool Game::move(Move move)
+{
+    if (_state.pieceAt(move.from()).first == PieceType::NONE)
+    {
+        return false;
+    }
+
+    _state.makeMove(move);
+    _state.clearSelection();
+    _state.possibleMoves().clear();
+    return true;
+}
@@ -0,0 +1,422 @@
+/*
+ * chess_rules.h - Chess position, move generation and game rules
+ *
+ * The position is kept as bitboards, one 64-bit set per piece type and colour
+ * with square index x + 8 * y (a1 = 0, h8 = 63). Moves are generated legal
+ * from the checkers and pins of the position and played in place with
+ * makeMove()/unmakeMove(). No SDL dependency, so headless tools (chess_perft)
+ * can share it with the game.
+ */
+#ifndef CHESS_RULES_H
+#define CHESS_RULES_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class PieceType : uint8_t
+{
+    KING, QUEEN, ROOK, KNIGHT, BISHOP, PAWN, NONE
+};
+
+enum class PieceColor
+{
+    WHITE, BLACK, NONE
+};
+
+using Piece = std::pair<PieceType, PieceColor>;
+using Square = std::pair<int, int>; // (x, y)
+
+const int BOARD_SIZE = 8;
+const int PIECE_TYPES = 6;
+const int COLORS = 2;
+
+//------------------------------------------------------------------------------
+// Bitboards: one bit per square, square index = x + 8 * y (a1 = 0, h8 = 63)
+//------------------------------------------------------------------------------
+using Bitboard = uint64_t;
+
+inline int squareIndex(Square sq) { return sq.first + sq.second * BOARD_SIZE; }
+inline Square squareAt(int index) { return {index % BOARD_SIZE, index / BOARD_SIZE}; }
+inline Bitboard squareBit(int index) { return Bitboard(1) << index; }
+inline Bitboard squareBit(Square sq) { return squareBit(squareIndex(sq)); }
+// Index of the lowest set bit, which is then cleared
+inline int popLowestSquare(Bitboard& bb) { int index = std::countr_zero(bb); bb &= bb - 1; return index; }
+inline PieceColor opponent(PieceColor color) { return color == PieceColor::WHITE ? PieceColor::BLACK : PieceColor::WHITE; }
+
+// Squares reached by single steps (knight, king, pawn captures)
+constexpr Bitboard stepAttacks(int index, const int (*steps)[2], int count)
+{
+    Bitboard attacks = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int x = index % BOARD_SIZE + steps[i][0];
+        int y = index / BOARD_SIZE + steps[i][1];
+        if (x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE)
+            attacks |= Bitboard(1) << (x + y * BOARD_SIZE);
+    }
+    return attacks;
+}
+
+inline constexpr int KNIGHT_STEPS[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+inline constexpr int KING_STEPS[8][2] = { {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}, {0, 1} };
+inline constexpr int PAWN_CAPTURE_STEPS[COLORS][2][2] = { { {-1, 1}, {1, 1} }, { {-1, -1}, {1, -1} } };
+
+// Ray directions; the first four increase the square index, the last four decrease it
+enum Direction { NORTH, EAST, NORTH_EAST, NORTH_WEST, SOUTH, WEST, SOUTH_WEST, SOUTH_EAST, DIRECTIONS };
+inline constexpr int DIRECTION_STEPS[DIRECTIONS][2] = { {0, 1}, {1, 0}, {1, 1}, {-1, 1}, {0, -1}, {-1, 0}, {-1, -1}, {1, -1} };
+
+struct AttackTables
+{
+    Bitboard knight[64];
+    Bitboard king[64];
+    Bitboard pawn[COLORS][64];
+    Bitboard rays[DIRECTIONS][64];  // squares from a square to the edge, excluding it
+
+    constexpr AttackTables() : knight(), king(), pawn(), rays()
+    {
+        for (int index = 0; index < 64; ++index)
+        {
+            knight[index] = stepAttacks(index, KNIGHT_STEPS, 8);
+            king[index] = stepAttacks(index, KING_STEPS, 8);
+            for (int color = 0; color < COLORS; ++color)
+                pawn[color][index] = stepAttacks(index, PAWN_CAPTURE_STEPS[color], 2);
+            for (int dir = 0; dir < DIRECTIONS; ++dir)
+            {
+                int x = index % BOARD_SIZE + DIRECTION_STEPS[dir][0];
+                int y = index / BOARD_SIZE + DIRECTION_STEPS[dir][1];
+                for (; x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE; x += DIRECTION_STEPS[dir][0], y += DIRECTION_STEPS[dir][1])
+                    rays[dir][index] |= Bitboard(1) << (x + y * BOARD_SIZE);
+            }
+        }
+    }
+};
+
+inline constexpr AttackTables ATTACKS;
+
+// Ray up to and including the first occupied square
+inline Bitboard rayAttacks(int dir, int index, Bitboard occupied)
+{
+    Bitboard ray = ATTACKS.rays[dir][index];
+    Bitboard blockers = ray & occupied;
+    if (blockers)
+    {
+        int blocker = dir < SOUTH ? std::countr_zero(blockers) : 63 - std::countl_zero(blockers);
+        ray ^= ATTACKS.rays[dir][blocker];
+    }
+    return ray;
+}
+
+inline Bitboard rookAttacks(int index, Bitboard occupied)
+{
+    return rayAttacks(NORTH, index, occupied) | rayAttacks(EAST, index, occupied) |
+           rayAttacks(SOUTH, index, occupied) | rayAttacks(WEST, index, occupied);
+}
+
+inline Bitboard bishopAttacks(int index, Bitboard occupied)
+{
+    return rayAttacks(NORTH_EAST, index, occupied) | rayAttacks(NORTH_WEST, index, occupied) |
+           rayAttacks(SOUTH_EAST, index, occupied) | rayAttacks(SOUTH_WEST, index, occupied);
+}
+
+// Squares strictly between two squares on a line, 0 if they are not on one
+inline Bitboard squaresBetween(int from, int to)
+{
+    for (int dir = 0; dir < DIRECTIONS; ++dir)
+    {
+        if (ATTACKS.rays[dir][from] & squareBit(to))
+            return ATTACKS.rays[dir][from] & ~ATTACKS.rays[dir][to] & ~squareBit(to);
+    }
+    return 0;
+}
+
+// Ray from a square through another one to the edge of the board
+inline Bitboard rayThrough(int from, int through)
+{
+    for (int dir = 0; dir < DIRECTIONS; ++dir)
+    {
+        if (ATTACKS.rays[dir][from] & squareBit(through))
+            return ATTACKS.rays[dir][from];
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Castling rights, one bit each
+//------------------------------------------------------------------------------
+const uint8_t WHITE_KINGSIDE = 1;
+const uint8_t WHITE_QUEENSIDE = 2;
+const uint8_t BLACK_KINGSIDE = 4;
+const uint8_t BLACK_QUEENSIDE = 8;
+const uint8_t ALL_CASTLING_RIGHTS = 15;
+
+// Rights kept when a piece moves from or to a square: moving the king or a
+// rook, or capturing a rook on its start square, loses them
+inline constexpr std::array<uint8_t, 64> CASTLING_RIGHTS_KEPT = [] {
+    std::array<uint8_t, 64> kept{};
+    kept.fill(ALL_CASTLING_RIGHTS);
+    kept[0] &= ~WHITE_QUEENSIDE;
+    kept[4] &= ~(WHITE_KINGSIDE | WHITE_QUEENSIDE);
+    kept[7] &= ~WHITE_KINGSIDE;
+    kept[56] &= ~BLACK_QUEENSIDE;
+    kept[60] &= ~(BLACK_KINGSIDE | BLACK_QUEENSIDE);
+    kept[63] &= ~BLACK_KINGSIDE;
+    return kept;
+}();
+
+//------------------------------------------------------------------------------
+// Zobrist keys: a position key is the XOR of the keys of its pieces, castling
+// rights, en passant file and side to move, so a move updates it with a few XORs
+//------------------------------------------------------------------------------
+struct ZobristKeys
+{
+    uint64_t pieces[COLORS][PIECE_TYPES][64];
+    uint64_t castling[ALL_CASTLING_RIGHTS + 1];
+    uint64_t enPassant[BOARD_SIZE];
+    uint64_t blackToMove;
+
+    // Fixed keys from a splitmix64 sequence, so keys are the same in every build
+    constexpr ZobristKeys() : pieces(), castling(), enPassant(), blackToMove()
+    {
+        uint64_t state = 0;
+        auto next = [&state]() {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        };
+        for (auto& color : pieces)
+            for (auto& type : color)
+                for (uint64_t& key : type) key = next();
+        for (uint64_t& key : castling) key = next();
+        for (uint64_t& key : enPassant) key = next();
+        blackToMove = next();
+    }
+};
+
+inline constexpr ZobristKeys ZOBRIST;
+
+//------------------------------------------------------------------------------
+// Moves
+//------------------------------------------------------------------------------
+// A move packed into 16 bits: origin (bits 0-5), target (6-11), promotion
+// piece (12-13) and kind (14-15)
+class Move
+{
+public:
+    enum Kind { NORMAL, PROMOTION, EN_PASSANT, CASTLING };
+
+    Move() = default;  // left uninitialized, move lists are filled before they are read
+    Move(int from, int to, Kind kind = NORMAL, PieceType promotion = PieceType::QUEEN)
+        : _bits(uint16_t(from | to << 6 | (int(promotion) - int(PieceType::QUEEN)) << 12 | kind << 14)) {}
+
+    int from() const { return _bits & 63; }
+    int to() const { return (_bits >> 6) & 63; }
+    Kind kind() const { return Kind(_bits >> 14); }
+    // Only meaningful for PROMOTION moves
+    PieceType promotion() const { return PieceType(((_bits >> 12) & 3) + int(PieceType::QUEEN)); }
+    bool operator==(const Move& other) const { return _bits == other._bits; }
+    // Long algebraic notation as used by UCI, e.g. "e2e4" or "e7e8q"
+    std::string toUci() const;
+
+private:
+    uint16_t _bits;
+};
+
+// Fixed capacity list for generated moves; a position has at most 218 legal moves
+class MoveList
+{
+public:
+    static const int CAPACITY = 256;
+
+    void add(Move move) { _moves[_size++] = move; }
+    void clear() { _size = 0; }
+    int size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    Move operator[](int i) const { return _moves[i]; }
+    const Move* begin() const { return _moves; }
+    const Move* end() const { return _moves + _size; }
+
+private:
+    Move _moves[CAPACITY];
+    int _size = 0;
+};
+
+//------------------------------------------------------------------------------
+// Game State
+//------------------------------------------------------------------------------
+class GameState
+{
+public:
+    static inline const Square INVALID_SQUARE = {-1, -1};
+
+    void initializeBoard();
+    // Sets up the position of a FEN record; an invalid record leaves the state unchanged
+    bool loadFen(const std::string& fen);
+    Piece pieceAt(Square sq) const { return pieceAt(squareIndex(sq)); }
+    Piece pieceAt(int index) const;
+    void setPiece(Square sq, Piece piece);
+    Bitboard pieces(PieceType type, PieceColor color) const { return _pieces[int(color)][int(type)]; }
+    Bitboard occupancy(PieceColor color) const { return _occupancy[int(color)]; }
+    Bitboard occupancy() const { return _occupancy[0] | _occupancy[1]; }
+    // Whether a piece of 'byColor' attacks the square, optionally with the
+    // sliders seeing through a different occupancy
+    bool isAttacked(int index, PieceColor byColor) const { return isAttacked(index, byColor, occupancy()); }
+    bool isAttacked(int index, PieceColor byColor, Bitboard occupied) const;
+    // Pieces of 'byColor' attacking the square
+    Bitboard attackers(int index, PieceColor byColor) const;
+
+    // Plays a move in place and passes the turn; unmakeMove() takes back the
+    // last move made
+    void makeMove(Move move);
+    void unmakeMove();
+    // The move of the piece on 'from' to 'to', with its kind taken from the
+    // position (e.g. a king moving two files castles)
+    Move moveFor(Square from, Square to, PieceType promotion = PieceType::QUEEN) const;
+    uint8_t castlingRights() const { return _castlingRights; }
+    // Square a pawn skipped with its last move, -1 if none or no enemy pawn
+    // could capture on it (the position is then the same as without it)
+    int enPassantSquare() const { return _enPassant; }
+    // Plies since the last capture or pawn move
+    int halfmoveClock() const { return _halfmoveClock; }
+    int fullmoveNumber() const { return _fullmoveNumber; }
+    // Zobrist key of the position, updated with every move
+    uint64_t key() const { return _key; }
+    // How often the current position occurred before. Only positions since the
+    // last capture or pawn move can repeat, so at most halfmoveClock() keys of
+    // the undo stack are compared.
+    int repetitions() const;
+    // FEN record of the position the game started from, empty for the
+    // standard start position. With the moves played since, oldest first, it
+    // describes the game including its history.
+    const std::string& startFen() const { return _startFen; }
+    int playedMoveCount() const { return int(_undoStack.size()); }
+    Move playedMove(int ply) const { return _undoStack[ply].move; }
+
+    void selectSquare(Square sq) { _selectedSquare = sq; }
+    Square getSelectedSquare() const { return _selectedSquare; }
+    void clearSelection() { _selectedSquare = INVALID_SQUARE; }
+    PieceColor currentTurn() const { return _turn; }
+    void setTurn(PieceColor color) { if (color != _turn) switchTurn(); }
+    void switchTurn()
+    {
+        _turn = (_turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+        _key ^= ZOBRIST.blackToMove;
+    }
+    MoveList& possibleMoves() { return _possibleMoves; }
+    const MoveList& possibleMoves() const { return _possibleMoves; }
+    std::string generateFen() const;
+
+private:
+    // What makeMove() changed beyond the moving piece
+    struct UndoRecord
+    {
+        Move move;
+        PieceType captured;  // NONE if nothing was captured
+        uint8_t castlingRights;
+        int8_t enPassant;
+        uint16_t halfmoveClock;
+        uint64_t key;        // of the position before the move, the key history
+    };
+
+    // Games longer than this many plies grow the undo stack
+    static const int UNDO_RESERVE = 512;
+
+    void putPiece(int index, PieceType type, PieceColor color)
+    {
+        _pieces[int(color)][int(type)] |= squareBit(index);
+        _occupancy[int(color)] |= squareBit(index);
+        _key ^= ZOBRIST.pieces[int(color)][int(type)][index];
+    }
+    void removePiece(int index, PieceType type, PieceColor color)
+    {
+        _pieces[int(color)][int(type)] &= ~squareBit(index);
+        _occupancy[int(color)] &= ~squareBit(index);
+        _key ^= ZOBRIST.pieces[int(color)][int(type)][index];
+    }
+    void shiftPiece(int from, int to, PieceType type, PieceColor color)
+    {
+        Bitboard bits = squareBit(from) | squareBit(to);
+        _pieces[int(color)][int(type)] ^= bits;
+        _occupancy[int(color)] ^= bits;
+        _key ^= ZOBRIST.pieces[int(color)][int(type)][from] ^ ZOBRIST.pieces[int(color)][int(type)][to];
+    }
+    void setEnPassant(int index)
+    {
+        if (_enPassant >= 0) _key ^= ZOBRIST.enPassant[_enPassant % BOARD_SIZE];
+        _enPassant = int8_t(index);
+        if (_enPassant >= 0) _key ^= ZOBRIST.enPassant[_enPassant % BOARD_SIZE];
+    }
+    // Key of the position computed from scratch
+    uint64_t computeKey() const;
+    // Rook squares of a castling king move
+    static void castlingRookSquares(int kingTo, int& rookFrom, int& rookTo)
+    {
+        bool kingSide = kingTo % BOARD_SIZE == 6;
+        int rank = kingTo - kingTo % BOARD_SIZE;
+        rookFrom = rank + (kingSide ? 7 : 0);
+        rookTo = rank + (kingSide ? 5 : 3);
+    }
+
+    Bitboard _pieces[COLORS][PIECE_TYPES] = {};
+    Bitboard _occupancy[COLORS] = {};
+    uint8_t _castlingRights = ALL_CASTLING_RIGHTS;
+    int8_t _enPassant = -1;
+    uint16_t _halfmoveClock = 0;
+    uint16_t _fullmoveNumber = 1;
+    uint64_t _key = 0;
+    std::vector<UndoRecord> _undoStack;
+    std::string _startFen;
+    Square _selectedSquare = INVALID_SQUARE;
+    PieceColor _turn = PieceColor::WHITE;
+    MoveList _possibleMoves;
+};
+
+//------------------------------------------------------------------------------
+// Game Logic
+//------------------------------------------------------------------------------
+class Game
+{
+    GameState _state;
+public:
+    enum class GameResult
+    {
+        ONGOING, WHITE_WIN, BLACK_WIN, DRAW
+    };
+    GameState& gameState() { return _state; }
+    const GameState& gameState() const { return _state; }
+    
+    void start();
+    bool start(const std::string& fen);
+    // All legal moves of the side to move. Checkers and pinned pieces are
+    // found once per position, so no move has to be tried on the board.
+    void generateLegalMoves(MoveList& moves) const;
+    // Legal moves of the selected piece
+    MoveList getPossibleMoves() const;
+    MoveList getAllPossibleMoves() const;
+    bool hasLegalMove() const;
+    bool isValidMove(Square to) const;
+    bool select(Square sq);
+    void unselect() { _state.clearSelection(); _state.possibleMoves().clear(); }
+    // Moves the selected piece to 'to' (promoting to a queen)
+    bool move(Square to);
+    bool move(Move move);
+    // Checkmate, stalemate, the fifty-move rule or threefold repetition
+    GameResult isGameOver() const;
+    static bool isCheck(const Game& game, PieceColor color);
+    static bool isValidState(const Game& game);
+    std::string gameResultToString(GameResult result) const {
+        switch (result) {
+            case GameResult::ONGOING: return "Ongoing";
+            case GameResult::WHITE_WIN: return "White wins";
+            case GameResult::BLACK_WIN: return "Black wins";
+            case GameResult::DRAW: return "Draw";
+            default: return "Unknown";
+        }
+    }
+};
+
+#endif
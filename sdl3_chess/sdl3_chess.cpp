@@ -6,9 +6,20 @@
 #include <algorithm>
 #include <string>
 #include <fstream>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string_view>
+#include <thread>
 #include <SDL3/SDL.h>
 #include <SDL3_image/SDL_image.h>
 
+#include "chess_rules.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h> // _getcwd
@@ -24,6 +35,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
 #endif
 #include <SDL3/SDL_main.h>
 
@@ -40,549 +54,147 @@ const string STOCKFISH_PATH = PROJECT_ROOT +  "stockfish/stockfish";
 #endif
 //const string PROJECT_ROOT = "";
 
-enum class PieceType
-{
-    KING, QUEEN, ROOK, KNIGHT, BISHOP, PAWN, NONE
-};
-
-enum class PieceColor
-{
-    WHITE, BLACK, NONE
-};
-
-using Piece = pair<PieceType, PieceColor>;
-using Square = pair<int, int>; // (x, y)
-
-const int BOARD_SIZE = 8;
-
 //------------------------------------------------------------------------------
-// Game State
+// UCI Output Parser
 //------------------------------------------------------------------------------
-class GameState
+// A line of engine output the game understands
+struct UciEvent
 {
-public:
-    static inline const Square INVALID_SQUARE = {-1, -1};
-
-    void initializeBoard();
-    Piece& pieceAt(Square sq) { return _board[sq.first][sq.second]; }
-    const Piece& pieceAt(Square sq) const { return _board[sq.first][sq.second]; }
-
-    void selectSquare(Square sq) { _selectedSquare = sq; }
-    void movePiece(Square from, Square to);
-    Square getSelectedSquare() const { return _selectedSquare; }
-    void clearSelection() { _selectedSquare = INVALID_SQUARE; }
-    PieceColor currentTurn() const { return _turn; }
-    void setTurn(PieceColor color) { _turn = color; }
-    void switchTurn() { _turn = (_turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE; }
-    vector<Square>& possibleMoves() { return _possibleMoves; }
-    const vector<Square>& possibleMoves() const { return _possibleMoves; }
-    string generateFen();
-
-private:
-    array<array<Piece, BOARD_SIZE>, BOARD_SIZE> _board;
-    Square _selectedSquare = INVALID_SQUARE;
-    PieceColor _turn = PieceColor::WHITE;
-    vector<Square> _possibleMoves;
+    enum class Type { UCIOK, READYOK, BESTMOVE, INFO };
+
+    Type type = Type::INFO;
+    // BESTMOVE: the move and the move to ponder on (empty if not given)
+    std::string_view move;
+    std::string_view ponder;
+    // INFO: the fields the line does not have stay at -1 / false / empty
+    int depth = -1;
+    bool hasScore = false;
+    bool mate = false;      // the score is in moves to mate instead of centipawns
+    int score = 0;
+    std::string_view pv;
 };
 
-string GameState::generateFen()
-{
-    string fen;
-    for (int y = BOARD_SIZE - 1; y >= 0; --y) {
-        int empty = 0;
-        for (int x = 0; x < BOARD_SIZE; ++x) {
-            const Piece& piece = _board[x][y];
-            if (piece.first == PieceType::NONE) {
-                ++empty;
-            } else {
-                if (empty > 0) {
-                    fen += to_string(empty);
-                    empty = 0;
-                }
-                char c = ' ';
-                switch (piece.first) {
-                    case PieceType::KING:   c = 'k'; break;
-                    case PieceType::QUEEN:  c = 'q'; break;
-                    case PieceType::ROOK:   c = 'r'; break;
-                    case PieceType::BISHOP: c = 'b'; break;
-                    case PieceType::KNIGHT: c = 'n'; break;
-                    case PieceType::PAWN:   c = 'p'; break;
-                    default: break;
-                }
-                if (piece.second == PieceColor::WHITE)
-                    c = toupper(c);
-                fen += c;
-            }
-        }
-        if (empty > 0) fen += to_string(empty);
-        if (y > 0) fen += '/';
-    }
-
-    // Turn
-    fen += ' ';
-    fen += (_turn == PieceColor::WHITE) ? 'w' : 'b';
-
-    // Castling rights - check if kings and rooks are in their initial squares
-    string castling;
-    // White king-side
-    if (pieceAt({4,0}).first == PieceType::KING && pieceAt({4,0}).second == PieceColor::WHITE &&
-        pieceAt({7,0}).first == PieceType::ROOK && pieceAt({7,0}).second == PieceColor::WHITE)
-        castling += 'K';
-    // White queen-side
-    if (pieceAt({4,0}).first == PieceType::KING && pieceAt({4,0}).second == PieceColor::WHITE &&
-        pieceAt({0,0}).first == PieceType::ROOK && pieceAt({0,0}).second == PieceColor::WHITE)
-        castling += 'Q';
-    // Black king-side
-    if (pieceAt({4,7}).first == PieceType::KING && pieceAt({4,7}).second == PieceColor::BLACK &&
-        pieceAt({7,7}).first == PieceType::ROOK && pieceAt({7,7}).second == PieceColor::BLACK)
-        castling += 'k';
-    // Black queen-side
-    if (pieceAt({4,7}).first == PieceType::KING && pieceAt({4,7}).second == PieceColor::BLACK &&
-        pieceAt({0,7}).first == PieceType::ROOK && pieceAt({0,7}).second == PieceColor::BLACK)
-        castling += 'q';
-    if (castling.empty()) castling = "-";
-    fen += " " + castling;
-
-    // En passant (not tracked, so always "-")
-    fen += " -";
-
-    // Halfmove clock and fullmove number (not tracked, so always "0 1")
-    fen += " 0 1";
-
-    return fen;
-}
-
-void GameState::initializeBoard()
-{
-    fill(&_board[0][0], &_board[0][0] + BOARD_SIZE * BOARD_SIZE, Piece{PieceType::NONE, PieceColor::NONE});
-    for (int x = 0; x < BOARD_SIZE; ++x)
-    {
-        _board[x][1] = {PieceType::PAWN, PieceColor::WHITE};
-        _board[x][6] = {PieceType::PAWN, PieceColor::BLACK};
-    }
-
-    _board[0][0] = {PieceType::ROOK, PieceColor::WHITE};
-    _board[1][0] = {PieceType::KNIGHT, PieceColor::WHITE};
-    _board[2][0] = {PieceType::BISHOP, PieceColor::WHITE};
-    _board[3][0] = {PieceType::QUEEN, PieceColor::WHITE};
-    _board[4][0] = {PieceType::KING, PieceColor::WHITE};
-    _board[5][0] = {PieceType::BISHOP, PieceColor::WHITE};
-    _board[6][0] = {PieceType::KNIGHT, PieceColor::WHITE};
-    _board[7][0] = {PieceType::ROOK, PieceColor::WHITE};
-
-    _board[0][7] = {PieceType::ROOK, PieceColor::BLACK};
-    _board[1][7] = {PieceType::KNIGHT, PieceColor::BLACK};
-    _board[2][7] = {PieceType::BISHOP, PieceColor::BLACK};
-    _board[3][7] = {PieceType::QUEEN, PieceColor::BLACK};
-    _board[4][7] = {PieceType::KING, PieceColor::BLACK};
-    _board[5][7] = {PieceType::BISHOP, PieceColor::BLACK};
-    _board[6][7] = {PieceType::KNIGHT, PieceColor::BLACK};
-    _board[7][7] = {PieceType::ROOK, PieceColor::BLACK};
-}
-
-void GameState::movePiece(Square from, Square to)
-{
-    if (from != INVALID_SQUARE && to != INVALID_SQUARE)
-    {
-        _board[to.first][to.second] = _board[from.first][from.second];
-        _board[from.first][from.second] = {PieceType::NONE, PieceColor::NONE};
-    }
-}
-
-//------------------------------------------------------------------------------
-// Game Logic
-//------------------------------------------------------------------------------
-class Game
+// Splits the engine's output into lines in a fixed ring buffer. The bytes are
+// scanned for line ends once, as they arrive, and a complete line is
+// tokenized in place and dispatched as an event, without allocating. The
+// views in an event are only valid during the callback.
+class UciParser
 {
-    GameState _state;
 public:
-    enum class GameResult
-    {
-        ONGOING, WHITE_WIN, BLACK_WIN, DRAW
-    };
-    GameState& gameState() { return _state; }
-    const GameState& gameState() const { return _state; }
-    
-    void start();
-    vector<Square> getPossibleMoveCandidates() const;
-    vector<Square> getPossibleMoves() const;
-    vector<Square> getAllPossibleMoves() const;
-    bool isValidMove(Square to) const;
-    bool select(Square sq);
-    void unselect() { _state.clearSelection(); _state.possibleMoves().clear(); }
-    bool move(Square to);
-    GameResult isGameOver() const;
-    static bool isCheck(const Game& game, PieceColor color);
-    static bool isValidState(const Game& game);
-    string gameResultToString(GameResult result) const {
-        switch (result) {
-            case GameResult::ONGOING: return "Ongoing";
-            case GameResult::WHITE_WIN: return "White wins";
-            case GameResult::BLACK_WIN: return "Black wins";
-            case GameResult::DRAW: return "Draw";
-            default: return "Unknown";
-        }
-    }
-};
+    static constexpr size_t CAPACITY = 4096;   // power of two; longer lines are dropped
 
-void Game::start()
-{
-    _state.initializeBoard();
-    _state.clearSelection();
-    _state.possibleMoves().clear();
-    _state.setTurn(PieceColor::WHITE);
-}
+    // Contiguous free space for the next read
+    char* writePointer() { return &ring[tail % CAPACITY]; }
+    size_t writeSpace() const { return std::min(CAPACITY - tail % CAPACITY, CAPACITY - (tail - head)); }
 
-vector<Square> Game::getAllPossibleMoves() const
-{
-    Game tempGame = *this;
-    vector<Square> allMoves;
-    for (int x = 0; x < BOARD_SIZE; ++x)
+    // Takes 'size' bytes read to writePointer() and calls 'onEvent' for each complete line
+    template<class Handler>
+    void commit(size_t size, Handler&& onEvent)
     {
-        for (int y = 0; y < BOARD_SIZE; ++y)
-        {
-            Piece piece = tempGame.gameState().pieceAt({x, y});
-            if (piece.first != PieceType::NONE && piece.second == tempGame.gameState().currentTurn())
-            {
-                tempGame.select({x, y});
-                auto moves = tempGame.getPossibleMoves();
-                allMoves.insert(allMoves.end(), moves.begin(), moves.end());
-                tempGame.unselect();
-            }
-        }
-    }
-    return allMoves;
-}
-
-Game::GameResult Game::isGameOver() const 
-{ 
-    if (getAllPossibleMoves().empty())
-    {
-        if (isCheck(*this, _state.currentTurn()))
-        {
-            // Checkmate
-            return (_state.currentTurn() == PieceColor::WHITE) ? GameResult::BLACK_WIN : GameResult::WHITE_WIN;
-        }
-        else
-        {
-            // Stalemate
-            return GameResult::DRAW;
-        }
-    }
-    else
-    {
-        return GameResult::ONGOING;
-    }
-}
-
-bool Game::isCheck(const Game& game, PieceColor color)
-{
-    Square kingPos = GameState::INVALID_SQUARE;
-    for (int x = 0; x < BOARD_SIZE; ++x)
-    {
-        for (int y = 0; y < BOARD_SIZE; ++y)
-        {
-            Piece piece = game.gameState().pieceAt({x, y});
-            if (piece.first == PieceType::KING && piece.second == color)
-            {
-                kingPos = {x, y};
-                break;
-            }
+        const char* data = writePointer();
+        size_t offset = 0;
+        while (const void* found = memchr(data + offset, '\n', size - offset)) {
+            const size_t lineEnd = tail + (static_cast<const char*>(found) - data);
+            UciEvent event;
+            if (!overflow && parse(lineAt(head, lineEnd), event)) onEvent(event);
+            overflow = false;
+            head = lineEnd + 1;
+            offset = head - tail;
         }
-        if (kingPos != GameState::INVALID_SQUARE) break;
-    }
-    if (kingPos == GameState::INVALID_SQUARE) return false;
-
-    for (int x = 0; x < BOARD_SIZE; ++x)
-    {
-        for (int y = 0; y < BOARD_SIZE; ++y)
-        {
-            Piece piece = game.gameState().pieceAt({x, y});
-            if (piece.first != PieceType::NONE && piece.second != color)
-            {
-                Game tempGame = game;
-                tempGame.gameState().selectSquare({x, y});
-                tempGame.gameState().setTurn(piece.second);
-                auto moves = tempGame.getPossibleMoveCandidates();
-                if (ranges::find(moves, kingPos) != moves.end())
-                {
-                    return true;
-                }
-            }
+        tail += size;
+        // Full without a line end: the rest of that line is skipped
+        if (tail - head == CAPACITY) {
+            overflow = true;
+            head = tail;
         }
     }
 
-    return false;
-}
-
-bool Game::isValidState(const Game& game)
-{
-    if (game.gameState().currentTurn() != PieceColor::WHITE && game.gameState().currentTurn() != PieceColor::BLACK)
-    {
-        return false;
-    }
-
-    if (isCheck(game, PieceColor::WHITE) && game.gameState().currentTurn() == PieceColor::BLACK)
-    {
-        return false;
-    }
-
-    if (isCheck(game, PieceColor::BLACK) && game.gameState().currentTurn() == PieceColor::WHITE)
-    {
-        return false;
-    }
-
-    return true;
-}
-
-vector<Square> Game::getPossibleMoveCandidates() const
-{
-    vector<Square> possibleMoves;
-    if (_state.getSelectedSquare() != GameState::INVALID_SQUARE)
-    {
-        Piece piece = _state.pieceAt(_state.getSelectedSquare());
-        if (piece.first != PieceType::NONE && piece.second == _state.currentTurn())
-        {
-            if (piece.first == PieceType::PAWN)
-            {
-                int direction = (piece.second == PieceColor::WHITE) ? 1 : -1;
-                Square front = {_state.getSelectedSquare().first, _state.getSelectedSquare().second + direction};
-                if (front.second >= 0 && front.second < BOARD_SIZE && _state.pieceAt(front).first == PieceType::NONE)
-                {
-                    possibleMoves.push_back(front);
-                }
-                Square doubleFront = {_state.getSelectedSquare().first, _state.getSelectedSquare().second + 2 * direction};
-                if ((piece.second == PieceColor::WHITE && _state.getSelectedSquare().second == 1) ||
-                    (piece.second == PieceColor::BLACK && _state.getSelectedSquare().second == 6))
-                {
-                    if (doubleFront.second >= 0 && doubleFront.second < BOARD_SIZE && _state.pieceAt(doubleFront).first == PieceType::NONE && _state.pieceAt(front).first == PieceType::NONE)
-                    {
-                        possibleMoves.push_back(doubleFront);
-                    }
-                }
-
-                // Capture moves
-                Square captureLeft = {_state.getSelectedSquare().first - 1, _state.getSelectedSquare().second + direction};
-                Square captureRight = {_state.getSelectedSquare().first + 1, _state.getSelectedSquare().second + direction};
-                if (captureLeft.first >= 0 && captureLeft.first < BOARD_SIZE && captureLeft.second >= 0 && captureLeft.second < BOARD_SIZE)
-                {
-                    Piece target = _state.pieceAt(captureLeft);
-                    if (target.first != PieceType::NONE && target.second != piece.second)
-                    {
-                        possibleMoves.push_back(captureLeft);
-                    }
-                }
-                if (captureRight.first >= 0 && captureRight.first < BOARD_SIZE && captureRight.second >= 0 && captureRight.second < BOARD_SIZE)
-                {
-                    Piece target = _state.pieceAt(captureRight);
-                    if (target.first != PieceType::NONE && target.second != piece.second)
-                    {
-                        possibleMoves.push_back(captureRight);
-                    }
-                }
-            }
-            else if (piece.first == PieceType::KNIGHT)
-            {
-                vector<Square> knightMoves = {
-                    {1, 2}, {2, 1}, {2, -1}, {1, -2},
-                    {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}
-                };
-                for (const auto& move : knightMoves)
-                {
-                    Square target = {_state.getSelectedSquare().first + move.first, _state.getSelectedSquare().second + move.second};
-                    if (target.first >= 0 && target.first < BOARD_SIZE && target.second >= 0 && target.second < BOARD_SIZE)
-                    {
-                        Piece targetPiece = _state.pieceAt(target);
-                        if (targetPiece.first == PieceType::NONE || targetPiece.second != piece.second)
-                        {
-                            possibleMoves.push_back(target);
-                        }
-                    }
-                }
-            }
-            else if (piece.first == PieceType::KING)
-            {
-                vector<Square> kingMoves = {
-                    {1, 1}, {1, 0}, {1, -1},
-                    {0, -1}, {-1, -1}, {-1, 0},
-                    {-1, 1}, {0, 1}
-                };
-                for (const auto& move : kingMoves)
-                {
-                    Square target = {_state.getSelectedSquare().first + move.first, _state.getSelectedSquare().second + move.second};
-                    if (target.first >= 0 && target.first < BOARD_SIZE && target.second >= 0 && target.second < BOARD_SIZE)
-                    {
-                        Piece targetPiece = _state.pieceAt(target);
-                        if (targetPiece.first == PieceType::NONE || targetPiece.second != piece.second)
-                        {
-                            possibleMoves.push_back(target);
-                        }
-                    }
-                }
+    static bool parse(std::string_view line, UciEvent& event);
 
-                // castling
-                // Simple castling logic: allow castling if king and rook are in initial positions and squares between are empty
-                // No check/checkmate validation, no castling rights tracking, no move history
-
-                int y = (_state.currentTurn() == PieceColor::WHITE) ? 0 : 7;
-                Square kingStart = {4, y};
-                if (_state.getSelectedSquare() == kingStart)
-                {
-                    // King-side castling
-                    Square rookKingSide = {7, y};
-                    Piece rookPiece = _state.pieceAt(rookKingSide);
-                    if (rookPiece.first == PieceType::ROOK && rookPiece.second == piece.second)
-                    {
-                        bool empty = true;
-                        for (int x = 5; x < 7; ++x)
-                        {
-                            if (_state.pieceAt({x, y}).first != PieceType::NONE)
-                            {
-                                empty = false;
-                                break;
-                            }
-                        }
-                        if (empty)
-                        {
-                            possibleMoves.push_back({6, y});
-                        }
-                    }
-                    // Queen-side castling
-                    Square rookQueenSide = {0, y};
-                    rookPiece = _state.pieceAt(rookQueenSide);
-                    if (rookPiece.first == PieceType::ROOK && rookPiece.second == piece.second)
-                    {
-                        bool empty = true;
-                        for (int x = 1; x < 4; ++x)
-                        {
-                            if (_state.pieceAt({x, y}).first != PieceType::NONE)
-                            {
-                                empty = false;
-                                break;
-                            }
-                        }
-                        if (empty)
-                        {
-                            possibleMoves.push_back({2, y});
-                        }
-                    }
-                }
-            }
-            else if (piece.first == PieceType::ROOK || piece.first == PieceType::BISHOP || piece.first == PieceType::QUEEN)
-            {
-                vector<Square> directions;
-                if (piece.first == PieceType::ROOK || piece.first == PieceType::QUEEN)
-                {
-                    directions.insert(directions.end(), {{1, 0}, {-1, 0}, {0, 1}, {0, -1}});
-                }
-                if (piece.first == PieceType::BISHOP || piece.first == PieceType::QUEEN)
-                {
-                    directions.insert(directions.end(), {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}});
-                }
-
-                for (const auto& dir : directions)
-                {
-                    Square target = _state.getSelectedSquare();
-                    while (true)
-                    {
-                        target.first += dir.first;
-                        target.second += dir.second;
-                        if (target.first < 0 || target.first >= BOARD_SIZE || target.second < 0 || target.second >= BOARD_SIZE)
-                        {
-                            break;
-                        }
-                        Piece targetPiece = _state.pieceAt(target);
-                        if (targetPiece.first == PieceType::NONE)
-                        {
-                            possibleMoves.push_back(target);
-                        }
-                        else
-                        {
-                            if (targetPiece.second != piece.second)
-                            {
-                                possibleMoves.push_back(target);
-                            }
-                            break;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    return possibleMoves;
-}
+private:
+    std::string_view lineAt(size_t first, size_t last);
+    static std::string_view nextToken(std::string_view& rest);
+    static int toInt(std::string_view token);
+
+    char ring[CAPACITY];
+    char line[CAPACITY];    // a line wrapping around the end of the ring is copied here
+    size_t head = 0;        // start of the current line
+    size_t tail = 0;        // end of the data read
+    bool overflow = false;
+};
 
-vector<Square> Game::getPossibleMoves() const
+std::string_view UciParser::lineAt(size_t first, size_t last)
 {
-    vector<Square> filteredMoves;
-    auto possibleMoves = getPossibleMoveCandidates();
-    for (auto candidateMove : possibleMoves)
-    {
-        Game tempGame = *this;
-        bool moved = tempGame.move(candidateMove);
-        if (moved && isValidState(tempGame))
-        {
-            filteredMoves.push_back(candidateMove);
-        }
+    const size_t start = first % CAPACITY;
+    size_t length = last - first;
+    const char* text = &ring[start];
+    if (start + length > CAPACITY) {
+        const size_t split = CAPACITY - start;
+        memcpy(line, &ring[start], split);
+        memcpy(line + split, ring, length - split);
+        text = line;
     }
-
-    return filteredMoves;
+    if (length > 0 && text[length - 1] == '\r') --length;
+    return std::string_view(text, length);
 }
 
-bool Game::select(Square sq)
+std::string_view UciParser::nextToken(std::string_view& rest)
 {
-    Piece piece = _state.pieceAt(sq);
-    if (piece.first != PieceType::NONE && piece.second == _state.currentTurn())
-    {
-        _state.selectSquare(sq);
-        _state.possibleMoves() = getPossibleMoves();
-        return true;
-    }
-    return false;
+    const size_t start = std::min(rest.find_first_not_of(' '), rest.size());
+    const size_t end = std::min(rest.find(' ', start), rest.size());
+    std::string_view token = rest.substr(start, end - start);
+    rest.remove_prefix(end);
+    return token;
 }
 
-bool Game::isValidMove(Square to) const
+int UciParser::toInt(std::string_view token)
 {
-    return _state.getSelectedSquare() != GameState::INVALID_SQUARE &&
-           ranges::find(_state.possibleMoves(), to) != _state.possibleMoves().end();
+    int value = 0;
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
 }
 
-bool Game::move(Square to)
+bool UciParser::parse(std::string_view line, UciEvent& event)
 {
-    bool isCastling = to.second == _state.getSelectedSquare().second &&
-                        abs(to.first - _state.getSelectedSquare().first) == 2 &&
-                        _state.pieceAt(_state.getSelectedSquare()).first == PieceType::KING;
-    if (isCastling)
-    {
-        // Move the rook as well
-        int y = _state.getSelectedSquare().second;
-        if (to.first == 6) // King-side castling
-        {
-            _state.movePiece({7, y}, {5, y});
-        }
-        else if (to.first == 2) // Queen-side castling
-        {
-            _state.movePiece({0, y}, {3, y});
+    std::string_view token = nextToken(line);
+    if (token == "uciok") {
+        event.type = UciEvent::Type::UCIOK;
+    } else if (token == "readyok") {
+        event.type = UciEvent::Type::READYOK;
+    } else if (token == "bestmove") {
+        event.type = UciEvent::Type::BESTMOVE;
+        event.move = nextToken(line);
+        if (nextToken(line) == "ponder") event.ponder = nextToken(line);
+    } else if (token == "info") {
+        event.type = UciEvent::Type::INFO;
+        while (!(token = nextToken(line)).empty()) {
+            if (token == "depth") {
+                event.depth = toInt(nextToken(line));
+            } else if (token == "score") {
+                event.hasScore = true;
+                event.mate = nextToken(line) == "mate";
+                event.score = toInt(nextToken(line));
+            } else if (token == "pv") {
+                // The rest of the line
+                line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+                event.pv = line;
+                break;
+            } else if (token == "string") {
+                break;  // free text
+            }
         }
+    } else {
+        return false;
     }
-    _state.movePiece(_state.getSelectedSquare(), to);
-
-    bool isPromotion = _state.pieceAt(to).first == PieceType::PAWN &&
-                        (to.second == 0 || to.second == BOARD_SIZE - 1);
-    if (isPromotion)
-    {
-        _state.pieceAt(to) = Piece { PieceType::QUEEN, _state.pieceAt(to).second }; // Auto-promote to queen
-    }
-    _state.clearSelection();
-    _state.switchTurn();
-    _state.possibleMoves().clear();
     return true;
 }
 
 //------------------------------------------------------------------------------
 // Chess Engine Interface (Stockfish)
 //------------------------------------------------------------------------------
+// The engine's output is read on a thread of its own and parsed as it
+// arrives, so a search never blocks the caller: its best move is handed
+// over through a future the moment the engine prints it.
 class StockfishEngine
 {
 public:
@@ -592,13 +204,29 @@ public:
     bool start(const std::string& path);
     void stop();
     void sendCommand(const std::string& cmd);
-    std::string readResponse();
-    std::string getMove(std::string positionFEN, int timeMs);
+    // Starts a search of 'timeMs' on the game's position. The future gets the best
+    // move, or an empty string if the search is cancelled or the engine quits;
+    // 'onReady' is then called on the reader thread (e.g. to wake up the UI).
+    std::future<std::string> requestMove(const GameState& position, int timeMs, std::function<void()> onReady = nullptr);
+    // Stops the search in progress, its future gets an empty move
+    void cancel();
+    // Searches and waits for the result
+    std::string getMove(const GameState& position, int timeMs);
     void setElo(int elo);
 
     bool isRunning() const { return running; }
 
 private:
+    void readerLoop();
+    void handleEvent(const UciEvent& event);
+    // Sends 'cmd' and waits until the engine answers with 'reply'
+    bool sendAndWait(const std::string& cmd, UciEvent::Type reply, std::chrono::milliseconds timeout);
+    // Brings the "position" command up to the game: the moves the engine has
+    // already seen are kept, only the new ones are appended
+    void updatePosition(const GameState& position);
+    // Hands the result of the requested search over, with the mutex held
+    void finishSearch(const std::string& move, std::unique_lock<std::mutex>& lock);
+
 #ifdef _WIN32
     HANDLE hProcess = NULL;
     HANDLE hChildStdinWr = NULL;
@@ -608,7 +236,25 @@ private:
     int to_engine = -1;
     int from_engine = -1;
 #endif
-    bool running = false;
+    std::atomic<bool> running = false;
+    std::thread reader;
+
+    std::mutex mutex;
+    std::promise<void> reply;
+    UciEvent::Type awaitedReply = UciEvent::Type::UCIOK;
+    bool replyPending = false;
+    std::promise<std::string> bestMove;
+    bool movePending = false;
+    std::function<void()> onMoveReady;
+    // "go" commands whose "bestmove" has not arrived yet; a cancelled search
+    // still answers, only the answer to the last one is handed over
+    int searches = 0;
+
+    // Sent before every search: the start of the game and all its moves, so the
+    // engine knows the repetitions and keeps its hash table from move to move
+    std::string positionCommand;
+    std::string positionFen;
+    std::vector<Move> positionMoves;
 };
 
 bool StockfishEngine::start(const std::string& path)
@@ -676,36 +322,55 @@ bool StockfishEngine::start(const std::string& path)
     }
 #endif
 
-    sendCommand("uci");
-    std::string response;
-    for (int i = 0; i < 10; ++i) {
-        response = readResponse();
-        if (response.find("uciok") != std::string::npos) break;
-#ifdef _WIN32
-        Sleep(10);
-#else
-        usleep(10000);
-#endif
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        searches = 0;
     }
+    positionCommand.clear();
+    reader = std::thread(&StockfishEngine::readerLoop, this);
+    if (sendAndWait("uci", UciEvent::Type::UCIOK, std::chrono::seconds(2)))
+        sendAndWait("isready", UciEvent::Type::READYOK, std::chrono::seconds(2));
     return running;
 }
 
+bool StockfishEngine::sendAndWait(const std::string& cmd, UciEvent::Type replyType, std::chrono::milliseconds timeout)
+{
+    std::future<void> replied;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return false;
+        reply = std::promise<void>();
+        replied = reply.get_future();
+        awaitedReply = replyType;
+        replyPending = true;
+    }
+    sendCommand(cmd);
+    return replied.wait_for(timeout) == std::future_status::ready && running;
+}
+
 void StockfishEngine::stop()
 {
 #ifdef _WIN32
     if (hProcess) {
         TerminateProcess(hProcess, 0);
+        WaitForSingleObject(hProcess, INFINITE);
         CloseHandle(hProcess);
         hProcess = NULL;
     }
-    if (hChildStdinWr) { CloseHandle(hChildStdinWr); hChildStdinWr = NULL; }
-    if (hChildStdoutRd) { CloseHandle(hChildStdoutRd); hChildStdoutRd = NULL; }
 #else
     if (pid > 0) {
         kill(pid, SIGTERM);
         waitpid(pid, nullptr, 0);
         pid = -1;
     }
+#endif
+    // The engine is gone, so the reader sees the end of its output; the pipes
+    // are only closed once it no longer reads from them
+    if (reader.joinable()) reader.join();
+#ifdef _WIN32
+    if (hChildStdinWr) { CloseHandle(hChildStdinWr); hChildStdinWr = NULL; }
+    if (hChildStdoutRd) { CloseHandle(hChildStdoutRd); hChildStdoutRd = NULL; }
+#else
     if (to_engine != -1) { close(to_engine); to_engine = -1; }
     if (from_engine != -1) { close(from_engine); from_engine = -1; }
 #endif
@@ -724,69 +389,134 @@ void StockfishEngine::sendCommand(const std::string& cmd)
 #endif
 }
 
-std::string StockfishEngine::readResponse()
+void StockfishEngine::readerLoop()
 {
-    if (!running) return "";
-    std::string result;
-    char buffer[1024];
-#ifdef _WIN32
-    DWORD read = 0;
+    // The parser's buffers are kept off the thread's stack
+    auto parser = std::make_unique<UciParser>();
+    auto onEvent = [this](const UciEvent& event) { handleEvent(event); };
     while (true) {
-        if (!ReadFile(hChildStdoutRd, buffer, sizeof(buffer) - 1, &read, NULL) || read == 0)
+#ifdef _WIN32
+        DWORD n = 0;
+        if (!ReadFile(hChildStdoutRd, parser->writePointer(), (DWORD)parser->writeSpace(), &n, NULL) || n == 0)
+            break;
+#else
+        pollfd fd = { from_engine, POLLIN, 0 };
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
             break;
-        buffer[read] = 0;
-        result += buffer;
-        if (result.find("bestmove") != std::string::npos || result.find("uciok") != std::string::npos)
+        }
+        ssize_t n = read(from_engine, parser->writePointer(), parser->writeSpace());
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+        if (n <= 0)
             break;
-        Sleep(10);
+#endif
+        parser->commit(n, onEvent);
     }
-#else
-    ssize_t n;
-    for (int i = 0; i < 100; ++i) {
-        n = read(from_engine, buffer, sizeof(buffer) - 1);
-        if (n > 0) {
-            buffer[n] = 0;
-            result += buffer;
-            if (result.find("bestmove") != std::string::npos || result.find("uciok") != std::string::npos)
-                break;
-        } else {
-            usleep(10000);
+
+    // Nothing more will come, nobody may wait for it
+    std::unique_lock<std::mutex> lock(mutex);
+    running = false;
+    if (replyPending) {
+        replyPending = false;
+        reply.set_value();
+    }
+    searches = 0;
+    finishSearch("", lock);
+}
+
+void StockfishEngine::handleEvent(const UciEvent& event)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    switch (event.type) {
+        case UciEvent::Type::UCIOK:
+        case UciEvent::Type::READYOK:
+            if (replyPending && event.type == awaitedReply) {
+                replyPending = false;
+                reply.set_value();
+            }
+            break;
+        case UciEvent::Type::BESTMOVE:
+            if (searches > 0) --searches;
+            if (searches == 0) finishSearch(std::string(event.move), lock);
+            break;
+        case UciEvent::Type::INFO:
+            // The search progress is not shown
+            break;
+    }
+}
+
+void StockfishEngine::finishSearch(const std::string& move, std::unique_lock<std::mutex>& lock)
+{
+    if (!movePending) return;
+    movePending = false;
+    bestMove.set_value(move);
+    std::function<void()> onReady = std::move(onMoveReady);
+    onMoveReady = nullptr;
+    lock.unlock();
+    if (onReady) onReady();
+    lock.lock();
+}
+
+void StockfishEngine::updatePosition(const GameState& position)
+{
+    const int plies = position.playedMoveCount();
+    bool continues = !positionCommand.empty() && position.startFen() == positionFen && plies >= int(positionMoves.size());
+    for (int i = 0; continues && i < int(positionMoves.size()); ++i)
+        continues = position.playedMove(i) == positionMoves[i];
+
+    if (!continues) {
+        // Another game (or moves taken back)
+        sendCommand("ucinewgame");
+        positionFen = position.startFen();
+        positionCommand = positionFen.empty() ? "position startpos" : "position fen " + positionFen;
+        positionMoves.clear();
+    }
+    for (int i = int(positionMoves.size()); i < plies; ++i) {
+        Move move = position.playedMove(i);
+        positionCommand += positionMoves.empty() ? " moves " : " ";
+        positionCommand += move.toUci();
+        positionMoves.push_back(move);
+    }
+}
+
+std::future<std::string> StockfishEngine::requestMove(const GameState& position, int timeMs, std::function<void()> onReady)
+{
+    cancel();
+    std::promise<std::string> promise;
+    std::future<std::string> result = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            promise.set_value("");
+            return result;
         }
+        bestMove = std::move(promise);
+        movePending = true;
+        onMoveReady = std::move(onReady);
+        ++searches;
     }
-#endif
+    updatePosition(position);
+    sendCommand(positionCommand);
+    sendCommand("go movetime " + std::to_string(timeMs));
     return result;
 }
 
-std::string StockfishEngine::getMove(std::string positionFEN, int timeMs)
+void StockfishEngine::cancel()
 {
-    if (!running) return "";
-    sendCommand("position fen " + positionFEN);
-    sendCommand("go movetime " + std::to_string(timeMs));
-    std::string bestMove;
-#ifdef _WIN32
-    Sleep(timeMs + 100);
-#else
-    usleep((timeMs + 100) * 1000);
-#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!movePending) return;
+    finishSearch("", lock);
+    lock.unlock();
+    sendCommand("stop");
+}
 
-    for (int i = 0; i < 100; ++i) {
-        std::string response = readResponse();
-        auto pos = response.find("bestmove");
-        if (pos != std::string::npos) {
-            size_t moveStart = pos + 9;
-            while (moveStart < response.size() && response[moveStart] == ' ') ++moveStart;
-            size_t moveEnd = moveStart;
-            while (moveEnd < response.size() && response[moveEnd] != ' ' && response[moveEnd] != '\n') ++moveEnd;
-            bestMove = response.substr(moveStart, moveEnd - moveStart);
-            break;
-        }
-#ifdef _WIN32
-        Sleep(10);
-#else
-        usleep(10000);
-#endif
+std::string StockfishEngine::getMove(const GameState& position, int timeMs)
+{
+    std::future<std::string> move = requestMove(position, timeMs);
+    if (move.wait_for(std::chrono::milliseconds(timeMs + 5000)) != std::future_status::ready) {
+        cancel();
     }
-    return bestMove;
+    return move.get();
 }
 
 void StockfishEngine::setElo(int elo) {
@@ -1080,7 +810,7 @@ void SdlRenderer::zoomOut()
 
 void SdlRenderer::render()
 {
-    auto possibleMoves = _gs.possibleMoves();
+    const MoveList& possibleMoves = _gs.possibleMoves();
     for (int y = 0; y < BOARD_SIZE; ++y) 
     {
         for (int x = 0; x < BOARD_SIZE; ++x) 
@@ -1106,7 +836,7 @@ void SdlRenderer::render()
             SDL_SetRenderDrawBlendMode(_renderer, SDL_BLENDMODE_NONE);
             SDL_RenderFillRect(_renderer, &rect);
 
-            if (ranges::find(possibleMoves, Square{x, y}) != possibleMoves.end())
+            if (ranges::any_of(possibleMoves, [&](Move move) { return move.to() == squareIndex({x, y}); }))
             {
                 SDL_SetRenderDrawColor(_renderer, 0x00, 0xFF, 0x00, 0x80);
                 SDL_SetRenderDrawBlendMode(_renderer, SDL_BLENDMODE_BLEND);
@@ -1231,6 +961,18 @@ int main(int argc, char* argv[])
     bool paused = false;
     bool quit = false;
 
+    // The engine thinks while the UI keeps running; its move is played when it arrives
+    std::future<string> engineMove;
+    uint64_t engineMoveKey = 0;
+    const Uint32 engineMoveEvent = SDL_RegisterEvents(1);
+    // The board takes no clicks while the engine is thinking about the position
+    auto engineThinking = [&]() { return engineMove.valid() && !paused; };
+    // With the game paused the player may move for the engine, its search is then obsolete
+    auto playerMove = [&](Square sq) {
+        if (engineMove.valid()) engine.cancel();
+        game.move(sq);
+    };
+
     while (!quit)
     {
         if (needRedraw)
@@ -1238,26 +980,45 @@ int main(int argc, char* argv[])
             sdlRenderer.render();
             needRedraw = false;
         }
-        SDL_Delay(UI_POLL_PERIOD_MS);
+        // Returns early on any event, the engine's move included
+        SDL_WaitEventTimeout(nullptr, UI_POLL_PERIOD_MS);
+
+        if (game.gameState().currentTurn() == aiColor && !paused && !engineMove.valid())
+        {
+            engineMoveKey = game.gameState().key();
+            engineMove = engine.requestMove(game.gameState(), 100, [engineMoveEvent]() {
+                SDL_Event event{};
+                event.type = engineMoveEvent;
+                if (engineMoveEvent) SDL_PushEvent(&event);
+            });
+        }
 
-        if (game.gameState().currentTurn() == aiColor && !paused)
+        if (engineMove.valid() && engineMove.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
         {
-            string fen = game.gameState().generateFen();
-            string bestMove = engine.getMove(fen, 100);
-            if (bestMove.size() >= 4)
+            string bestMove = engineMove.get();
+            // Dropped if the position changed while the engine was thinking (restart, a move made for it)
+            if (game.gameState().key() == engineMoveKey && bestMove.size() >= 4)
             {
                 int fromX = bestMove[0] - 'a';
                 int fromY = bestMove[1] - '1';
                 int toX = bestMove[2] - 'a';
                 int toY = bestMove[3] - '1';
-                if (fromX >= 0 && fromX < BOARD_SIZE && fromY >= 0 && fromY < BOARD_SIZE &&
-                    toX >= 0 && toX < BOARD_SIZE && toY >= 0 && toY < BOARD_SIZE)
+                PieceType promotion = PieceType::QUEEN;
+                if (bestMove.size() >= 5)
                 {
-                    game.select({fromX, fromY});
-                    //if (game.isValidMove({toX, toY}))  // Stockfish knows rules better than us
+                    switch (bestMove[4])
                     {
-                        game.move({toX, toY});
+                        case 'r': promotion = PieceType::ROOK; break;
+                        case 'b': promotion = PieceType::BISHOP; break;
+                        case 'n': promotion = PieceType::KNIGHT; break;
+                        default: break;
                     }
+                }
+                if (fromX >= 0 && fromX < BOARD_SIZE && fromY >= 0 && fromY < BOARD_SIZE &&
+                    toX >= 0 && toX < BOARD_SIZE && toY >= 0 && toY < BOARD_SIZE)
+                {
+                    // Not checked against our own move list, Stockfish knows rules better than us
+                    game.move(game.gameState().moveFor({fromX, fromY}, {toX, toY}, promotion));
                     needRedraw = true;
                 }
             }
@@ -1290,6 +1051,7 @@ int main(int argc, char* argv[])
                 }
                 else if(e.key.key == SDLK_R)
                 {
+                    engine.cancel();
                     game.start();
                     needRedraw = true;
                 }
@@ -1301,7 +1063,7 @@ int main(int argc, char* argv[])
                 if (e.button.button == SDL_BUTTON_LEFT)
                 {
                     auto sq = sdlRenderer.getSquareAtScreenPos(x, y);
-                    if (sq != GameState::INVALID_SQUARE)
+                    if (sq != GameState::INVALID_SQUARE && !engineThinking())
                     {
                         Piece piece = game.gameState().pieceAt(sq);
                         if (game.gameState().currentTurn() == piece.second && piece.second != PieceColor::NONE)
@@ -1315,7 +1077,7 @@ int main(int argc, char* argv[])
                             {
                                 if (game.isValidMove(sq))
                                 {
-                                    game.move(sq);
+                                    playerMove(sq);
                                 }
                             }
                         }
@@ -1331,11 +1093,12 @@ int main(int argc, char* argv[])
                 int x = (int)e.button.x;
                 int y = (int)e.button.y;
                 auto sq = sdlRenderer.getSquareAtScreenPos(x, y);
-                if (sq != GameState::INVALID_SQUARE && game.gameState().getSelectedSquare() != GameState::INVALID_SQUARE)
+                if (sq != GameState::INVALID_SQUARE && game.gameState().getSelectedSquare() != GameState::INVALID_SQUARE &&
+                    !engineThinking())
                 {
                     if (game.isValidMove(sq))
                     {
-                        bool moved = game.move(sq);
+                        playerMove(sq);
                     }
                 }
             }